@@ -0,0 +1,494 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gi18n.h>
+
+#include "daemon.h"
+#include "admission.h"
+
+/**
+ * SECTION: Admission
+ * @title: Admission
+ * @short_description: Admission control for D-Bus method calls.
+ *
+ * Every method call on an exported object passes a token bucket of its
+ * sender before it is dispatched, a client calling in a loop is rejected
+ * with a LimitsExceeded error once its bucket is empty. Calls in flight,
+ * i.e. invocations not yet completed, are bounded per subsystem as well.
+ *
+ * The checks run in the main context as first handler of the handle-*
+ * signals the method calls are dispatched by, a rejected call does not
+ * reach the object. Unlike an authorization handler this takes no thread
+ * hop, so calls of a client are handled in the order they were sent.
+ *
+ * Link polling and kernel events are dispatched at a higher priority than
+ * D-Bus method calls, so they are not starved by a busy bus.
+ */
+
+/* Interval in milli-seconds idle token buckets are pruned with. */
+#define PRUNE_INTERVAL 60000
+
+typedef enum
+{
+  SUBSYSTEM_MANAGER,
+  SUBSYSTEM_INTERFACES,
+  SUBSYSTEM_SETTINGS,
+  SUBSYSTEM_CONNECTIONS,
+  SUBSYSTEM_OTHER,
+  N_SUBSYSTEMS,
+} Subsystem;
+
+static const gchar * const subsystem_names[N_SUBSYSTEMS] =
+{
+  "manager", "interfaces", "settings", "connections", "other",
+};
+
+static GType (*interface_types[]) (void) =
+{
+  loom_manager_get_type,
+  loom_interfaces_get_type,
+  loom_interface_get_type,
+  loom_settings_get_type,
+  loom_setting_get_type,
+  loom_connections_get_type,
+  loom_connection_get_type,
+  loom_metrics_get_type,
+};
+
+/* Shared with pending invocations, which may outlive the #Admission. */
+typedef struct
+{
+  gint ref_count;
+  gint counts[N_SUBSYSTEMS];
+} InFlight;
+
+typedef struct
+{
+  InFlight *in_flight;
+  Subsystem subsystem;
+} InFlightSlot;
+
+typedef struct
+{
+  gdouble tokens;
+  gint64 time;
+} Bucket;
+
+struct _Admission
+{
+  Daemon *daemon;
+  GDBusObjectManager *object_manager;
+
+  gdouble rate;
+  gdouble burst;
+  gint max_in_flight;
+
+  GHashTable *buckets;
+  InFlight *in_flight;
+  guint prune_job_id;
+};
+
+static InFlight *
+in_flight_ref (InFlight *in_flight)
+{
+  g_atomic_int_inc (&in_flight->ref_count);
+  return in_flight;
+}
+
+static void
+in_flight_unref (InFlight *in_flight)
+{
+  if (g_atomic_int_dec_and_test (&in_flight->ref_count))
+    g_slice_free (InFlight, in_flight);
+}
+
+static void
+on_invocation_finalized (gpointer data,
+                         GObject *where_the_object_was)
+{
+  InFlightSlot *slot = data;
+
+  g_atomic_int_add (&slot->in_flight->counts[slot->subsystem], -1);
+  in_flight_unref (slot->in_flight);
+  g_slice_free (InFlightSlot, slot);
+}
+
+static Subsystem
+get_subsystem (GDBusInterfaceSkeleton *interface)
+{
+  const gchar *name;
+
+  name = g_dbus_interface_skeleton_get_info (interface)->name;
+  if (g_str_equal (name, "org.blackox.Loom.Manager"))
+    return SUBSYSTEM_MANAGER;
+  if (g_str_has_prefix (name, "org.blackox.Loom.Interface"))
+    return SUBSYSTEM_INTERFACES;
+  if (g_str_has_prefix (name, "org.blackox.Loom.Setting"))
+    return SUBSYSTEM_SETTINGS;
+  if (g_str_has_prefix (name, "org.blackox.Loom.Connection"))
+    return SUBSYSTEM_CONNECTIONS;
+
+  return SUBSYSTEM_OTHER;
+}
+
+static gchar *
+get_client_key (GDBusMethodInvocation *invocation)
+{
+  const gchar *sender;
+
+  sender = g_dbus_method_invocation_get_sender (invocation);
+  if (sender != NULL)
+    return g_strdup (sender);
+
+  /* peer connections have no bus name */
+  return g_strdup_printf ("peer:%p",
+                          g_dbus_method_invocation_get_connection (invocation));
+}
+
+static gboolean
+take_token (Admission *admission,
+            GDBusMethodInvocation *invocation)
+{
+  Bucket *bucket;
+  gboolean ret;
+  gchar *key;
+  gint64 now;
+
+  if (admission->rate <= 0)
+    return TRUE;
+
+  now = g_get_monotonic_time ();
+  key = get_client_key (invocation);
+
+  bucket = g_hash_table_lookup (admission->buckets, key);
+  if (bucket == NULL)
+    {
+      bucket = g_slice_new (Bucket);
+      bucket->tokens = admission->burst;
+      bucket->time = now;
+      g_hash_table_insert (admission->buckets, key, bucket);
+    }
+  else
+    {
+      g_free (key);
+      bucket->tokens = MIN (admission->burst,
+                            bucket->tokens + admission->rate *
+                            (now - bucket->time) / G_USEC_PER_SEC);
+      bucket->time = now;
+    }
+
+  ret = bucket->tokens >= 1;
+  if (ret)
+    bucket->tokens -= 1;
+
+  return ret;
+}
+
+/* Checks and increments the count in one step, invocations may be
+ * finalized and release their slot in other threads meanwhile. */
+static gboolean
+reserve_in_flight (Admission *admission,
+                   Subsystem subsystem)
+{
+  gint *count = &admission->in_flight->counts[subsystem];
+  gint value;
+
+  if (admission->max_in_flight <= 0)
+    {
+      g_atomic_int_inc (count);
+      return TRUE;
+    }
+
+  do
+    {
+      value = g_atomic_int_get (count);
+      if (value >= admission->max_in_flight)
+        return FALSE;
+    }
+  while (!g_atomic_int_compare_and_exchange (count, value, value + 1));
+
+  return TRUE;
+}
+
+static gboolean
+admit (Admission *admission,
+       GDBusInterfaceSkeleton *interface,
+       GDBusMethodInvocation *invocation)
+{
+  Subsystem subsystem;
+  InFlightSlot *slot;
+
+  if (!take_token (admission, invocation))
+    {
+      g_debug ("Rejecting %s.%s of %s, rate limit exceeded",
+               g_dbus_method_invocation_get_interface_name (invocation),
+               g_dbus_method_invocation_get_method_name (invocation),
+               g_dbus_method_invocation_get_sender (invocation));
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                             _("too many requests"));
+      return FALSE;
+    }
+
+  subsystem = get_subsystem (interface);
+  if (!reserve_in_flight (admission, subsystem))
+    {
+      g_debug ("Rejecting %s.%s, too many %s requests in flight",
+               g_dbus_method_invocation_get_interface_name (invocation),
+               g_dbus_method_invocation_get_method_name (invocation),
+               subsystem_names[subsystem]);
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                             _("too many requests in flight"));
+      return FALSE;
+    }
+
+  slot = g_slice_new (InFlightSlot);
+  slot->in_flight = in_flight_ref (admission->in_flight);
+  slot->subsystem = subsystem;
+  g_object_weak_ref (G_OBJECT (invocation), on_invocation_finalized, slot);
+
+  return TRUE;
+}
+
+/* Marshals any handle-* signal, whose first arguments are the interface
+ * and the invocation. Returning %TRUE stops the emission, the call is
+ * handled by the error reply. */
+static void
+on_method_call (GClosure *closure,
+                GValue *return_value,
+                guint n_param_values,
+                const GValue *param_values,
+                gpointer invocation_hint,
+                gpointer marshal_data)
+{
+  gboolean handled;
+
+  handled = !admit (closure->data, g_value_get_object (&param_values[0]),
+                    g_value_get_object (&param_values[1]));
+  if (return_value != NULL)
+    g_value_set_boolean (return_value, handled);
+}
+
+static void
+watch_interface (Admission *admission,
+                 GDBusInterface *interface)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (interface_types); i++)
+    {
+      GType type = interface_types[i] ();
+      guint *ids;
+      guint n_ids;
+
+      if (!G_TYPE_CHECK_INSTANCE_TYPE (interface, type))
+        continue;
+
+      ids = g_signal_list_ids (type, &n_ids);
+      for (guint j = 0; j < n_ids; j++)
+        {
+          GClosure *closure;
+
+          if (!g_str_has_prefix (g_signal_name (ids[j]), "handle-"))
+            continue;
+
+          closure = g_closure_new_simple (sizeof (GClosure), admission);
+          g_closure_set_marshal (closure, on_method_call);
+          g_signal_connect_closure_by_id (interface, ids[j], 0, closure,
+                                          FALSE);
+        }
+      g_free (ids);
+    }
+}
+
+static void
+on_interface_added (GDBusObject *object,
+                    GDBusInterface *interface,
+                    gpointer user_data)
+{
+  watch_interface (user_data, interface);
+}
+
+static void
+on_interface_removed (GDBusObject *object,
+                      GDBusInterface *interface,
+                      gpointer user_data)
+{
+  g_signal_handlers_disconnect_by_data (interface, user_data);
+}
+
+static void
+watch_object (Admission *admission,
+              GDBusObject *object)
+{
+  GList *interfaces;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL; l = l->next)
+    watch_interface (admission, G_DBUS_INTERFACE (l->data));
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_signal_connect (object, "interface-added",
+                    G_CALLBACK (on_interface_added), admission);
+  g_signal_connect (object, "interface-removed",
+                    G_CALLBACK (on_interface_removed), admission);
+}
+
+static void
+unwatch_object (Admission *admission,
+                GDBusObject *object)
+{
+  GList *interfaces;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL; l = l->next)
+    g_signal_handlers_disconnect_by_data (l->data, admission);
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_signal_handlers_disconnect_by_data (object, admission);
+}
+
+static void
+on_object_added (GDBusObjectManager *object_manager,
+                 GDBusObject *object,
+                 gpointer user_data)
+{
+  watch_object (user_data, object);
+}
+
+static void
+on_object_removed (GDBusObjectManager *object_manager,
+                   GDBusObject *object,
+                   gpointer user_data)
+{
+  unwatch_object (user_data, object);
+}
+
+static gboolean
+on_prune_job (gpointer user_data)
+{
+  Admission *admission = user_data;
+  GHashTableIter iter;
+  gpointer value;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  /* a bucket refilled to the burst size carries no state */
+  g_hash_table_iter_init (&iter, admission->buckets);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Bucket *bucket = value;
+
+      if (bucket->tokens + admission->rate *
+          (now - bucket->time) / G_USEC_PER_SEC >= admission->burst)
+        g_hash_table_iter_remove (&iter);
+    }
+
+  return FALSE;
+}
+
+static void
+bucket_free (Bucket *bucket)
+{
+  g_slice_free (Bucket, bucket);
+}
+
+/**
+ * admission_new:
+ * @daemon: A #Daemon.
+ *
+ * Creates a new #Admission guarding all objects exported by the object
+ * manager of @daemon, including objects exported later on.
+ *
+ * Returns: A new #Admission. Free with admission_free().
+ */
+Admission *
+admission_new (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+
+  Admission *admission;
+  GList *objects;
+
+  admission = g_slice_new0 (Admission);
+  admission->daemon = daemon;
+  admission->object_manager =
+    G_DBUS_OBJECT_MANAGER (daemon_get_object_manager (daemon));
+
+  admission->rate = daemon_config_get_integer (daemon, "Admission",
+                                               "Rate", 50);
+  admission->burst = MAX (1, daemon_config_get_integer (daemon, "Admission",
+                                                        "Burst", 100));
+  admission->max_in_flight = daemon_config_get_integer (daemon, "Admission",
+                                                        "MaxInFlight", 64);
+
+  admission->buckets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify) bucket_free);
+  admission->in_flight = g_slice_new0 (InFlight);
+  admission->in_flight->ref_count = 1;
+
+  objects = g_dbus_object_manager_get_objects (admission->object_manager);
+  for (GList *l = objects; l != NULL; l = l->next)
+    watch_object (admission, G_DBUS_OBJECT (l->data));
+  g_list_free_full (objects, g_object_unref);
+
+  g_signal_connect (admission->object_manager, "object-added",
+                    G_CALLBACK (on_object_added), admission);
+  g_signal_connect (admission->object_manager, "object-removed",
+                    G_CALLBACK (on_object_removed), admission);
+
+  admission->prune_job_id =
+    scheduler_add (daemon_get_scheduler (daemon), "admission-prune",
+                   PRUNE_INTERVAL, PRUNE_INTERVAL, 0,
+                   on_prune_job, admission, NULL);
+
+  return admission;
+}
+
+/**
+ * admission_free:
+ * @admission: A #Admission.
+ *
+ * Stops guarding method calls and frees @admission.
+ */
+void
+admission_free (Admission *admission)
+{
+  GList *objects;
+
+  if (admission == NULL)
+    return;
+
+  scheduler_remove (daemon_get_scheduler (admission->daemon),
+                    admission->prune_job_id);
+
+  objects = g_dbus_object_manager_get_objects (admission->object_manager);
+  for (GList *l = objects; l != NULL; l = l->next)
+    unwatch_object (admission, G_DBUS_OBJECT (l->data));
+  g_list_free_full (objects, g_object_unref);
+  g_signal_handlers_disconnect_by_data (admission->object_manager, admission);
+
+  g_hash_table_unref (admission->buckets);
+  in_flight_unref (admission->in_flight);
+  g_slice_free (Admission, admission);
+}
@@ -21,8 +21,12 @@
 
 #include "gsystem-local-alloc.h"
 
+#include <netinet/in.h>
+
 #include <glib/gi18n.h>
 
+#include <netlink/addr.h>
+
 #include "daemon.h"
 #include "interface.h"
 #include "setting.h"
@@ -31,6 +35,14 @@
 
 typedef struct _ConnectionClass ConnectionClass;
 
+/* Steps of one apply of the setting configuration with their duration in
+ * micro-seconds, published as LastApplyTrace property when done. */
+typedef struct
+{
+  GVariantBuilder steps;
+  gint64 mark;
+} Trace;
+
 struct _Connection
 {
   LoomConnectionSkeleton parent_instance;
@@ -38,6 +50,11 @@ struct _Connection
   Interface *interface;
   Setting *setting;
   gchar *id;
+
+  gboolean requested;
+  gchar *address;
+  gchar *previous_address;
+  GVariant *applied;
 };
 
 struct _ConnectionClass
@@ -56,6 +73,12 @@ enum
 };
 
 static void connection_iface_init (LoomConnectionIface *iface);
+static void on_addresses_notify (GObject *object, GParamSpec *pspec,
+                                 gpointer user_data);
+static void on_object_path_notify (GObject *object, GParamSpec *pspec,
+                                   gpointer user_data);
+static void on_configuration_notify (GObject *object, GParamSpec *pspec,
+                                     gpointer user_data);
 
 G_DEFINE_TYPE_WITH_CODE (Connection, connection,
                          LOOM_TYPE_CONNECTION_SKELETON,
@@ -72,7 +95,13 @@ connection_finalize (GObject *object)
 {
   Connection *connection = CONNECTION (object);
 
+  g_signal_handlers_disconnect_by_data (connection->interface, connection);
+  g_signal_handlers_disconnect_by_data (connection->setting, connection);
   g_free (connection->id);
+  g_free (connection->address);
+  g_free (connection->previous_address);
+  if (connection->applied != NULL)
+    g_variant_unref (connection->applied);
 
   G_OBJECT_CLASS (connection_parent_class)->finalize (object);
 }
@@ -183,6 +212,15 @@ connection_constructed (GObject *object)
                              interface_get_object_path (connection->interface));
   loom_connection_set_setting (LOOM_CONNECTION (connection),
                                setting_get_object_path (connection->setting));
+  loom_connection_set_last_apply_trace (LOOM_CONNECTION (connection),
+                                        g_variant_new ("a(st)", NULL));
+
+  g_signal_connect (connection->interface, "notify::addresses",
+                    G_CALLBACK (on_addresses_notify), connection);
+  g_signal_connect (connection->interface, "notify::object-path",
+                    G_CALLBACK (on_object_path_notify), connection);
+  g_signal_connect (connection->setting, "notify::configuration",
+                    G_CALLBACK (on_configuration_notify), connection);
 
   if (G_OBJECT_CLASS (connection_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (connection_parent_class)->constructed (object);
@@ -280,6 +318,242 @@ connection_get_id (Connection *connection)
   return connection->id;
 }
 
+static void
+trace_begin (Trace *trace)
+{
+  g_variant_builder_init (&trace->steps, G_VARIANT_TYPE ("a(st)"));
+  trace->mark = g_get_monotonic_time ();
+}
+
+static void
+trace_step (Trace *trace,
+            const gchar *step)
+{
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+  g_variant_builder_add (&trace->steps, "(st)", step,
+                         (guint64) (now - trace->mark));
+  trace->mark = now;
+}
+
+static void
+trace_end (Connection *connection,
+           Trace *trace)
+{
+  loom_connection_set_last_apply_trace (LOOM_CONNECTION (connection),
+                                        g_variant_builder_end (&trace->steps));
+}
+
+/* Tracks whether the kernel confirmed the configuration: the connection is
+ * applied once its address shows up on the interface and stops being
+ * applied when the address is gone. While the address is being replaced
+ * the previous one keeps the connection applied. */
+static void
+update_applied (Connection *connection)
+{
+  LoomConnection *_connection = LOOM_CONNECTION (connection);
+  gboolean applied;
+  gboolean present;
+
+  applied = loom_connection_get_applied (_connection);
+  present = connection->address != NULL &&
+            interface_has_address (connection->interface, connection->address);
+
+  if (present)
+    g_clear_pointer (&connection->previous_address, g_free);
+  else if (connection->previous_address != NULL)
+    present = interface_has_address (connection->interface,
+                                     connection->previous_address);
+
+  if (connection->requested && !applied && present)
+    {
+      loom_connection_set_applied (_connection, TRUE);
+      loom_connection_emit_activated (_connection);
+    }
+  else if (applied && !present)
+    {
+      loom_connection_set_applied (_connection, FALSE);
+      loom_connection_emit_deactivated (_connection);
+    }
+}
+
+static void
+on_addresses_notify (GObject *object,
+                     GParamSpec *pspec,
+                     gpointer user_data)
+{
+  update_applied (CONNECTION (user_data));
+}
+
+/* The link was renamed, the interface moved to another object-path. */
+static void
+on_object_path_notify (GObject *object,
+                       GParamSpec *pspec,
+                       gpointer user_data)
+{
+  Connection *connection = CONNECTION (user_data);
+
+  loom_connection_set_interface (LOOM_CONNECTION (connection),
+                             interface_get_object_path (connection->interface));
+}
+
+static const gchar *
+lookup_string (GVariant *configuration,
+               const gchar *key)
+{
+  const gchar *value = NULL;
+
+  g_variant_lookup (configuration, key, "&s", &value);
+
+  return value;
+}
+
+static void
+write_resolver_configuration (GVariant *configuration,
+                              Trace *trace)
+{
+  gs_free const gchar **nameservers = NULL;
+  gs_free const gchar **searches = NULL;
+  const gchar *domain = NULL;
+
+  if (!g_variant_lookup (configuration, "nameservers", "^a&s", &nameservers))
+    {
+      tools_erase_resolver_configuration (NULL, NULL, NULL);
+      trace_step (trace, "resolver-erase");
+      return;
+    }
+
+  g_variant_lookup (configuration, "domain", "&s", &domain);
+  g_variant_lookup (configuration, "searches", "^a&s", &searches);
+
+  tools_write_resolver_configuration ((const gchar * const *) nameservers,
+                                      domain,
+                                      (const gchar * const *) searches);
+  trace_step (trace, "resolver-write");
+}
+
+/* Whether two addresses with optional suffix length are in the same
+ * subnet, i.e. whether the routes of one stay valid for the other. */
+static gboolean
+same_subnet (const gchar *a,
+             const gchar *b)
+{
+  struct nl_addr *a_addr = NULL;
+  struct nl_addr *b_addr = NULL;
+  gboolean same = FALSE;
+
+  if (a != NULL && b != NULL &&
+      nl_addr_parse (a, AF_INET, &a_addr) == 0 &&
+      nl_addr_parse (b, AF_INET, &b_addr) == 0)
+    same = nl_addr_get_prefixlen (a_addr) == nl_addr_get_prefixlen (b_addr) &&
+           nl_addr_cmp_prefix (a_addr, b_addr) == 0;
+
+  nl_addr_put (a_addr);
+  nl_addr_put (b_addr);
+
+  return same;
+}
+
+/* Make-before-break: the new address is added and the default route is
+ * replaced before the old address is removed, the link stays up. The new
+ * address of the same subnet is a secondary one, the kernel promotes it
+ * when the old primary is removed. The route is only replaced if the
+ * router changed or the subnet it is reached through. */
+static void
+reconfigure (Connection *connection)
+{
+  GVariant *configuration;
+  SettingField changed;
+  const gchar *address;
+  const gchar *old_address;
+  const gchar *router;
+  const gchar *old_router;
+  gboolean replace_route;
+  Trace trace;
+
+  configuration = setting_get_configuration (connection->setting);
+  changed = setting_diff_configuration (connection->applied, configuration);
+  if (changed == 0)
+    return;
+
+  trace_begin (&trace);
+
+  address = lookup_string (configuration, "address");
+  old_address = lookup_string (connection->applied, "address");
+  router = lookup_string (configuration, "router");
+  old_router = lookup_string (connection->applied, "router");
+
+  replace_route = (changed & SETTING_FIELD_ROUTER) ||
+                  ((changed & SETTING_FIELD_ADDRESS) && router != NULL &&
+                   !same_subnet (address, old_address));
+
+  if (changed & SETTING_FIELD_ADDRESS)
+    {
+      interface_set_promote_secondaries (connection->interface);
+      interface_add_address (connection->interface, address);
+      trace_step (&trace, "address-add");
+      g_free (connection->previous_address);
+      connection->previous_address = connection->address;
+      connection->address = g_strdup (address);
+    }
+
+  if (replace_route)
+    {
+      if (router != NULL)
+        {
+          tools_add_router_address (router);
+          trace_step (&trace, "route-add");
+        }
+      else if (old_router != NULL)
+        {
+          tools_delete_router_address (old_router);
+          trace_step (&trace, "route-delete");
+        }
+    }
+
+  if (changed & SETTING_FIELD_ADDRESS)
+    {
+      interface_delete_address (connection->interface,
+                                connection->previous_address);
+      trace_step (&trace, "address-delete");
+
+      /* the address events may lag behind, ask the kernel */
+      interface_refresh_addresses (connection->interface);
+      trace_step (&trace, "address-verify");
+      if (!interface_has_address (connection->interface, address))
+        {
+          g_warning (_("Address %s of interface %s was removed along with %s."),
+                     address, interface_get_name (connection->interface),
+                     connection->previous_address);
+          interface_add_address (connection->interface, address);
+          trace_step (&trace, "address-add");
+        }
+    }
+  interface_poll (connection->interface);
+
+  if (changed & (SETTING_FIELD_NAME_SERVERS | SETTING_FIELD_DOMAIN |
+                 SETTING_FIELD_SEARCHES))
+    write_resolver_configuration (configuration, &trace);
+
+  g_variant_unref (connection->applied);
+  connection->applied = g_variant_ref (configuration);
+  trace_end (connection, &trace);
+
+  update_applied (connection);
+}
+
+static void
+on_configuration_notify (GObject *object,
+                         GParamSpec *pspec,
+                         gpointer user_data)
+{
+  Connection *connection = CONNECTION (user_data);
+
+  if (connection->requested)
+    reconfigure (connection);
+}
+
 void
 connection_add (Connection *connection)
 {
@@ -289,6 +563,9 @@ connection_add (Connection *connection)
   GVariant *value;
   GVariant *configuration;
   const gchar *address;
+  Trace trace;
+
+  trace_begin (&trace);
 
   configuration = setting_get_configuration (connection->setting);
   dict = g_variant_dict_new (configuration);
@@ -296,50 +573,39 @@ connection_add (Connection *connection)
   value = g_variant_dict_lookup_value (dict, "address", G_VARIANT_TYPE_STRING);
   address = g_variant_get_string (value, NULL);
 
+  g_free (connection->address);
+  connection->address = g_strdup (address);
+  connection->requested = TRUE;
+  if (connection->applied != NULL)
+    g_variant_unref (connection->applied);
+  connection->applied = g_variant_ref (configuration);
+
   interface_set_up (connection->interface);
+  trace_step (&trace, "link-up");
   interface_add_address (connection->interface, address);
+  trace_step (&trace, "address-add");
+  interface_poll (connection->interface);
 
   if (g_variant_dict_contains (dict, "router"))
     {
       value = g_variant_dict_lookup_value (dict, "router",
                                            G_VARIANT_TYPE_STRING);
       tools_add_router_address (g_variant_get_string (value, NULL));
+      trace_step (&trace, "route-add");
     }
 
   if (g_variant_dict_contains (dict, "nameservers"))
-    {
-      gs_strfreev gchar **nameservers = NULL;
-      const gchar *domain = NULL;
-      gs_strfreev gchar **searches = NULL;
-
-      value = g_variant_dict_lookup_value (dict, "nameservers",
-                                           G_VARIANT_TYPE_STRING_ARRAY);
-      nameservers = g_variant_dup_strv (value, NULL);
-
-      if (g_variant_dict_contains (dict, "domain"))
-        {
-          value = g_variant_dict_lookup_value (dict, "domain",
-                                               G_VARIANT_TYPE_STRING);
-          domain = g_variant_get_string (value, NULL);
-        }
-
-      if (g_variant_dict_contains (dict, "searches"))
-        {
-          value = g_variant_dict_lookup_value (dict, "searches",
-                                               G_VARIANT_TYPE_STRING_ARRAY);
-          searches = g_variant_dup_strv (value, NULL);
-        }
-
-      tools_write_resolver_configuration ((const gchar * const *)nameservers,
-                                          domain,
-                                          (const gchar * const *)searches);
-    }
+    write_resolver_configuration (configuration, &trace);
 
   g_variant_dict_unref (dict);
+  trace_end (connection, &trace);
+
+  update_applied (connection);
 }
 
 void
-connection_delete (Connection *connection)
+connection_delete (Connection *connection,
+                   gboolean link_down)
 {
   g_return_if_fail (IS_CONNECTION (connection));
 
@@ -347,27 +613,47 @@ connection_delete (Connection *connection)
   GVariant *value;
   GVariant *configuration;
   const gchar *address;
+  Trace trace;
 
-  configuration = setting_get_configuration (connection->setting);
+  trace_begin (&trace);
+
+  /* the setting may have been updated since */
+  configuration = connection->applied != NULL ?
+    connection->applied : setting_get_configuration (connection->setting);
   dict = g_variant_dict_new (configuration);
 
   value = g_variant_dict_lookup_value (dict, "address", G_VARIANT_TYPE_STRING);
   address = g_variant_get_string (value, NULL);
 
-  interface_set_down (connection->interface);
+  connection->requested = FALSE;
+
+  if (link_down)
+    {
+      interface_set_down (connection->interface);
+      trace_step (&trace, "link-down");
+    }
   interface_delete_address (connection->interface, address);
+  trace_step (&trace, "address-delete");
+  interface_poll (connection->interface);
 
   if (g_variant_dict_contains (dict, "router"))
     {
       value = g_variant_dict_lookup_value (dict, "router",
                                            G_VARIANT_TYPE_STRING);
       tools_delete_router_address (g_variant_get_string (value, NULL));
+      trace_step (&trace, "route-delete");
     }
 
   if (g_variant_dict_contains (dict, "nameservers"))
-    tools_erase_resolver_configuration (NULL, NULL, NULL);
+    {
+      tools_erase_resolver_configuration (NULL, NULL, NULL);
+      trace_step (&trace, "resolver-erase");
+    }
 
   g_variant_dict_unref (dict);
+  trace_end (connection, &trace);
+
+  update_applied (connection);
 }
 
 Interface *
@@ -386,7 +672,22 @@ connection_get_setting(Connection *connection)
   return connection->setting;
 }
 
+static gboolean
+handle_set_auto_activate (LoomConnection *object,
+                          GDBusMethodInvocation *invocation,
+                          gboolean arg_activate,
+                          gboolean arg_deactivate)
+{
+  loom_connection_set_auto_deactivate (object, arg_deactivate);
+  loom_connection_set_auto_activate (object, arg_activate);
+
+  loom_connection_complete_set_auto_activate (object, invocation);
+
+  return TRUE;
+}
+
 static void
 connection_iface_init (LoomConnectionIface *iface)
 {
+  iface->handle_set_auto_activate = handle_set_auto_activate;
 }
@@ -43,7 +43,7 @@ void connection_export   (Connection *connection);
 void connection_unexport (Connection *connection);
 
 void connection_add    (Connection *connection);
-void connection_delete (Connection *connection);
+void connection_delete (Connection *connection, gboolean link_down);
 
 G_END_DECLS
 
@@ -30,6 +30,7 @@
 #include "setting.h"
 #include "connections.h"
 #include "connection.h"
+#include "probes.h"
 
 /**
  * SECTION: Connections
@@ -38,8 +39,29 @@
  * management.
  *
  * This type provides an implementation of the #LoomConnections interface.
+ *
+ * Add and Delete requests are not applied right away but recorded as
+ * intent of the interface they concern. Within a short window further
+ * intents for the same interface merge with it, opposing ones cancel out;
+ * only the net transition is applied to the kernel when the window closes,
+ * and the pending calls are completed then.
  */
 
+/* Default time in milli-seconds intents of an interface are collected. */
+#define COALESCE_WINDOW 5
+
+typedef struct
+{
+  Connections *connections;
+  Interface *interface;
+  Connection *target;
+  gboolean link_down;
+  GPtrArray *adds;
+  GPtrArray *deletes;
+  guint timeout_id;
+  gint64 created;
+} Intent;
+
 typedef struct _ConnectionsClass ConnectionsClass;
 
 /**
@@ -55,6 +77,8 @@ struct _Connections
   Interfaces *interfaces;
   Settings *settings;
   GHashTable *connections;
+  GHashTable *intents;
+  guint coalesce_window;
 };
 
 struct _ConnectionsClass
@@ -71,6 +95,7 @@ enum
 };
 
 static void connections_iface_init (LoomConnectionsIface *iface);
+static void intent_free (Intent *intent);
 
 G_DEFINE_TYPE_WITH_CODE (Connections, connections,
                          LOOM_TYPE_CONNECTIONS_SKELETON,
@@ -82,13 +107,35 @@ connections_init (Connections *connections)
 {
   connections->connections = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                     NULL, g_object_unref);
+  connections->intents = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                NULL,
+                                                (GDestroyNotify) intent_free);
 }
 
 static void
 connections_finalize (GObject *object)
 {
   Connections *connections = CONNECTIONS (object);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, connections->intents);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Intent *intent = value;
+      GPtrArray *invocations[] = { intent->adds, intent->deletes };
 
+      for (guint i = 0; i < G_N_ELEMENTS (invocations); i++)
+        {
+          for (guint j = 0; j < invocations[i]->len; j++)
+            g_dbus_method_invocation_return_error (invocations[i]->pdata[j],
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   _("daemon shutting down"));
+          g_ptr_array_set_size (invocations[i], 0);
+        }
+    }
+  g_hash_table_unref (connections->intents);
   g_hash_table_unref (connections->connections);
 
   G_OBJECT_CLASS (connections_parent_class)->finalize (object);
@@ -135,6 +182,10 @@ connections_constructed (GObject *object)
   g_assert (connections_instance == NULL);
   connections_instance = connections;
 
+  connections->coalesce_window =
+    MAX (0, daemon_config_get_integer (connections->daemon, "Connections",
+                                       "CoalesceWindow", COALESCE_WINDOW));
+
   if (G_OBJECT_CLASS (connections_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (connections_parent_class)->constructed (object);
 }
@@ -242,6 +293,426 @@ connections_get_by_object_path (Connections *connections,
   return g_hash_table_lookup (connections->connections, object_path);
 }
 
+static gboolean
+is_active (Connections *connections,
+           const gchar *object_path)
+{
+  const gchar * const *active_connections;
+
+  active_connections =
+    loom_connections_get_active_connections (LOOM_CONNECTIONS (connections));
+  if (active_connections == NULL)
+    return FALSE;
+
+  for (guint i = 0; active_connections[i] != NULL; i++)
+    {
+      if (g_str_equal (object_path, active_connections[i]))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static Connection *
+get_active_connection (Connections *connections,
+                       Interface *interface)
+{
+  const gchar * const *active_connections;
+
+  active_connections =
+    loom_connections_get_active_connections (LOOM_CONNECTIONS (connections));
+  if (active_connections == NULL)
+    return NULL;
+
+  for (guint i = 0; active_connections[i] != NULL; i++)
+    {
+      Connection *connection;
+
+      connection = g_hash_table_lookup (connections->connections,
+                                        active_connections[i]);
+      if (connection != NULL &&
+          connection_get_interface (connection) == interface)
+        return connection;
+    }
+
+  return NULL;
+}
+
+static gboolean
+activate_connection (Connections *connections,
+                     Connection *connection,
+                     GError **error)
+{
+  const gchar *object_path;
+  const gchar * const *active_connections;
+  gs_unref_ptrarray GPtrArray *_active_connections = NULL;
+  Interface *interface;
+  Setting *setting;
+
+  object_path = connection_get_object_path (connection);
+  interface = connection_get_interface (connection);
+  setting = connection_get_setting (connection);
+
+  if (is_active (connections, object_path))
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'connection' object already in use"));
+      return FALSE;
+    }
+
+  if (get_active_connection (connections, interface) != NULL)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'interface' object already in use"));
+      return FALSE;
+    }
+
+  connection_add (connection);
+
+  _active_connections = g_ptr_array_new ();
+  active_connections =
+    loom_connections_get_active_connections (LOOM_CONNECTIONS (connections));
+  if (active_connections != NULL)
+    {
+      for (guint i = 0; active_connections[i] != NULL; i++)
+        g_ptr_array_add (_active_connections, (gpointer)active_connections[i]);
+    }
+  g_ptr_array_add (_active_connections, (gpointer)object_path);
+  g_ptr_array_add (_active_connections, NULL);
+  loom_connections_set_active_connections (LOOM_CONNECTIONS (connections),
+                             (const gchar * const *)_active_connections->pdata);
+
+  interfaces_add_to_actives (connections->interfaces, interface);
+  settings_add_to_actives (connections->settings, setting);
+
+  return TRUE;
+}
+
+static gboolean
+deactivate_connection (Connections *connections,
+                       Connection *connection,
+                       gboolean link_down,
+                       GError **error)
+{
+  const gchar *object_path;
+  const gchar * const *active_connections;
+  gs_unref_ptrarray GPtrArray *_active_connections = NULL;
+
+  object_path = connection_get_object_path (connection);
+
+  active_connections =
+    loom_connections_get_active_connections (LOOM_CONNECTIONS (connections));
+  if (active_connections == NULL)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("no 'connection' objects active"));
+      return FALSE;
+    }
+
+  if (!is_active (connections, object_path))
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'connection' object is not active"));
+      return FALSE;
+    }
+
+  connection_delete (connection, link_down);
+
+  _active_connections = g_ptr_array_new ();
+  for (guint i = 0; active_connections[i] != NULL; i++)
+    {
+      if (!g_str_equal (active_connections[i], object_path))
+        g_ptr_array_add (_active_connections, (gpointer)active_connections[i]);
+    }
+  g_ptr_array_add (_active_connections, NULL);
+  loom_connections_set_active_connections (LOOM_CONNECTIONS (connections),
+                             (const gchar * const *)_active_connections->pdata);
+
+  interfaces_remove_from_actives (connections->interfaces,
+                                  connection_get_interface (connection));
+  settings_remove_from_actives (connections->settings,
+                                connection_get_setting (connection));
+
+  return TRUE;
+}
+
+static void
+intent_free (Intent *intent)
+{
+  if (intent->timeout_id > 0)
+    g_source_remove (intent->timeout_id);
+  g_clear_object (&intent->target);
+  g_ptr_array_unref (intent->adds);
+  g_ptr_array_unref (intent->deletes);
+  g_slice_free (Intent, intent);
+}
+
+static Connection *
+get_pending_connection (Connections *connections,
+                        Interface *interface)
+{
+  Intent *intent;
+
+  intent = g_hash_table_lookup (connections->intents, interface);
+  if (intent != NULL)
+    return intent->target;
+
+  return get_active_connection (connections, interface);
+}
+
+static void
+apply_intent (Intent *intent)
+{
+  Connections *connections = intent->connections;
+  Connection *current;
+  GError *error = NULL;
+  GError *delete_error = NULL;
+  GVariant *trace = NULL;
+  gint64 start;
+
+  start = LOOM_PROBE_NOW ();
+
+  current = get_active_connection (connections, intent->interface);
+  if (current == intent->target)
+    {
+      g_debug ("Intents of %s cancelled out",
+               interface_get_name (intent->interface));
+    }
+  else
+    {
+      /* the deletes merged into the intent only depend on the
+       * deactivation, the adds on both halves */
+      if (current != NULL &&
+          !deactivate_connection (connections, current, intent->link_down,
+                                  &delete_error))
+        error = g_error_copy (delete_error);
+      if (error == NULL && intent->target != NULL &&
+          activate_connection (connections, intent->target, &error))
+        trace = loom_connection_dup_last_apply_trace (
+                  LOOM_CONNECTION (intent->target));
+    }
+  if (trace == NULL)
+    trace = g_variant_ref_sink (g_variant_new ("a(st)", NULL));
+
+  LOOM_PROBE6 (intent__apply, interface_get_name (intent->interface),
+               intent->target != NULL ?
+               connection_get_object_path (intent->target) : "",
+               intent->adds->len + intent->deletes->len,
+               start - intent->created, LOOM_PROBE_NOW () - start,
+               error != NULL ? -1 : 0);
+
+  for (guint i = 0; i < intent->adds->len; i++)
+    {
+      GDBusMethodInvocation *invocation = intent->adds->pdata[i];
+      const gchar *method;
+
+      method = g_dbus_method_invocation_get_method_name (invocation);
+      if (error != NULL)
+        g_dbus_method_invocation_return_gerror (invocation, error);
+      else if (g_str_equal (method, "AddWithTrace"))
+        loom_connections_complete_add_with_trace (
+          LOOM_CONNECTIONS (connections), invocation, trace);
+      else
+        loom_connections_complete_add (LOOM_CONNECTIONS (connections),
+                                       invocation);
+    }
+  for (guint i = 0; i < intent->deletes->len; i++)
+    {
+      if (delete_error != NULL)
+        g_dbus_method_invocation_return_gerror (intent->deletes->pdata[i],
+                                                delete_error);
+      else
+        loom_connections_complete_delete (LOOM_CONNECTIONS (connections),
+                                          intent->deletes->pdata[i]);
+    }
+  g_ptr_array_set_size (intent->adds, 0);
+  g_ptr_array_set_size (intent->deletes, 0);
+  g_variant_unref (trace);
+
+  if (error != NULL)
+    {
+      g_warning (_("Failed to apply connection change on %s: %s"),
+                 interface_get_name (intent->interface), error->message);
+      g_error_free (error);
+    }
+  g_clear_error (&delete_error);
+}
+
+static gboolean
+on_intent_timeout (gpointer user_data)
+{
+  Intent *intent = user_data;
+
+  intent->timeout_id = 0;
+
+  /* changes applied now may queue new intents for the interface */
+  g_hash_table_steal (intent->connections->intents, intent->interface);
+  apply_intent (intent);
+  intent_free (intent);
+
+  return FALSE;
+}
+
+static Intent *
+get_intent (Connections *connections,
+            Interface *interface)
+{
+  Intent *intent;
+  Connection *current;
+
+  intent = g_hash_table_lookup (connections->intents, interface);
+  if (intent != NULL)
+    return intent;
+
+  current = get_active_connection (connections, interface);
+
+  intent = g_slice_new0 (Intent);
+  intent->connections = connections;
+  intent->interface = interface;
+  intent->target = current != NULL ? g_object_ref (current) : NULL;
+  intent->adds = g_ptr_array_new ();
+  intent->deletes = g_ptr_array_new ();
+  intent->created = LOOM_PROBE_NOW ();
+  intent->timeout_id = g_timeout_add (connections->coalesce_window,
+                                      on_intent_timeout, intent);
+  g_hash_table_insert (connections->intents, interface, intent);
+
+  return intent;
+}
+
+static gboolean
+queue_add (Connections *connections,
+           Connection *connection,
+           GDBusMethodInvocation *invocation,
+           GError **error)
+{
+  Interface *interface;
+  Connection *pending;
+  Intent *intent;
+
+  interface = connection_get_interface (connection);
+  pending = get_pending_connection (connections, interface);
+  intent = g_hash_table_lookup (connections->intents, interface);
+
+  /* a repeated request merges with the pending one */
+  if (pending == connection && intent != NULL)
+    {
+      if (invocation != NULL)
+        g_ptr_array_add (intent->adds, invocation);
+      return TRUE;
+    }
+
+  if (pending == connection)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'connection' object already in use"));
+      return FALSE;
+    }
+
+  if (pending != NULL)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'interface' object already in use"));
+      return FALSE;
+    }
+
+  intent = get_intent (connections, interface);
+  g_set_object (&intent->target, connection);
+  if (invocation != NULL)
+    g_ptr_array_add (intent->adds, invocation);
+
+  return TRUE;
+}
+
+static gboolean
+queue_delete (Connections *connections,
+              Connection *connection,
+              gboolean link_down,
+              GDBusMethodInvocation *invocation,
+              GError **error)
+{
+  Interface *interface;
+  Intent *intent;
+
+  interface = connection_get_interface (connection);
+  intent = g_hash_table_lookup (connections->intents, interface);
+
+  if (intent != NULL && intent->target == NULL &&
+      get_active_connection (connections, interface) == connection)
+    {
+      intent->link_down |= link_down;
+      if (invocation != NULL)
+        g_ptr_array_add (intent->deletes, invocation);
+      return TRUE;
+    }
+
+  if (get_pending_connection (connections, interface) != connection)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'connection' object is not active"));
+      return FALSE;
+    }
+
+  intent = get_intent (connections, interface);
+  g_clear_object (&intent->target);
+  intent->link_down |= link_down;
+  if (invocation != NULL)
+    g_ptr_array_add (intent->deletes, invocation);
+
+  return TRUE;
+}
+
+static void
+update_auto_connection (Connections *connections,
+                        Connection *connection)
+{
+  LoomConnection *_connection = LOOM_CONNECTION (connection);
+  Interface *interface;
+  gboolean carrier;
+  gboolean active;
+  GError *error = NULL;
+
+  interface = connection_get_interface (connection);
+  carrier = loom_interface_get_carrier (LOOM_INTERFACE (interface));
+  active = get_pending_connection (connections, interface) == connection;
+
+  if (carrier && !active && loom_connection_get_auto_activate (_connection))
+    {
+      if (!queue_add (connections, connection, NULL, &error))
+        {
+          g_debug ("Not activating connection %s: %s",
+                   connection_get_object_path (connection), error->message);
+          g_error_free (error);
+        }
+    }
+  else if (!carrier && active &&
+           loom_connection_get_auto_deactivate (_connection))
+    {
+      if (!queue_delete (connections, connection, FALSE, NULL, &error))
+        {
+          g_warning (_("Failed to deactivate connection %s: %s"),
+                     connection_get_object_path (connection), error->message);
+          g_error_free (error);
+        }
+    }
+}
+
+static void
+on_carrier_notify (GObject *object,
+                   GParamSpec *pspec,
+                   gpointer user_data)
+{
+  update_auto_connection (connections_instance, CONNECTION (user_data));
+}
+
+static void
+on_auto_activate_notify (GObject *object,
+                         GParamSpec *pspec,
+                         gpointer user_data)
+{
+  update_auto_connection (CONNECTIONS (user_data), CONNECTION (object));
+}
+
 static gboolean
 handle_create (LoomConnections *object,
                GDBusMethodInvocation *invocation,
@@ -304,6 +775,11 @@ handle_create (LoomConnections *object,
   connection = CONNECTION (connection_new (connections->daemon,
                                            interface, setting));
   connection_export (connection);
+  interfaces_pin (connections->interfaces, interface);
+  g_signal_connect (interface, "notify::carrier",
+                    G_CALLBACK (on_carrier_notify), connection);
+  g_signal_connect (connection, "notify::auto-activate",
+                    G_CALLBACK (on_auto_activate_notify), connections);
   g_hash_table_insert (connections->connections,
                        (gchar *)connection_get_object_path (connection),
                        connection);
@@ -329,8 +805,11 @@ handle_destroy (LoomConnections *object,
   GError *error = NULL;
   const gchar * const *active_connections;
   gs_free gchar **object_paths = NULL;
+  Connection *connection;
+  Interface *interface;
 
-  if (!g_hash_table_contains (connections->connections, arg_connection))
+  connection = connections_get_by_object_path (connections, arg_connection);
+  if (connection == NULL)
     {
       error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
                            _("no such 'connection' object found"));
@@ -339,6 +818,8 @@ handle_destroy (LoomConnections *object,
       return TRUE;
     }
 
+  interface = connection_get_interface (connection);
+
   active_connections = loom_connections_get_active_connections (object);
   if (active_connections != NULL)
     {
@@ -354,8 +835,19 @@ handle_destroy (LoomConnections *object,
             }
         }
     }
+  if (get_pending_connection (connections, interface) == connection)
+    {
+      error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                           _("'connection' object is being activated"));
+      g_dbus_method_invocation_take_error (invocation, error);
+
+      return TRUE;
+    }
 
+  g_signal_handlers_disconnect_by_data (interface, connection);
+  g_signal_handlers_disconnect_by_data (connection, connections);
   g_hash_table_remove (connections->connections, arg_connection);
+  interfaces_unpin (connections->interfaces, interface);
 
   object_paths =
     (gchar **)g_hash_table_get_keys_as_array (connections->connections,
@@ -375,13 +867,11 @@ handle_add (LoomConnections *object,
   Connections *connections = CONNECTIONS (object);
 
   GError *error = NULL;
-  const gchar * const *active_connections;
-  gs_unref_ptrarray GPtrArray *_active_connections = NULL;
   Connection *connection;
-  const gchar *connection_id;
-  gs_strfreev gchar **connection_id_tokens = NULL;
-  Interface *interface;
-  Setting *setting;
+  gint64 start;
+
+  start = LOOM_PROBE_NOW ();
+  LOOM_PROBE1 (add__entry, arg_connection);
 
   connection = connections_get_by_object_path (connections, arg_connection);
   if (connection == NULL)
@@ -389,55 +879,17 @@ handle_add (LoomConnections *object,
       error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
                            _("no such 'connection' object found"));
       g_dbus_method_invocation_take_error (invocation, error);
+      LOOM_PROBE3 (add__return, arg_connection, -1,
+                   LOOM_PROBE_NOW () - start);
 
       return TRUE;
     }
 
-  connection_id = connection_get_id (connection);
-  connection_id_tokens = g_strsplit (connection_id, "%", 2);
-
-  _active_connections = g_ptr_array_new ();
-
-  active_connections = loom_connections_get_active_connections (object);
-  if (active_connections != NULL)
-    {
-      active_connections = loom_connections_get_active_connections (object);
-      for (guint i = 0; active_connections[i] != NULL; i++)
-        {
-          if (g_str_equal (arg_connection, active_connections[i]))
-            {
-              error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                   _("'connection' object already in use"));
-              g_dbus_method_invocation_take_error (invocation, error);
-
-              return TRUE;
-            }
-          if (g_str_has_prefix (active_connections[i], connection_id_tokens[1]))
-            {
-              error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                   _("'interface' object already in use"));
-              g_dbus_method_invocation_take_error (invocation, error);
-
-              return TRUE;
-            }
-          g_ptr_array_add (_active_connections, (gpointer)active_connections[i]);
-        }
-    }
-
-  connection_add (connection);
-
-  g_ptr_array_add (_active_connections, (gpointer)arg_connection);
-  g_ptr_array_add (_active_connections, NULL);
-  loom_connections_set_active_connections (object,
-                             (const gchar * const *)_active_connections->pdata);
-
-  interface = connection_get_interface (connection);
-  interfaces_add_to_actives (connections->interfaces, interface);
-
-  setting = connection_get_setting (connection);
-  settings_add_to_actives (connections->settings, setting);
-
-  loom_connections_complete_add (object, invocation);
+  /* completed once the intent is applied */
+  if (!queue_add (connections, connection, invocation, &error))
+    g_dbus_method_invocation_take_error (invocation, error);
+  LOOM_PROBE3 (add__return, arg_connection, error != NULL ? -1 : 0,
+               LOOM_PROBE_NOW () - start);
 
   return TRUE;
 }
@@ -451,11 +903,10 @@ handle_delete (LoomConnections *object,
 
   GError *error = NULL;
   Connection *connection;
-  const gchar * const *active_connections;
-  gs_unref_ptrarray GPtrArray *_active_connections;
-  gboolean active = FALSE;
-  Interface *interface;
-  Setting *setting;
+  gint64 start;
+
+  start = LOOM_PROBE_NOW ();
+  LOOM_PROBE1 (delete__entry, arg_connection);
 
   connection = connections_get_by_object_path (connections, arg_connection);
 
@@ -464,59 +915,17 @@ handle_delete (LoomConnections *object,
       error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
                            _("no such 'connection' object found"));
       g_dbus_method_invocation_take_error (invocation, error);
+      LOOM_PROBE3 (delete__return, arg_connection, -1,
+                   LOOM_PROBE_NOW () - start);
 
       return TRUE;
     }
 
-  _active_connections = g_ptr_array_new ();
-
-  active_connections =
-  (const gchar * const *)loom_connections_get_active_connections (object);
-  if (active_connections != NULL)
-    {
-      for (guint i = 0; active_connections[i] != NULL; i++)
-        {
-          if (!g_str_equal (active_connections[i], arg_connection))
-            {
-              g_ptr_array_add (_active_connections,
-                               (gpointer)active_connections[i]);
-            }
-          else
-            {
-              active = TRUE;
-            }
-        }
-    }
-  else
-    {
-      error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                           _("no 'connection' objects active"));
-      g_dbus_method_invocation_take_error (invocation, error);
-
-      return TRUE;
-    }
-
-  if (!active)
-    {
-      error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                           _("'connection' object is not active"));
-      g_dbus_method_invocation_take_error (invocation, error);
-
-      return TRUE;
-    }
-
-  connection_delete (connection);
-
-  loom_connections_set_active_connections (object,
-                             (const gchar * const *)_active_connections->pdata);
-
-  interface = connection_get_interface (connection);
-  interfaces_remove_from_actives (connections->interfaces, interface);
-
-  setting = connection_get_setting (connection);
-  settings_remove_from_actives (connections->settings, setting);
-
-  loom_connections_complete_delete (object, invocation);
+  /* completed once the intent is applied */
+  if (!queue_delete (connections, connection, TRUE, invocation, &error))
+    g_dbus_method_invocation_take_error (invocation, error);
+  LOOM_PROBE3 (delete__return, arg_connection, error != NULL ? -1 : 0,
+               LOOM_PROBE_NOW () - start);
 
   return TRUE;
 }
@@ -527,5 +936,7 @@ connections_iface_init (LoomConnectionsIface *iface)
   iface->handle_create = handle_create;
   iface->handle_destroy = handle_destroy;
   iface->handle_add = handle_add;
+  /* same arguments, completed with the trace once the intent is applied */
+  iface->handle_add_with_trace = handle_add;
   iface->handle_delete = handle_delete;
 }
@@ -22,9 +22,18 @@
 #include "gsystem-local-alloc.h"
 
 #include "daemon.h"
+#include "manager.h"
 #include "interfaces.h"
 #include "settings.h"
 #include "connections.h"
+#include "scheduler.h"
+#include "monitor.h"
+#include "server.h"
+#include "admission.h"
+#include "metrics.h"
+#include "watchdog.h"
+#include "exporter.h"
+#include "statspage.h"
 
 /**
  * SECTION: Daemon
@@ -47,20 +56,25 @@ struct _Daemon
   GObject parent_instance;
   GDBusConnection *connection;
   GDBusObjectManagerServer *object_manager;
+  GKeyFile *config;
 
+  Manager *manager;
+  Metrics *metrics;
   Interfaces *interfaces;
   Settings *settings;
   Connections *connections;
-  guint tick_timeout_id;
-  gint64 last_tick;
+  Scheduler *scheduler;
+  Monitor *monitor;
+  Server *server;
+  Admission *admission;
+  Watchdog *watchdog;
+  Exporter *exporter;
+  StatsPage *stats_page;
 };
 
 struct _DaemonClass
 {
   GObjectClass parent_class;
-
-  void (*tick) (Daemon *daemon,
-                guint64 delta_usec);
 };
 
 enum
@@ -68,16 +82,9 @@ enum
   PROP_0,
   PROP_CONNECTION,
   PROP_OBJECT_MANAGER,
+  PROP_CONFIG,
 };
 
-enum
-{
-  TICK_SIGNAL,
-  LAST_SIGNAL
-};
-
-static guint signals[LAST_SIGNAL] = { 0 };
-
 G_DEFINE_TYPE(Daemon, daemon, G_TYPE_OBJECT);
 
 static void
@@ -85,14 +92,22 @@ daemon_finalize (GObject *object)
 {
   Daemon *daemon = DAEMON (object);
 
+  stats_page_free (daemon->stats_page);
+  exporter_free (daemon->exporter);
+  server_free (daemon->server);
+  monitor_free (daemon->monitor);
+  admission_free (daemon->admission);
+
   g_object_unref (daemon->connection);
+  g_object_unref (daemon->manager);
+  g_object_unref (daemon->metrics);
   g_object_unref (daemon->object_manager);
   g_object_unref (daemon->interfaces);
   g_object_unref (daemon->settings);
   g_object_unref (daemon->connections);
-
-  if (daemon->tick_timeout_id > 0)
-    g_source_remove (daemon->tick_timeout_id);
+  watchdog_free (daemon->watchdog);
+  g_key_file_unref (daemon->config);
+  scheduler_free (daemon->scheduler);
 
   if (G_OBJECT_CLASS (daemon_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (daemon_parent_class)->finalize (object);
@@ -116,6 +131,10 @@ daemon_get_property (GObject *object,
       g_value_set_object (value, daemon_get_object_manager (daemon));
       break;
 
+    case PROP_CONFIG:
+      g_value_set_boxed (value, daemon_get_config (daemon));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -137,6 +156,11 @@ daemon_set_property (GObject *object,
       daemon->connection = g_value_dup_object (value);
       break;
 
+    case PROP_CONFIG:
+      g_assert (daemon->config == NULL);
+      daemon->config = g_value_dup_boxed (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -148,21 +172,37 @@ daemon_init (Daemon *daemon)
 {
 }
 
-static gboolean
-on_timeout (gpointer user_data)
+static void
+on_link_event (gboolean removed,
+               struct rtnl_link *link,
+               gpointer user_data)
+{
+  Daemon *daemon = DAEMON (user_data);
+
+  interfaces_handle_link_event (daemon->interfaces, removed, link);
+}
+
+static void
+on_address_event (gboolean removed,
+                  struct rtnl_addr *addr,
+                  gpointer user_data)
 {
   Daemon *daemon = DAEMON (user_data);
-  guint64 delta_usec = 0;
-  gint64 now;
 
-  now = g_get_monotonic_time ();
-  if (daemon->last_tick != 0)
-    delta_usec = now - daemon->last_tick;
-  daemon->last_tick = now;
+  interfaces_handle_address_event (daemon->interfaces, removed, addr);
+}
 
-  g_signal_emit (daemon, signals[TICK_SIGNAL], 0, delta_usec);
+static void
+on_resync (gboolean links,
+           struct nl_cache *cache,
+           gpointer user_data)
+{
+  Daemon *daemon = DAEMON (user_data);
 
-  return TRUE;
+  if (links)
+    interfaces_resync_links (daemon->interfaces, cache);
+  else
+    interfaces_resync_addresses (daemon->interfaces, cache);
 }
 
 static Daemon *daemon_instance;
@@ -171,14 +211,27 @@ static void
 daemon_constructed (GObject *_object)
 {
   Daemon *daemon = DAEMON (_object);
+  LoomManager *manager;
+  LoomMetrics *metrics;
   LoomInterfaces *interfaces;
   LoomSettings *settings;
   LoomConnections *connections;
   LoomObjectSkeleton *object = NULL;
+  gs_free gchar *socket_path = NULL;
+  gs_free gchar *exporter_address = NULL;
+  gs_free gchar *stats_path = NULL;
 
   g_assert (daemon_instance == NULL);
   daemon_instance = daemon;
 
+  if (daemon->config == NULL)
+    daemon->config = g_key_file_new ();
+
+  /* polling goes ahead of method calls dispatched at default priority */
+  daemon->scheduler = scheduler_new (G_PRIORITY_HIGH);
+
+  daemon->watchdog = watchdog_new (daemon);
+
   daemon->object_manager = g_dbus_object_manager_server_new ("/org/blackox/Loom");
 
   /* /org/blackox/Loom/Interfaces */
@@ -208,10 +261,45 @@ daemon_constructed (GObject *_object)
                                        G_DBUS_OBJECT_SKELETON (object));
   g_object_unref (object);
 
+  /* /org/blackox/Loom/Manager */
+  manager = manager_new (daemon);
+  daemon->manager = MANAGER (manager);
+  object = loom_object_skeleton_new ("/org/blackox/Loom/Manager");
+  loom_object_skeleton_set_manager (object, manager);
+  g_dbus_object_manager_server_export (daemon->object_manager,
+                                       G_DBUS_OBJECT_SKELETON (object));
+  g_object_unref (object);
+
+  /* /org/blackox/Loom/Metrics */
+  metrics = metrics_new (daemon);
+  daemon->metrics = METRICS (metrics);
+  object = loom_object_skeleton_new ("/org/blackox/Loom/Metrics");
+  loom_object_skeleton_set_metrics (object, metrics);
+  g_dbus_object_manager_server_export (daemon->object_manager,
+                                       G_DBUS_OBJECT_SKELETON (object));
+  g_object_unref (object);
+
+  daemon->admission = admission_new (daemon);
+
   g_dbus_object_manager_server_set_connection (daemon->object_manager,
                                                daemon->connection);
 
-  daemon->tick_timeout_id = g_timeout_add_seconds (1, on_timeout, daemon);
+  daemon->monitor = monitor_new (on_link_event, on_address_event, on_resync,
+                                 daemon);
+
+  socket_path = daemon_config_get_string (daemon, "Server", "Socket",
+                                          LOOM_RUNDIR "/loomd.socket");
+  if (socket_path[0] != '\0')
+    daemon->server = server_new (daemon, socket_path);
+
+  exporter_address = daemon_config_get_string (daemon, "Exporter", "Listen",
+                                               "");
+  if (exporter_address[0] != '\0')
+    daemon->exporter = exporter_new (daemon, exporter_address);
+
+  stats_path = daemon_config_get_string (daemon, "Stats", "Path", "");
+  if (stats_path[0] != '\0')
+    daemon->stats_page = stats_page_new (daemon, stats_path);
 
   if (G_OBJECT_CLASS (daemon_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (daemon_parent_class)->constructed (_object);
@@ -260,45 +348,41 @@ daemon_class_init (DaemonClass *klass)
                                                         G_PARAM_STATIC_STRINGS));
 
   /**
-   * Daemon:tick:
-   * @daemon: A #Daemon.
-   * @delta_usec: The number of micro-seconds since this was last emitted or 0
-   * if the first time it's emitted.
-   *
-   * Emitted every second - subsystems use this signal instead of setting up
-   * their own timeout.
+   * Daemon:config:
    *
-   * This signal is emitted in the
-   * <link linkend="g-main-context-push-thread-default">thread-default main
-   * Loop</link> that @daemon was created in.
+   * The #GKeyFile holding the daemon configuration.
    */
-  signals[TICK_SIGNAL] = g_signal_new ("tick",
-                                       G_OBJECT_CLASS_TYPE (klass),
-                                       G_SIGNAL_RUN_LAST,
-                                       G_STRUCT_OFFSET (DaemonClass, tick),
-                                       NULL,
-                                       NULL,
-                                       g_cclosure_marshal_generic,
-                                       G_TYPE_NONE,
-                                       1,
-                                       G_TYPE_UINT64);
+  g_object_class_install_property (gobject_class,
+                                   PROP_CONFIG,
+                                   g_param_spec_boxed ("config",
+                                                       "Config",
+                                                       "The daemon configuration.",
+                                                       G_TYPE_KEY_FILE,
+                                                       G_PARAM_READABLE |
+                                                       G_PARAM_WRITABLE |
+                                                       G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_STATIC_STRINGS));
 }
 
 /**
  * daemon_new:
  * @connection: A #GDBusConnection
+ * @config: (allow-none): A #GKeyFile with the daemon configuration.
  *
  * Create a new daemon object for exporting objects on @connection.
  *
  * Returns: A #Daemon object. Free with g_object_unref().
  */
 Daemon *
-daemon_new (GDBusConnection *connection)
+daemon_new (GDBusConnection *connection,
+            GKeyFile *config)
 {
   g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
   return DAEMON (g_object_new (TYPE_DAEMON,
                                "connection",
                                connection,
+                               "config",
+                               config,
                                NULL));
 }
 
@@ -344,3 +428,208 @@ daemon_get_object_manager (Daemon *daemon)
   g_return_val_if_fail (IS_DAEMON (daemon), NULL);
   return daemon->object_manager;
 }
+
+/**
+ * daemon_get_scheduler:
+ * @daemon: A #Daemon.
+ *
+ * Gets the scheduler subsystems register their periodic jobs with instead of
+ * setting up their own timeouts.
+ *
+ * Returns: A #Scheduler. Do not free, the object is owned by @daemon.
+ */
+Scheduler *
+daemon_get_scheduler (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return daemon->scheduler;
+}
+
+/**
+ * daemon_get_watchdog:
+ * @daemon: A #Daemon.
+ *
+ * Gets the watchdog recording stalls of the main loop of @daemon.
+ *
+ * Returns: A #Watchdog. Do not free, the object is owned by @daemon.
+ */
+Watchdog *
+daemon_get_watchdog (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return daemon->watchdog;
+}
+
+/**
+ * daemon_get_manager:
+ * @daemon: A #Daemon.
+ *
+ * Gets the manager of @daemon.
+ *
+ * Returns: A #Manager. Do not free, the object is owned by @daemon.
+ */
+Manager *
+daemon_get_manager (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return daemon->manager;
+}
+
+/**
+ * daemon_get_interfaces:
+ * @daemon: A #Daemon.
+ *
+ * Gets the interfaces of @daemon.
+ *
+ * Returns: A #Interfaces. Do not free, the object is owned by @daemon.
+ */
+Interfaces *
+daemon_get_interfaces (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return daemon->interfaces;
+}
+
+/**
+ * daemon_get_metrics:
+ * @daemon: A #Daemon.
+ *
+ * Gets the metrics of @daemon.
+ *
+ * Returns: A #Metrics. Do not free, the object is owned by @daemon.
+ */
+Metrics *
+daemon_get_metrics (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return daemon->metrics;
+}
+
+/**
+ * daemon_get_config:
+ * @daemon: A #Daemon.
+ *
+ * Gets the configuration used by @daemon.
+ *
+ * Returns: A #GKeyFile. Do not free, the object is owned by @daemon.
+ */
+GKeyFile *
+daemon_get_config (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return daemon->config;
+}
+
+/**
+ * daemon_config_get_boolean:
+ * @daemon: A #Daemon.
+ * @group: A group name.
+ * @key: A key name.
+ * @default_value: Value to return if @key is not set or invalid.
+ *
+ * Gets a boolean value from the daemon configuration.
+ *
+ * Returns: The configured value or @default_value.
+ */
+gboolean
+daemon_config_get_boolean (Daemon *daemon,
+                           const gchar *group,
+                           const gchar *key,
+                           gboolean default_value)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), default_value);
+
+  gboolean value;
+  GError *error = NULL;
+
+  value = g_key_file_get_boolean (daemon->config, group, key, &error);
+  if (error != NULL)
+    {
+      g_error_free (error);
+      return default_value;
+    }
+
+  return value;
+}
+
+/**
+ * daemon_config_get_integer:
+ * @daemon: A #Daemon.
+ * @group: A group name.
+ * @key: A key name.
+ * @default_value: Value to return if @key is not set or invalid.
+ *
+ * Gets an integer value from the daemon configuration.
+ *
+ * Returns: The configured value or @default_value.
+ */
+gint
+daemon_config_get_integer (Daemon *daemon,
+                           const gchar *group,
+                           const gchar *key,
+                           gint default_value)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), default_value);
+
+  gint value;
+  GError *error = NULL;
+
+  value = g_key_file_get_integer (daemon->config, group, key, &error);
+  if (error != NULL)
+    {
+      g_error_free (error);
+      return default_value;
+    }
+
+  return value;
+}
+
+/**
+ * daemon_config_get_string:
+ * @daemon: A #Daemon.
+ * @group: A group name.
+ * @key: A key name.
+ * @default_value: (allow-none): Value to return if @key is not set.
+ *
+ * Gets a string value from the daemon configuration.
+ *
+ * Returns: The configured value or a copy of @default_value. Free with
+ * g_free().
+ */
+gchar *
+daemon_config_get_string (Daemon *daemon,
+                          const gchar *group,
+                          const gchar *key,
+                          const gchar *default_value)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+
+  gchar *value;
+
+  value = g_key_file_get_string (daemon->config, group, key, NULL);
+  if (value == NULL)
+    return g_strdup (default_value);
+
+  return value;
+}
+
+/**
+ * daemon_config_get_string_list:
+ * @daemon: A #Daemon.
+ * @group: A group name.
+ * @key: A key name.
+ *
+ * Gets a string list from the daemon configuration.
+ *
+ * Returns: A %NULL-terminated array or %NULL if @key is not set. Free with
+ * g_strfreev().
+ */
+gchar **
+daemon_config_get_string_list (Daemon *daemon,
+                               const gchar *group,
+                               const gchar *key)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+
+  return g_key_file_get_string_list (daemon->config, group, key, NULL, NULL);
+}
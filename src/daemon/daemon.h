@@ -21,6 +21,8 @@
 #define LOOM_DAEMON_H
 
 #include "types.h"
+#include "scheduler.h"
+#include "watchdog.h"
 
 G_BEGIN_DECLS
 
@@ -29,11 +31,34 @@ G_BEGIN_DECLS
 #define IS_DAEMON(o)  (G_TYPE_CHECK_INSTANCE_TYPE ((o), TYPE_DAEMON))
 
 GType    daemon_get_type (void) G_GNUC_CONST;
-Daemon * daemon_new      (GDBusConnection *connection);
+Daemon * daemon_new      (GDBusConnection *connection,
+                          GKeyFile *config);
 
 Daemon *                   daemon_get                (void);
 GDBusConnection *          daemon_get_connection     (Daemon *daemon);
 GDBusObjectManagerServer * daemon_get_object_manager (Daemon *daemon);
+GKeyFile *                 daemon_get_config         (Daemon *daemon);
+Scheduler *                daemon_get_scheduler      (Daemon *daemon);
+Watchdog *                 daemon_get_watchdog       (Daemon *daemon);
+Manager *                  daemon_get_manager        (Daemon *daemon);
+Interfaces *               daemon_get_interfaces     (Daemon *daemon);
+Metrics *                  daemon_get_metrics        (Daemon *daemon);
+
+gboolean daemon_config_get_boolean     (Daemon *daemon,
+                                        const gchar *group,
+                                        const gchar *key,
+                                        gboolean default_value);
+gint     daemon_config_get_integer     (Daemon *daemon,
+                                        const gchar *group,
+                                        const gchar *key,
+                                        gint default_value);
+gchar *  daemon_config_get_string      (Daemon *daemon,
+                                        const gchar *group,
+                                        const gchar *key,
+                                        const gchar *default_value);
+gchar ** daemon_config_get_string_list (Daemon *daemon,
+                                        const gchar *group,
+                                        const gchar *key);
 
 G_END_DECLS
 
@@ -0,0 +1,868 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <grp.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/link.h>
+
+#include "daemon.h"
+#include "exporter.h"
+#include "interfaces.h"
+#include "manager.h"
+#include "metrics.h"
+#include "nlio.h"
+
+/**
+ * SECTION: Exporter
+ * @title: Exporter
+ * @short_description: Prometheus metrics exporter.
+ *
+ * Serves the metrics of the daemon in the Prometheus text format over HTTP
+ * on a unix socket or a TCP address, from the main loop. Reported are the
+ * link state and counters of the managed interfaces, the number of
+ * connections, the method latencies and the netlink accounting.
+ *
+ * Scrapes are rendered into buffers kept for the lifetime of the exporter,
+ * one scrape at a time; scrapes arriving meanwhile wait their turn. The
+ * number of clients is limited, so is the memory held by waiting scrapes.
+ * A unix socket is only accessible by root and the configured group.
+ */
+
+#define REQUEST_SIZE    1024
+#define SAMPLE_SIZE     512
+#define LABEL_SIZE      64
+#define CLIENT_TIMEOUT  10
+
+/* Default number of clients connected at the same time. */
+#define MAX_CLIENTS     16
+
+/* Default group allowed to connect to a unix socket. */
+#define EXPORTER_GROUP  "netdev"
+
+typedef struct
+{
+  Exporter *exporter;
+  GSocketConnection *connection;
+  gchar request[REQUEST_SIZE];
+  gsize length;
+} Scrape;
+
+struct _Exporter
+{
+  Daemon *daemon;
+  gchar *path;
+
+  GSocketService *service;
+  GCancellable *cancellable;
+  struct nl_sock *sock;
+
+  GString *body;
+  GString *response;
+  GPtrArray *links;
+  NlioStats nlio[N_NLIO_OPERATIONS];
+  gboolean busy;
+  GQueue pending;
+  guint n_clients;
+  guint max_clients;
+};
+
+typedef struct
+{
+  const gchar *name;
+  const gchar *help;
+  rtnl_link_stat_id_t id;
+} LinkCounter;
+
+static const LinkCounter link_counters[] =
+{
+  { "loom_interface_receive_bytes_total",
+    "Bytes received by the interface.", RTNL_LINK_RX_BYTES },
+  { "loom_interface_transmit_bytes_total",
+    "Bytes transmitted by the interface.", RTNL_LINK_TX_BYTES },
+  { "loom_interface_receive_packets_total",
+    "Packets received by the interface.", RTNL_LINK_RX_PACKETS },
+  { "loom_interface_transmit_packets_total",
+    "Packets transmitted by the interface.", RTNL_LINK_TX_PACKETS },
+  { "loom_interface_receive_errors_total",
+    "Receive errors of the interface.", RTNL_LINK_RX_ERRORS },
+  { "loom_interface_transmit_errors_total",
+    "Transmit errors of the interface.", RTNL_LINK_TX_ERRORS },
+  { "loom_interface_receive_dropped_total",
+    "Received packets dropped by the interface.", RTNL_LINK_RX_DROPPED },
+  { "loom_interface_transmit_dropped_total",
+    "Packets to transmit dropped by the interface.", RTNL_LINK_TX_DROPPED },
+};
+
+static void serve (Exporter *exporter, Scrape *scrape);
+
+/* The append helpers format on the stack, the buffers do not grow once
+ * they reached the size of a scrape. */
+
+static void
+append_family (GString *out,
+               const gchar *name,
+               const gchar *type,
+               const gchar *help)
+{
+  g_string_append (out, "# HELP ");
+  g_string_append (out, name);
+  g_string_append_c (out, ' ');
+  g_string_append (out, help);
+  g_string_append (out, "\n# TYPE ");
+  g_string_append (out, name);
+  g_string_append_c (out, ' ');
+  g_string_append (out, type);
+  g_string_append_c (out, '\n');
+}
+
+/* Escapes a label value as the text format requires, truncating it to fit
+ * @size. Link names may contain any character but '/', ':' and white
+ * space. */
+static const gchar *
+escape_label (const gchar *value,
+              gchar *buf,
+              gsize size)
+{
+  gsize n = 0;
+
+  for (; *value != '\0' && n + 3 <= size; value++)
+    {
+      switch (*value)
+        {
+        case '\\':
+        case '"':
+          buf[n++] = '\\';
+          buf[n++] = *value;
+          break;
+
+        case '\n':
+          buf[n++] = '\\';
+          buf[n++] = 'n';
+          break;
+
+        default:
+          buf[n++] = *value;
+          break;
+        }
+    }
+  buf[n] = '\0';
+
+  return buf;
+}
+
+static void
+append_sample (GString *out,
+               const gchar *name,
+               const gchar *labels,
+               guint64 value)
+{
+  gchar buf[SAMPLE_SIZE];
+
+  if (labels != NULL)
+    g_snprintf (buf, sizeof (buf), "%s{%s} %" G_GUINT64_FORMAT "\n",
+                name, labels, value);
+  else
+    g_snprintf (buf, sizeof (buf), "%s %" G_GUINT64_FORMAT "\n",
+                name, value);
+  g_string_append (out, buf);
+}
+
+static void
+append_summary (GString *out,
+                const gchar *name,
+                const gchar *labels,
+                guint64 count,
+                guint64 sum,
+                guint p50,
+                guint p90,
+                guint p99,
+                guint max)
+{
+  gchar sample_name[SAMPLE_SIZE / 4];
+  gchar buf[SAMPLE_SIZE / 2];
+
+  g_snprintf (buf, sizeof (buf), "%s,quantile=\"0.5\"", labels);
+  append_sample (out, name, buf, p50);
+  g_snprintf (buf, sizeof (buf), "%s,quantile=\"0.9\"", labels);
+  append_sample (out, name, buf, p90);
+  g_snprintf (buf, sizeof (buf), "%s,quantile=\"0.99\"", labels);
+  append_sample (out, name, buf, p99);
+  g_snprintf (buf, sizeof (buf), "%s,quantile=\"1\"", labels);
+  append_sample (out, name, buf, max);
+
+  g_snprintf (sample_name, sizeof (sample_name), "%s_sum", name);
+  append_sample (out, sample_name, labels, sum);
+  g_snprintf (sample_name, sizeof (sample_name), "%s_count", name);
+  append_sample (out, sample_name, labels, count);
+}
+
+static void
+append_link_sample (GString *out,
+                    const gchar *name,
+                    struct rtnl_link *link,
+                    guint64 value)
+{
+  gchar labels[SAMPLE_SIZE / 4];
+  gchar name_buf[LABEL_SIZE];
+
+  g_snprintf (labels, sizeof (labels), "interface=\"%s\"",
+              escape_label (rtnl_link_get_name (link), name_buf,
+                            sizeof (name_buf)));
+  append_sample (out, name, labels, value);
+}
+
+static void
+render_interfaces (Exporter *exporter,
+                   GString *out)
+{
+  Interfaces *interfaces = daemon_get_interfaces (exporter->daemon);
+  GPtrArray *links = exporter->links;
+  struct nl_cache *cache = NULL;
+  struct nl_object *object;
+  gint err;
+
+  err = nlio_link_alloc_cache (exporter->sock, &cache);
+  if (err != 0)
+    {
+      g_warning (_("Error getting link cache from kernel: %s"),
+                 nl_geterror (err));
+      return;
+    }
+
+  for (object = nl_cache_get_first (cache); object != NULL;
+       object = nl_cache_get_next (object))
+    {
+      struct rtnl_link *link = (struct rtnl_link *) object;
+
+      if (interfaces_is_managed (interfaces, rtnl_link_get_ifindex (link)))
+        g_ptr_array_add (links, link);
+    }
+
+  append_family (out, "loom_interface_up", "gauge",
+                 "Whether the interface is administratively up.");
+  for (guint i = 0; i < links->len; i++)
+    append_link_sample (out, "loom_interface_up", links->pdata[i],
+                        (rtnl_link_get_flags (links->pdata[i]) & IFF_UP) != 0);
+
+  append_family (out, "loom_interface_carrier", "gauge",
+                 "Whether the interface has carrier.");
+  for (guint i = 0; i < links->len; i++)
+    append_link_sample (out, "loom_interface_carrier", links->pdata[i],
+                        rtnl_link_get_carrier (links->pdata[i]) != 0);
+
+  for (guint i = 0; i < G_N_ELEMENTS (link_counters); i++)
+    {
+      append_family (out, link_counters[i].name, "counter",
+                     link_counters[i].help);
+      for (guint j = 0; j < links->len; j++)
+        append_link_sample (out, link_counters[i].name, links->pdata[j],
+                            rtnl_link_get_stat (links->pdata[j],
+                                                link_counters[i].id));
+    }
+
+  g_ptr_array_set_size (links, 0);
+  nl_cache_free (cache);
+}
+
+static void
+render_connections (Exporter *exporter,
+                    GString *out)
+{
+  Snapshot *snapshot;
+  GVariantIter iter;
+  GVariant *properties;
+  guint64 total = 0;
+  guint64 applied = 0;
+
+  snapshot = manager_acquire_snapshot (daemon_get_manager (exporter->daemon));
+  if (snapshot != NULL)
+    {
+      g_variant_iter_init (&iter, snapshot_get_objects (snapshot,
+                                                        SNAPSHOT_CONNECTIONS));
+      while (g_variant_iter_next (&iter, "{&o@a{sv}}", NULL, &properties))
+        {
+          gboolean value = FALSE;
+
+          total++;
+          if (g_variant_lookup (properties, "Applied", "b", &value) && value)
+            applied++;
+          g_variant_unref (properties);
+        }
+      snapshot_unref (snapshot);
+    }
+
+  append_family (out, "loom_connections", "gauge",
+                 "Number of connections.");
+  append_sample (out, "loom_connections", NULL, total);
+  append_family (out, "loom_connections_applied", "gauge",
+                 "Number of connections confirmed by the kernel.");
+  append_sample (out, "loom_connections_applied", NULL, applied);
+}
+
+static void
+render_method_latency (const gchar *interface_name,
+                       const gchar *method_name,
+                       Histogram *latency,
+                       guint errors,
+                       gpointer user_data)
+{
+  gchar labels[SAMPLE_SIZE / 4];
+  gchar interface_buf[LABEL_SIZE];
+  gchar method_buf[LABEL_SIZE];
+  guint count, p50, p90, p99, max;
+
+  if (g_atomic_int_get (&latency->count) == 0)
+    return;
+
+  histogram_summarize (latency, &count, &p50, &p90, &p99, &max);
+
+  g_snprintf (labels, sizeof (labels), "interface=\"%s\",method=\"%s\"",
+              escape_label (interface_name, interface_buf,
+                            sizeof (interface_buf)),
+              escape_label (method_name, method_buf, sizeof (method_buf)));
+  append_summary (user_data, "loom_method_latency_microseconds", labels,
+                  count, histogram_get_sum (latency), p50, p90, p99, max);
+}
+
+static void
+render_method_errors (const gchar *interface_name,
+                      const gchar *method_name,
+                      Histogram *latency,
+                      guint errors,
+                      gpointer user_data)
+{
+  gchar labels[SAMPLE_SIZE / 4];
+  gchar interface_buf[LABEL_SIZE];
+  gchar method_buf[LABEL_SIZE];
+
+  if (g_atomic_int_get (&latency->count) == 0)
+    return;
+
+  g_snprintf (labels, sizeof (labels), "interface=\"%s\",method=\"%s\"",
+              escape_label (interface_name, interface_buf,
+                            sizeof (interface_buf)),
+              escape_label (method_name, method_buf, sizeof (method_buf)));
+  append_sample (user_data, "loom_method_errors_total", labels, errors);
+}
+
+static void
+render_methods (Exporter *exporter,
+                GString *out)
+{
+  Metrics *metrics = daemon_get_metrics (exporter->daemon);
+
+  append_family (out, "loom_method_latency_microseconds", "summary",
+                 "Latency of D-Bus method calls from authorization to reply.");
+  metrics_foreach_method (metrics, render_method_latency, out);
+
+  append_family (out, "loom_method_errors_total", "counter",
+                 "D-Bus method calls replied with an error.");
+  metrics_foreach_method (metrics, render_method_errors, out);
+}
+
+static void
+render_netlink (Exporter *exporter,
+                GString *out)
+{
+  static const struct
+  {
+    const gchar *name;
+    const gchar *help;
+    gsize offset;
+  } counters[] =
+  {
+    { "loom_netlink_calls_total", "Netlink requests.",
+      G_STRUCT_OFFSET (NlioStats, calls) },
+    { "loom_netlink_messages_sent_total", "Netlink messages sent.",
+      G_STRUCT_OFFSET (NlioStats, messages_sent) },
+    { "loom_netlink_messages_received_total", "Netlink messages received.",
+      G_STRUCT_OFFSET (NlioStats, messages_received) },
+    { "loom_netlink_bytes_sent_total", "Netlink bytes sent.",
+      G_STRUCT_OFFSET (NlioStats, bytes_sent) },
+    { "loom_netlink_bytes_received_total", "Netlink bytes received.",
+      G_STRUCT_OFFSET (NlioStats, bytes_received) },
+  };
+  gchar labels[SAMPLE_SIZE / 2];
+  gchar error_buf[LABEL_SIZE * 2];
+  NlioOperation operation;
+
+  for (operation = 0; operation < N_NLIO_OPERATIONS; operation++)
+    nlio_get_stats (operation, &exporter->nlio[operation]);
+
+  for (guint i = 0; i < G_N_ELEMENTS (counters); i++)
+    {
+      append_family (out, counters[i].name, "counter", counters[i].help);
+      for (operation = 0; operation < N_NLIO_OPERATIONS; operation++)
+        {
+          g_snprintf (labels, sizeof (labels), "operation=\"%s\"",
+                      nlio_operation_to_string (operation));
+          append_sample (out, counters[i].name, labels,
+                         G_STRUCT_MEMBER (guint64, &exporter->nlio[operation],
+                                          counters[i].offset));
+        }
+    }
+
+  append_family (out, "loom_netlink_round_trip_microseconds", "summary",
+                 "Round trip time of netlink requests.");
+  for (operation = 0; operation < N_NLIO_OPERATIONS; operation++)
+    {
+      NlioStats *stats = &exporter->nlio[operation];
+
+      if (stats->calls == 0)
+        continue;
+
+      g_snprintf (labels, sizeof (labels), "operation=\"%s\"",
+                  nlio_operation_to_string (operation));
+      append_summary (out, "loom_netlink_round_trip_microseconds", labels,
+                      stats->calls, stats->sum, stats->p50, stats->p90,
+                      stats->p99, stats->max);
+    }
+
+  append_family (out, "loom_netlink_errors_total", "counter",
+                 "Netlink requests failed, by libnl error.");
+  for (operation = 0; operation < N_NLIO_OPERATIONS; operation++)
+    {
+      NlioStats *stats = &exporter->nlio[operation];
+
+      for (guint i = 1; i < NLIO_N_ERRORS; i++)
+        {
+          if (stats->errors[i] == 0)
+            continue;
+
+          g_snprintf (labels, sizeof (labels),
+                      "operation=\"%s\",error=\"%s\"",
+                      nlio_operation_to_string (operation),
+                      escape_label (nl_geterror (i), error_buf,
+                                    sizeof (error_buf)));
+          append_sample (out, "loom_netlink_errors_total", labels,
+                         stats->errors[i]);
+        }
+    }
+}
+
+static void
+render (Exporter *exporter,
+        const gchar *status,
+        GString *body)
+{
+  gchar header[256];
+
+  g_snprintf (header, sizeof (header),
+              "HTTP/1.0 %s\r\n"
+              "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+              "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+              "Connection: close\r\n"
+              "\r\n", status, body->len);
+
+  g_string_truncate (exporter->response, 0);
+  g_string_append (exporter->response, header);
+  g_string_append_len (exporter->response, body->str, body->len);
+}
+
+static void
+scrape_free (Scrape *scrape)
+{
+  g_io_stream_close (G_IO_STREAM (scrape->connection), NULL, NULL);
+  g_object_unref (scrape->connection);
+  g_slice_free (Scrape, scrape);
+}
+
+/* Frees @scrape while the exporter is still alive. */
+static void
+scrape_finish (Scrape *scrape)
+{
+  scrape->exporter->n_clients--;
+  scrape_free (scrape);
+}
+
+static void
+on_written (GObject *source_object,
+            GAsyncResult *result,
+            gpointer user_data)
+{
+  Scrape *scrape = user_data;
+  Exporter *exporter;
+  GError *error = NULL;
+
+  if (!g_output_stream_write_all_finish (G_OUTPUT_STREAM (source_object),
+                                         result, NULL, &error))
+    {
+      /* the exporter is gone */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_error_free (error);
+          scrape_free (scrape);
+          return;
+        }
+
+      g_debug ("Failed to write metrics: %s", error->message);
+      g_error_free (error);
+    }
+
+  exporter = scrape->exporter;
+  scrape_finish (scrape);
+
+  exporter->busy = FALSE;
+  scrape = g_queue_pop_head (&exporter->pending);
+  if (scrape != NULL)
+    serve (exporter, scrape);
+}
+
+static void
+serve (Exporter *exporter,
+       Scrape *scrape)
+{
+  GOutputStream *output;
+
+  exporter->busy = TRUE;
+
+  g_string_truncate (exporter->body, 0);
+  if (g_str_has_prefix (scrape->request, "GET /metrics ") ||
+      g_str_has_prefix (scrape->request, "GET / "))
+    {
+      render_interfaces (exporter, exporter->body);
+      render_connections (exporter, exporter->body);
+      render_methods (exporter, exporter->body);
+      render_netlink (exporter, exporter->body);
+      render (exporter, "200 OK", exporter->body);
+    }
+  else
+    {
+      g_string_append (exporter->body, "Not Found\n");
+      render (exporter, "404 Not Found", exporter->body);
+    }
+
+  output = g_io_stream_get_output_stream (G_IO_STREAM (scrape->connection));
+  g_output_stream_write_all_async (output,
+                                   exporter->response->str,
+                                   exporter->response->len,
+                                   G_PRIORITY_DEFAULT,
+                                   exporter->cancellable,
+                                   on_written,
+                                   scrape);
+}
+
+static void read_request (Scrape *scrape);
+
+static void
+on_read (GObject *source_object,
+         GAsyncResult *result,
+         gpointer user_data)
+{
+  Scrape *scrape = user_data;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish (G_INPUT_STREAM (source_object), result,
+                                  &error);
+  if (n <= 0)
+    {
+      /* the exporter is gone */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_error_free (error);
+          scrape_free (scrape);
+          return;
+        }
+
+      if (error != NULL)
+        {
+          g_debug ("Failed to read metrics request: %s", error->message);
+          g_error_free (error);
+        }
+      scrape_finish (scrape);
+      return;
+    }
+
+  scrape->length += n;
+  scrape->request[scrape->length] = '\0';
+
+  if (strstr (scrape->request, "\r\n\r\n") == NULL &&
+      strstr (scrape->request, "\n\n") == NULL)
+    {
+      if (scrape->length < REQUEST_SIZE - 1)
+        read_request (scrape);
+      else
+        scrape_finish (scrape);
+      return;
+    }
+
+  if (scrape->exporter->busy)
+    g_queue_push_tail (&scrape->exporter->pending, scrape);
+  else
+    serve (scrape->exporter, scrape);
+}
+
+static void
+read_request (Scrape *scrape)
+{
+  GInputStream *input;
+
+  input = g_io_stream_get_input_stream (G_IO_STREAM (scrape->connection));
+  g_input_stream_read_async (input,
+                             scrape->request + scrape->length,
+                             REQUEST_SIZE - 1 - scrape->length,
+                             G_PRIORITY_DEFAULT,
+                             scrape->exporter->cancellable,
+                             on_read,
+                             scrape);
+}
+
+static gboolean
+on_incoming (GSocketService *service,
+             GSocketConnection *connection,
+             GObject *source_object,
+             gpointer user_data)
+{
+  Exporter *exporter = user_data;
+  Scrape *scrape;
+
+  if (exporter->n_clients >= exporter->max_clients)
+    {
+      g_debug ("Rejecting metrics client, %u clients connected",
+               exporter->n_clients);
+      g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+      return TRUE;
+    }
+
+  g_socket_set_timeout (g_socket_connection_get_socket (connection),
+                        CLIENT_TIMEOUT);
+
+  scrape = g_slice_new0 (Scrape);
+  exporter->n_clients++;
+  scrape->exporter = exporter;
+  scrape->connection = g_object_ref (connection);
+  read_request (scrape);
+
+  return TRUE;
+}
+
+static GSocketAddress *
+parse_address (const gchar *address,
+               gchar **path)
+{
+  const gchar *colon;
+  gchar *host;
+  gchar *end;
+  guint64 port;
+  GInetAddress *inet_address;
+  GSocketAddress *socket_address = NULL;
+
+  if (g_path_is_absolute (address))
+    {
+      *path = g_strdup (address);
+      return g_unix_socket_address_new (address);
+    }
+
+  colon = strrchr (address, ':');
+  if (colon == NULL)
+    return NULL;
+
+  port = g_ascii_strtoull (colon + 1, &end, 10);
+  if (*end != '\0' || end == colon + 1 || port == 0 || port > G_MAXUINT16)
+    return NULL;
+
+  host = g_strndup (address, colon - address);
+  inet_address = g_inet_address_new_from_string (host);
+  if (inet_address != NULL)
+    {
+      socket_address = g_inet_socket_address_new (inet_address, port);
+      g_object_unref (inet_address);
+    }
+  g_free (host);
+
+  return socket_address;
+}
+
+/* Restricts the socket at @path to root and @group. */
+static void
+restrict_socket (const gchar *path,
+                 const gchar *group)
+{
+  struct group grp, *gr = NULL;
+  gchar buf[4096];
+
+  if (group[0] != '\0')
+    {
+      if (getgrnam_r (group, &grp, buf, sizeof (buf), &gr) != 0 || gr == NULL)
+        g_warning (_("Unknown group %s for socket %s"), group, path);
+      else if (chown (path, -1, gr->gr_gid) != 0)
+        g_warning (_("Failed to change group of socket %s: %s"),
+                   path, g_strerror (errno));
+    }
+
+  if (g_chmod (path, 0660) != 0)
+    g_warning (_("Failed to change mode of socket %s: %s"),
+               path, g_strerror (errno));
+}
+
+/**
+ * exporter_new:
+ * @daemon: A #Daemon.
+ * @address: The absolute path of a unix socket or a numeric IP address
+ * and port, e.g. 127.0.0.1:9467.
+ *
+ * Creates a new #Exporter listening on @address. A stale socket left at a
+ * unix socket path is removed first. The group allowed to connect to a
+ * unix socket and the number of clients are configured by the [Exporter]
+ * section of the configuration.
+ *
+ * Returns: A new #Exporter or %NULL if listening failed. Free with
+ * exporter_free().
+ */
+Exporter *
+exporter_new (Daemon *daemon,
+              const gchar *address)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (address != NULL, NULL);
+
+  Exporter *exporter;
+  GSocketAddress *socket_address;
+  GError *error = NULL;
+
+  exporter = g_slice_new0 (Exporter);
+  exporter->daemon = daemon;
+
+  socket_address = parse_address (address, &exporter->path);
+  if (socket_address == NULL)
+    {
+      g_warning (_("Invalid exporter address %s"), address);
+      exporter_free (exporter);
+      return NULL;
+    }
+
+  if (exporter->path != NULL)
+    {
+      gchar *dirname;
+
+      dirname = g_path_get_dirname (exporter->path);
+      if (g_mkdir_with_parents (dirname, 0755) != 0)
+        g_warning (_("Failed to create directory %s: %s"),
+                   dirname, g_strerror (errno));
+      g_free (dirname);
+
+      if (g_unlink (exporter->path) != 0 && errno != ENOENT)
+        g_warning (_("Failed to remove stale socket %s: %s"),
+                   exporter->path, g_strerror (errno));
+    }
+
+  exporter->service = g_socket_service_new ();
+  if (!g_socket_listener_add_address (G_SOCKET_LISTENER (exporter->service),
+                                      socket_address,
+                                      G_SOCKET_TYPE_STREAM,
+                                      G_SOCKET_PROTOCOL_DEFAULT,
+                                      NULL, NULL, &error))
+    {
+      g_warning (_("Failed to listen on %s: %s"), address, error->message);
+      g_error_free (error);
+      g_object_unref (socket_address);
+      g_clear_pointer (&exporter->path, g_free);
+      exporter_free (exporter);
+      return NULL;
+    }
+  g_object_unref (socket_address);
+
+  if (exporter->path != NULL)
+    {
+      gs_free gchar *group = NULL;
+
+      group = daemon_config_get_string (daemon, "Exporter", "Group",
+                                        EXPORTER_GROUP);
+      restrict_socket (exporter->path, group);
+    }
+
+  exporter->max_clients = MAX (1, daemon_config_get_integer (daemon,
+                                                             "Exporter",
+                                                             "MaxClients",
+                                                             MAX_CLIENTS));
+
+  exporter->cancellable = g_cancellable_new ();
+  exporter->sock = nlio_socket_new ();
+  exporter->body = g_string_sized_new (16384);
+  exporter->response = g_string_sized_new (16384);
+  exporter->links = g_ptr_array_new ();
+  g_queue_init (&exporter->pending);
+
+  g_signal_connect (exporter->service, "incoming",
+                    G_CALLBACK (on_incoming), exporter);
+  g_socket_service_start (exporter->service);
+
+  return exporter;
+}
+
+/**
+ * exporter_free:
+ * @exporter: A #Exporter.
+ *
+ * Stops listening, drops pending scrapes and frees @exporter.
+ */
+void
+exporter_free (Exporter *exporter)
+{
+  Scrape *scrape;
+
+  if (exporter == NULL)
+    return;
+
+  if (exporter->service != NULL)
+    {
+      g_signal_handlers_disconnect_by_data (exporter->service, exporter);
+      g_socket_service_stop (exporter->service);
+      g_socket_listener_close (G_SOCKET_LISTENER (exporter->service));
+      g_object_unref (exporter->service);
+    }
+
+  /* scrapes in flight are freed by their cancelled callbacks */
+  if (exporter->cancellable != NULL)
+    {
+      g_cancellable_cancel (exporter->cancellable);
+      g_object_unref (exporter->cancellable);
+    }
+  while ((scrape = g_queue_pop_head (&exporter->pending)) != NULL)
+    scrape_free (scrape);
+
+  if (exporter->path != NULL)
+    g_unlink (exporter->path);
+
+  if (exporter->sock != NULL)
+    nl_socket_free (exporter->sock);
+  if (exporter->body != NULL)
+    g_string_free (exporter->body, TRUE);
+  if (exporter->response != NULL)
+    g_string_free (exporter->response, TRUE);
+  if (exporter->links != NULL)
+    g_ptr_array_unref (exporter->links);
+  g_free (exporter->path);
+  g_slice_free (Exporter, exporter);
+}
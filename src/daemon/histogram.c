@@ -0,0 +1,168 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "histogram.h"
+
+/**
+ * SECTION: Histogram
+ * @title: Histogram
+ * @short_description: Lock-free latency histograms.
+ *
+ * HDR-style histograms with a fixed set of log-linear buckets. Recording a
+ * value is a few atomic increments, so histograms can be fed from any
+ * thread without locks. Percentiles are computed from the bucket counts
+ * when read and are accurate to the bucket width.
+ */
+
+static guint
+get_bucket (guint64 value)
+{
+  gint msb;
+  gint shift;
+
+  if (value < HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  msb = g_bit_nth_msf (value >> 32, -1);
+  msb = msb >= 0 ? msb + 32 : g_bit_nth_msf ((guint32) value, -1);
+  shift = msb - 3;
+
+  return MIN ((shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & 7),
+              HISTOGRAM_N_BUCKETS - 1);
+}
+
+/* Gets the highest value falling into @bucket. */
+static guint64
+get_bucket_value (guint bucket)
+{
+  guint shift;
+  guint64 sub;
+
+  if (bucket < HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  sub = bucket % HISTOGRAM_SUB_BUCKETS;
+
+  return ((HISTOGRAM_SUB_BUCKETS + sub) << shift) + ((guint64) 1 << shift) - 1;
+}
+
+/**
+ * histogram_record:
+ * @histogram: A #Histogram.
+ * @value: A value in micro-seconds.
+ *
+ * Adds @value to @histogram. Can be called from any thread.
+ */
+void
+histogram_record (Histogram *histogram,
+                  guint64 value)
+{
+  gint max;
+  gint clamped = MIN (value, G_MAXINT);
+
+  g_atomic_int_inc (&histogram->buckets[get_bucket (value)]);
+  g_atomic_int_inc (&histogram->count);
+  __atomic_fetch_add (&histogram->sum, value, __ATOMIC_RELAXED);
+
+  do
+    max = g_atomic_int_get (&histogram->max);
+  while (clamped > max &&
+         !g_atomic_int_compare_and_exchange (&histogram->max, max, clamped));
+}
+
+/**
+ * histogram_reset:
+ * @histogram: A #Histogram.
+ *
+ * Empties @histogram. Values recorded concurrently may or may not survive.
+ */
+void
+histogram_reset (Histogram *histogram)
+{
+  for (guint i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+    g_atomic_int_set (&histogram->buckets[i], 0);
+  g_atomic_int_set (&histogram->count, 0);
+  g_atomic_int_set (&histogram->max, 0);
+  __atomic_store_n (&histogram->sum, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * histogram_summarize:
+ * @histogram: A #Histogram.
+ * @count: (out): Return location for the number of values.
+ * @p50: (out): Return location for the median.
+ * @p90: (out): Return location for the 90th percentile.
+ * @p99: (out): Return location for the 99th percentile.
+ * @max: (out): Return location for the maximum.
+ *
+ * Summarizes the values recorded in @histogram.
+ */
+void
+histogram_summarize (Histogram *histogram,
+                     guint *count,
+                     guint *p50,
+                     guint *p90,
+                     guint *p99,
+                     guint *max)
+{
+  gint buckets[HISTOGRAM_N_BUCKETS];
+  guint *values[] = { p50, p90, p99 };
+  const gdouble ranks[] = { 0.50, 0.90, 0.99 };
+  guint64 total = 0;
+  guint64 seen = 0;
+  guint next = 0;
+
+  for (guint i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+    {
+      buckets[i] = g_atomic_int_get (&histogram->buckets[i]);
+      total += buckets[i];
+    }
+
+  *count = total;
+  *max = g_atomic_int_get (&histogram->max);
+  for (guint i = 0; i < G_N_ELEMENTS (values); i++)
+    *values[i] = 0;
+
+  for (guint i = 0; i < HISTOGRAM_N_BUCKETS && next < G_N_ELEMENTS (values);
+       i++)
+    {
+      seen += buckets[i];
+      while (next < G_N_ELEMENTS (values) && total > 0 &&
+             seen >= ranks[next] * total)
+        *values[next++] = MIN (get_bucket_value (i), *max);
+    }
+}
+
+/**
+ * histogram_get_sum:
+ * @histogram: A #Histogram.
+ *
+ * Gets the sum of the values recorded in @histogram, exact unlike the
+ * percentiles.
+ *
+ * Returns: The sum in micro-seconds.
+ */
+guint64
+histogram_get_sum (Histogram *histogram)
+{
+  return __atomic_load_n (&histogram->sum, __ATOMIC_RELAXED);
+}
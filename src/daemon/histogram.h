@@ -0,0 +1,59 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_HISTOGRAM_H
+#define LOOM_HISTOGRAM_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+/* Values below 8 get a bucket each, above each power of two is split into
+ * 8 buckets, which bounds the error to 12.5%, up to 2^40. */
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_N_BUCKETS   (HISTOGRAM_SUB_BUCKETS * 39)
+
+/**
+ * Histogram:
+ *
+ * Fixed-size log-linear histogram of micro-second values. All fields are
+ * updated atomically, a zero-filled #Histogram is empty.
+ */
+typedef struct
+{
+  gint buckets[HISTOGRAM_N_BUCKETS];
+  gint count;
+  gint max;
+  guint64 sum;
+} Histogram;
+
+void histogram_record    (Histogram *histogram,
+                          guint64 value);
+void histogram_reset     (Histogram *histogram);
+void histogram_summarize (Histogram *histogram,
+                          guint *count,
+                          guint *p50,
+                          guint *p90,
+                          guint *p99,
+                          guint *max);
+guint64 histogram_get_sum (Histogram *histogram);
+
+G_END_DECLS
+
+#endif /* LOOM_HISTOGRAM_H */
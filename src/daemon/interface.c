@@ -19,7 +19,10 @@
 
 #include "config.h"
 
+#include <math.h>
 #include <string.h>
+#include <netinet/in.h>
+#include <linux/ip.h>
 
 #include <glib/gi18n.h>
 
@@ -28,11 +31,13 @@
 #include <netlink/cache.h>
 #include <netlink/route/link.h>
 #include <netlink/route/addr.h>
+#include <netlink/route/link/inet.h>
 
 #include "gsystem-local-alloc.h"
 
 #include "daemon.h"
 #include "interface.h"
+#include "nlio.h"
 
 /**
  * SECTION: Interface
@@ -56,6 +61,20 @@ struct _Interface
   LoomInterfaceSkeleton parent_instance;
   Daemon *daemon;
   gchar *name;
+  gint ifindex;
+  guint link_job_id;
+
+  gboolean carrier;
+  guint64 transitions;
+  gdouble penalty;
+  gint64 penalty_time;
+  gboolean suppressed;
+
+  gdouble flap_penalty;
+  gdouble suppress_threshold;
+  gdouble reuse_threshold;
+  gdouble max_penalty;
+  gdouble half_life;
 };
 
 struct _InterfaceClass
@@ -78,10 +97,6 @@ G_DEFINE_TYPE_WITH_CODE (Interface, interface,
                          G_IMPLEMENT_INTERFACE (LOOM_TYPE_INTERFACE,
                                                 interface_iface_init));
 
-static void on_tick (Daemon *daemon,
-                     guint64 delta_usec,
-                     gpointer user_data);
-
 static void
 interface_init (Interface *interface)
 {
@@ -94,9 +109,9 @@ interface_finalize (GObject *object)
 
   g_free (interface->name);
 
-  g_signal_handlers_disconnect_by_func (interface->daemon,
-                                        G_CALLBACK (on_tick),
-                                        interface);
+  if (interface->link_job_id > 0)
+    scheduler_remove (daemon_get_scheduler (interface->daemon),
+                      interface->link_job_id);
 
   G_OBJECT_CLASS (interface_parent_class)->finalize (object);
 }
@@ -149,6 +164,22 @@ static void interface_get_property (GObject *object,
     }
 }
 
+void
+interface_unexport (Interface *interface)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+
+  GDBusObjectManagerServer *object_manager;
+  GDBusObject *object;
+
+  object_manager = daemon_get_object_manager (interface->daemon);
+
+  object = g_dbus_interface_get_object (G_DBUS_INTERFACE (interface));
+  if (object != NULL)
+    g_dbus_object_manager_server_unexport (object_manager,
+                                        g_dbus_object_get_object_path (object));
+}
+
 void
 interface_export (Interface *interface)
 {
@@ -163,8 +194,7 @@ interface_export (Interface *interface)
       LoomObjectSkeleton *object = NULL;
       gs_free gchar *object_path = NULL;
 
-      object_path = g_strdup_printf ("/org/blackox/Loom/Interface/%s",
-                                     interface->name);
+      object_path = interface_build_object_path (interface->name);
       object = loom_object_skeleton_new (object_path);
       loom_object_skeleton_set_interface (object, LOOM_INTERFACE (interface));
       g_dbus_object_manager_server_export (object_manager,
@@ -173,6 +203,38 @@ interface_export (Interface *interface)
     }
 }
 
+/**
+ * interface_rename:
+ * @interface: A #Interface.
+ * @name: The new name of the link.
+ *
+ * Follows a rename of the link of @interface. If @interface is exported it
+ * is exported again at the object-path of @name.
+ */
+void
+interface_rename (Interface *interface,
+                  const gchar *name)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+  g_return_if_fail (name != NULL);
+
+  gboolean exported;
+
+  exported = g_dbus_interface_get_object (G_DBUS_INTERFACE (interface)) != NULL;
+  if (exported)
+    interface_unexport (interface);
+
+  g_free (interface->name);
+  interface->name = g_strdup (name);
+
+  if (exported)
+    interface_export (interface);
+
+  g_object_notify (G_OBJECT (interface), "name");
+  if (exported)
+    g_object_notify (G_OBJECT (interface), "object-path");
+}
+
 static void
 read_link_address (Interface *interface)
 {
@@ -182,10 +244,9 @@ read_link_address (Interface *interface)
 
   gs_free gchar *addr_str = NULL;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
-  rtnl_link_get_kernel (sock, 0, interface->name, &link);
+  nlio_link_get_kernel (sock, interface->name, &link);
 
   if (link == NULL)
     {
@@ -193,6 +254,8 @@ read_link_address (Interface *interface)
       goto out;
     }
 
+  interface->ifindex = rtnl_link_get_ifindex (link);
+
   addr = rtnl_link_get_addr (link);
   addr_str = g_malloc0 (17);
   nl_addr2str (addr, addr_str, 17);
@@ -203,33 +266,129 @@ out:
   nl_socket_free (sock);
 }
 
+static gchar *
+format_address (struct rtnl_addr *addr)
+{
+  gchar buf[INET_ADDRSTRLEN + 4];
+
+  nl_addr2str (rtnl_addr_get_local (addr), buf, sizeof (buf));
+
+  return g_strdup (buf);
+}
+
+/* Compares the address parts of two addresses with optional suffix. */
 static gboolean
-read_link_properties (Interface *interface)
+address_equal (const gchar *a,
+               const gchar *b)
 {
-  LoomInterface *_interface = LOOM_INTERFACE (interface);
+  gsize a_len = strcspn (a, "/");
+  gsize b_len = strcspn (b, "/");
+
+  return a_len == b_len && strncmp (a, b, a_len) == 0;
+}
 
+static void
+read_addresses (Interface *interface)
+{
   struct nl_sock *sock = NULL;
-  struct rtnl_link *link = NULL;
+  struct nl_cache *cache = NULL;
 
-  gboolean changed = FALSE;
+  sock = nlio_socket_new ();
 
-  gboolean state;
-  gboolean carrier;
-  guint8 flags;
+  nlio_addr_alloc_cache (sock, &cache);
+  if (cache == NULL)
+    {
+      g_warning (_("Error getting address cache from kernel."));
+      goto out;
+    }
+
+  interface_sync_addresses (interface, cache);
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+out:
+  nl_cache_free (cache);
+  nl_socket_free (sock);
+}
 
-  rtnl_link_get_kernel (sock, 0, interface->name, &link);
+static void
+decay_penalty (Interface *interface,
+               gint64 now)
+{
+  gdouble elapsed;
 
-  if (link == NULL)
+  if (interface->penalty_time != 0 && interface->penalty > 0)
     {
-      g_warning (_("Error getting link info from kernel."));
-      goto out;
+      elapsed = (now - interface->penalty_time) / (gdouble) G_USEC_PER_SEC;
+      interface->penalty *= pow (2.0, -elapsed / interface->half_life);
     }
+  interface->penalty_time = now;
+}
+
+static gboolean
+update_carrier (Interface *interface,
+                gboolean carrier)
+{
+  LoomInterface *_interface = LOOM_INTERFACE (interface);
+  gboolean dampening = interface->half_life > 0;
+
+  if (dampening)
+    decay_penalty (interface, g_get_monotonic_time ());
+
+  if (interface->carrier != carrier)
+    {
+      interface->carrier = carrier;
+      interface->transitions++;
+      loom_interface_set_carrier_transitions (_interface,
+                                              interface->transitions);
+
+      if (dampening)
+        interface->penalty = MIN (interface->penalty + interface->flap_penalty,
+                                  interface->max_penalty);
+
+      if (dampening && !interface->suppressed &&
+          interface->penalty >= interface->suppress_threshold)
+        {
+          interface->suppressed = TRUE;
+          loom_interface_set_carrier_dampened (_interface, TRUE);
+          g_message (_("Carrier of interface %s is flapping, dampening."),
+                     interface->name);
+          return TRUE;
+        }
+    }
+
+  if (interface->suppressed)
+    {
+      if (interface->penalty >= interface->reuse_threshold)
+        return FALSE;
+
+      interface->suppressed = FALSE;
+      loom_interface_set_carrier_dampened (_interface, FALSE);
+      g_message (_("Carrier of interface %s is stable again."),
+                 interface->name);
+    }
+
+  if (loom_interface_get_carrier (_interface) != carrier)
+    {
+      loom_interface_set_carrier (_interface, carrier);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+update_link_properties (Interface *interface,
+                        struct rtnl_link *link)
+{
+  LoomInterface *_interface = LOOM_INTERFACE (interface);
+
+  gboolean changed = FALSE;
+
+  gboolean state;
+  gboolean carrier;
+  guint flags;
 
   flags = rtnl_link_get_flags (link);
-  state = (gboolean) flags & IFF_UP;
+  state = (flags & IFF_UP) != 0;
   carrier = (gboolean) rtnl_link_get_carrier (link);
 
   if (loom_interface_get_state (_interface) != state)
@@ -238,12 +397,31 @@ read_link_properties (Interface *interface)
       changed = TRUE;
     }
 
-  if (loom_interface_get_carrier (_interface) != carrier)
+  changed |= update_carrier (interface, carrier);
+
+  return changed;
+}
+
+static gboolean
+read_link_properties (Interface *interface)
+{
+  struct nl_sock *sock = NULL;
+  struct rtnl_link *link = NULL;
+
+  gboolean changed = FALSE;
+
+  sock = nlio_socket_new ();
+
+  nlio_link_get_kernel (sock, interface->name, &link);
+
+  if (link == NULL)
     {
-      loom_interface_set_carrier (_interface, carrier);
-      changed = TRUE;
+      g_warning (_("Error getting link info from kernel."));
+      goto out;
     }
 
+  changed = update_link_properties (interface, link);
+
 out:
   rtnl_link_put (link);
   nl_socket_free (sock);
@@ -251,10 +429,8 @@ out:
   return changed;
 }
 
-static void
-on_tick (Daemon *daemon,
-         guint64 delta_usec,
-         gpointer user_data)
+static gboolean
+on_link_job (gpointer user_data)
 {
   Interface *interface = INTERFACE (user_data);
 
@@ -264,17 +440,47 @@ on_tick (Daemon *daemon,
 
   if (changed)
     loom_interface_emit_changed (LOOM_INTERFACE (interface));
+
+  return changed;
 }
 
 static void
 interface_constructed (GObject *object)
 {
   Interface *interface = INTERFACE (object);
+  Daemon *daemon = interface->daemon;
+
+  interface->flap_penalty =
+    daemon_config_get_integer (daemon, "Dampening", "Penalty", 1000);
+  interface->suppress_threshold =
+    daemon_config_get_integer (daemon, "Dampening", "SuppressThreshold", 2000);
+  interface->reuse_threshold =
+    daemon_config_get_integer (daemon, "Dampening", "ReuseThreshold", 750);
+  interface->half_life =
+    daemon_config_get_integer (daemon, "Dampening", "HalfLife", 15);
+  interface->max_penalty = interface->reuse_threshold *
+    pow (2.0, daemon_config_get_integer (daemon, "Dampening", "MaxSuppress", 60) /
+              MAX (interface->half_life, 1));
 
   read_link_address (interface);
   read_link_properties (interface);
-
-  g_signal_connect (interface->daemon, "tick", G_CALLBACK (on_tick), interface);
+  read_addresses (interface);
+  interface->transitions = 0;
+  interface->penalty = 0;
+  loom_interface_set_carrier_transitions (LOOM_INTERFACE (interface), 0);
+
+  interface->link_job_id =
+    scheduler_add (daemon_get_scheduler (interface->daemon),
+                   "interface-link",
+                   daemon_config_get_integer (interface->daemon, "Scheduler",
+                                              "LinkInterval", 1000),
+                   daemon_config_get_integer (interface->daemon, "Scheduler",
+                                              "LinkMaxInterval", 4000),
+                   daemon_config_get_integer (interface->daemon, "Scheduler",
+                                              "LinkJitter", 100),
+                   on_link_job,
+                   interface,
+                   NULL);
 
   if (G_OBJECT_CLASS (interface_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (interface_parent_class)->constructed (object);
@@ -343,6 +549,22 @@ interface_get_object_path (Interface *interface)
   return g_dbus_object_get_object_path (object);
 }
 
+/**
+ * interface_build_object_path:
+ * @name: A network interface name.
+ *
+ * Builds the D-Bus object-path an interface named @name is exported at.
+ *
+ * Returns: A new object-path. Free with g_free().
+ */
+gchar *
+interface_build_object_path (const gchar *name)
+{
+  g_return_val_if_fail (name != NULL, NULL);
+
+  return g_strdup_printf ("/org/blackox/Loom/Interface/%s", name);
+}
+
 const gchar *
 interface_get_name (Interface *interface)
 {
@@ -352,17 +574,169 @@ interface_get_name (Interface *interface)
 }
 
 
+/**
+ * interface_handle_link:
+ * @interface: A #Interface.
+ * @link: A rtnl link object received with a link event.
+ *
+ * Updates the properties of @interface from a kernel link event.
+ */
+void
+interface_handle_link (Interface *interface,
+                       struct rtnl_link *link)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+  g_return_if_fail (link != NULL);
+
+  interface->ifindex = rtnl_link_get_ifindex (link);
+
+  if (update_link_properties (interface, link))
+    {
+      loom_interface_emit_changed (LOOM_INTERFACE (interface));
+      interface_poll (interface);
+    }
+}
+
+/**
+ * interface_handle_address:
+ * @interface: A #Interface.
+ * @removed: %TRUE if the address was removed.
+ * @addr: A rtnl address object received with an address event.
+ *
+ * Updates the Addresses property of @interface from a kernel address event.
+ */
+void
+interface_handle_address (Interface *interface,
+                          gboolean removed,
+                          struct rtnl_addr *addr)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+  g_return_if_fail (addr != NULL);
+
+  const gchar * const *addresses;
+  gs_unref_ptrarray GPtrArray *_addresses = NULL;
+  gs_free gchar *address = NULL;
+  gboolean found = FALSE;
+
+  if (rtnl_addr_get_family (addr) != AF_INET)
+    return;
+
+  address = format_address (addr);
+  addresses = loom_interface_get_addresses (LOOM_INTERFACE (interface));
+
+  _addresses = g_ptr_array_new ();
+  for (guint i = 0; addresses != NULL && addresses[i] != NULL; i++)
+    {
+      if (g_str_equal (addresses[i], address))
+        {
+          found = TRUE;
+          if (removed)
+            continue;
+        }
+      g_ptr_array_add (_addresses, (gpointer)addresses[i]);
+    }
+
+  if (found != removed)
+    return;
+
+  if (!removed)
+    g_ptr_array_add (_addresses, address);
+  g_ptr_array_add (_addresses, NULL);
+
+  loom_interface_set_addresses (LOOM_INTERFACE (interface),
+                                (const gchar * const *)_addresses->pdata);
+}
+
+/**
+ * interface_sync_addresses:
+ * @interface: A #Interface.
+ * @cache: A rtnl address cache.
+ *
+ * Sets the addresses of @interface to the IPv4 addresses of its link found
+ * in @cache. Properties only change if the addresses differ.
+ */
+void
+interface_sync_addresses (Interface *interface,
+                          struct nl_cache *cache)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+  g_return_if_fail (cache != NULL);
+
+  struct nl_object *object;
+  gs_unref_ptrarray GPtrArray *addresses = NULL;
+
+  addresses = g_ptr_array_new_with_free_func (g_free);
+  for (object = nl_cache_get_first (cache); object != NULL;
+       object = nl_cache_get_next (object))
+    {
+      struct rtnl_addr *addr = (struct rtnl_addr *) object;
+
+      if (rtnl_addr_get_ifindex (addr) == interface->ifindex &&
+          rtnl_addr_get_family (addr) == AF_INET)
+        g_ptr_array_add (addresses, format_address (addr));
+    }
+  g_ptr_array_add (addresses, NULL);
+
+  loom_interface_set_addresses (LOOM_INTERFACE (interface),
+                                (const gchar * const *)addresses->pdata);
+}
+
+/**
+ * interface_has_address:
+ * @interface: A #Interface.
+ * @address: An IPv4 address with or without suffix length.
+ *
+ * Checks whether the kernel reported @address as assigned to @interface.
+ * Only the address part is compared.
+ *
+ * Returns: %TRUE if @address is assigned.
+ */
+gboolean
+interface_has_address (Interface *interface,
+                       const gchar *address)
+{
+  g_return_val_if_fail (IS_INTERFACE (interface), FALSE);
+  g_return_val_if_fail (address != NULL, FALSE);
+
+  const gchar * const *addresses;
+
+  addresses = loom_interface_get_addresses (LOOM_INTERFACE (interface));
+  for (guint i = 0; addresses != NULL && addresses[i] != NULL; i++)
+    {
+      if (address_equal (addresses[i], address))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * interface_poll:
+ * @interface: A #Interface.
+ *
+ * Resets the link polling of @interface to its base interval, e.g. after the
+ * link was reconfigured.
+ */
+void
+interface_poll (Interface *interface)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+
+  scheduler_reset (daemon_get_scheduler (interface->daemon),
+                   interface->link_job_id);
+}
+
 void
 interface_set_up (Interface *interface)
 {
   struct nl_sock *sock = NULL;
   struct rtnl_link *link = NULL;
   struct rtnl_link *change = NULL;
+  gint err;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
-  rtnl_link_get_kernel (sock, 0, interface->name, &link);
+  nlio_link_get_kernel (sock, interface->name, &link);
   if (link == NULL)
     {
       g_warning (_("Error getting link info from kernel."));
@@ -372,7 +746,10 @@ interface_set_up (Interface *interface)
   change = rtnl_link_alloc ();
   rtnl_link_set_flags (change, IFF_UP);
 
-  rtnl_link_change (sock, link, change, 0);
+  err = nlio_link_change (sock, link, change);
+  if (err != 0)
+    g_warning (_("Failed to set interface %s up: %s"),
+               interface->name, nl_geterror (err));
 
 out:
   rtnl_link_put (change);
@@ -386,11 +763,11 @@ interface_set_down (Interface *interface)
   struct nl_sock *sock = NULL;
   struct rtnl_link *link = NULL;
   struct rtnl_link *change = NULL;
+  gint err;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
-  rtnl_link_get_kernel (sock, 0, interface->name, &link);
+  nlio_link_get_kernel (sock, interface->name, &link);
   if (link == NULL)
     {
       g_warning (_("Error getting link info from kernel."));
@@ -400,7 +777,10 @@ interface_set_down (Interface *interface)
   change = rtnl_link_alloc ();
   rtnl_link_unset_flags (change, IFF_UP);
 
-  rtnl_link_change (sock, link, change, 0);
+  err = nlio_link_change (sock, link, change);
+  if (err != 0)
+    g_warning (_("Failed to set interface %s down: %s"),
+               interface->name, nl_geterror (err));
 
 out:
   rtnl_link_put (change);
@@ -408,6 +788,67 @@ out:
   nl_socket_free (sock);
 }
 
+/**
+ * interface_set_promote_secondaries:
+ * @interface: A #Interface.
+ *
+ * Makes the kernel promote a secondary address of @interface to primary
+ * when the primary address of its subnet is deleted, instead of deleting
+ * the secondary addresses along with it.
+ */
+void
+interface_set_promote_secondaries (Interface *interface)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+
+  struct nl_sock *sock = NULL;
+  struct rtnl_link *link = NULL;
+  struct rtnl_link *change = NULL;
+  guint32 value = 0;
+  gint err;
+
+  sock = nlio_socket_new ();
+
+  nlio_link_get_kernel (sock, interface->name, &link);
+  if (link == NULL)
+    {
+      g_warning (_("Error getting link info from kernel."));
+      goto out;
+    }
+
+  if (rtnl_link_inet_get_conf (link, IPV4_DEVCONF_PROMOTE_SECONDARIES,
+                               &value) == 0 && value != 0)
+    goto out;
+
+  change = rtnl_link_alloc ();
+  rtnl_link_inet_set_conf (change, IPV4_DEVCONF_PROMOTE_SECONDARIES, 1);
+
+  err = nlio_link_change (sock, link, change);
+  if (err != 0)
+    g_warning (_("Failed to promote secondary addresses of interface %s: %s"),
+               interface->name, nl_geterror (err));
+
+out:
+  rtnl_link_put (change);
+  rtnl_link_put (link);
+  nl_socket_free (sock);
+}
+
+/**
+ * interface_refresh_addresses:
+ * @interface: A #Interface.
+ *
+ * Reads the addresses of @interface from the kernel, without waiting for
+ * the address events of a change to arrive.
+ */
+void
+interface_refresh_addresses (Interface *interface)
+{
+  g_return_if_fail (IS_INTERFACE (interface));
+
+  read_addresses (interface);
+}
+
 void
 interface_add_address (Interface *interface,
                        const gchar *address)
@@ -416,11 +857,11 @@ interface_add_address (Interface *interface,
   struct rtnl_link *link = NULL;
   struct rtnl_addr *addr = NULL;
   struct nl_addr *local = NULL;
+  gint err;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
-  rtnl_link_get_kernel (sock, 0, interface->name, &link);
+  nlio_link_get_kernel (sock, interface->name, &link);
   if (link == NULL)
     {
       g_warning (_("Error getting link info from kernel."));
@@ -434,7 +875,10 @@ interface_add_address (Interface *interface,
   rtnl_addr_set_family (addr, AF_INET);
   rtnl_addr_set_local (addr, local);
 
-  rtnl_addr_add(sock, addr, 0);
+  err = nlio_addr_add (sock, addr, 0);
+  if (err != 0)
+    g_warning (_("Failed to add address %s to interface %s: %s"),
+               address, interface->name, nl_geterror (err));
 
 out:
   rtnl_link_put (link);
@@ -451,11 +895,11 @@ interface_delete_address  (Interface *interface,
   struct rtnl_link *link = NULL;
   struct rtnl_addr *addr = NULL;
   struct nl_addr *local = NULL;
+  gint err;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
-  rtnl_link_get_kernel (sock, 0, interface->name, &link);
+  nlio_link_get_kernel (sock, interface->name, &link);
   if (link == NULL)
     {
       g_warning (_("Error getting link info from kernel."));
@@ -469,7 +913,10 @@ interface_delete_address  (Interface *interface,
   rtnl_addr_set_family (addr, AF_INET);
   rtnl_addr_set_local (addr, local);
 
-  rtnl_addr_delete(sock, addr, 0);
+  err = nlio_addr_delete (sock, addr, 0);
+  if (err != 0)
+    g_warning (_("Failed to delete address %s from interface %s: %s"),
+               address, interface->name, nl_geterror (err));
 
 out:
   rtnl_link_put (link);
@@ -24,6 +24,10 @@
 
 G_BEGIN_DECLS
 
+struct rtnl_link;
+struct rtnl_addr;
+struct nl_cache;
+
 #define TYPE_INTERFACE  (interface_get_type ())
 #define INTERFACE(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), \
                          TYPE_INTERFACE, Interface))
@@ -32,17 +36,33 @@ G_BEGIN_DECLS
 GType           interface_get_type (void) G_GNUC_CONST;
 LoomInterface * interface_new      (Daemon *daemon, gchar *name);
 
+gchar *       interface_build_object_path (const gchar *name);
+
 const gchar * interface_get_object_path (Interface *interface);
 const gchar * interface_get_name        (Interface *interface);
 
 void interface_export   (Interface *interface);
 void interface_unexport (Interface *interface);
+void interface_rename   (Interface *interface, const gchar *name);
 
+void interface_handle_link     (Interface *interface,
+                                struct rtnl_link *link);
+void interface_handle_address  (Interface *interface,
+                                gboolean removed,
+                                struct rtnl_addr *addr);
+void interface_sync_addresses  (Interface *interface,
+                                struct nl_cache *cache);
+void interface_poll            (Interface *interface);
 void interface_set_up          (Interface *interface);
 void interface_set_down        (Interface *interface);
+void interface_set_promote_secondaries (Interface *interface);
+void interface_refresh_addresses       (Interface *interface);
 void interface_add_address     (Interface *interface, const gchar *address);
 void interface_delete_address  (Interface *interface, const gchar *address);
 
+gboolean interface_has_address (Interface *interface,
+                                const gchar *address);
+
 G_END_DECLS
 
 #endif /* LOOM_INTERFACE_WIRED_H */
@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "gsystem-local-alloc.h"
 
 #include <glib/gi18n.h>
@@ -27,10 +29,14 @@
 #include <netlink/socket.h>
 #include <netlink/cache.h>
 #include <netlink/route/link.h>
+#include <netlink/route/addr.h>
 
 #include "daemon.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "linkfilter.h"
+#include "nlio.h"
+#include "probes.h"
 
 /**
  * SECTION: Interfaces
@@ -42,6 +48,19 @@
  */
 
 typedef struct _InterfacesClass InterfacesClass;
+typedef struct _InterfaceEntry InterfaceEntry;
+
+/**
+ * InterfaceEntry:
+ *
+ * Compact record of a managed link. Kept for every link, whether an
+ * #Interface object is exported for it or not.
+ */
+struct _InterfaceEntry
+{
+  gint ifindex;
+  gchar name[IFNAMSIZ];
+};
 
 /**
  * Interfaces:
@@ -54,6 +73,18 @@ struct _Interfaces
   LoomInterfacesSkeleton parent_instance;
   Daemon *daemon;
   GHashTable *interfaces;
+  GHashTable *entries;
+  GHashTable *entries_by_name;
+  LinkFilter *filter;
+  gboolean on_demand;
+  guint max_exported;
+  GQueue lru;
+  GHashTable *pins;
+
+  GHashTable *sent;
+  GHashTable *dirty;
+  gboolean entries_changed;
+  guint flush_id;
 };
 
 struct _InterfacesClass
@@ -73,19 +104,49 @@ G_DEFINE_TYPE_WITH_CODE (Interfaces, interfaces, LOOM_TYPE_INTERFACES_SKELETON,
                          G_IMPLEMENT_INTERFACE (LOOM_TYPE_INTERFACES,
                                                 interfaces_iface_init));
 
+static void
+entry_free (gpointer data)
+{
+  g_slice_free (InterfaceEntry, data);
+}
+
 static void
 interfaces_init (Interfaces *interfaces)
 {
   interfaces->interfaces = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                   NULL, g_object_unref);
+  interfaces->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                               NULL, entry_free);
+  interfaces->entries_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+  interfaces->pins = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_queue_init (&interfaces->lru);
+  interfaces->sent = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free,
+                                            (GDestroyNotify) g_variant_unref);
+  interfaces->dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 static void
 interfaces_finalize (GObject *object)
 {
   Interfaces *interfaces = INTERFACES (object);
+  GHashTableIter iter;
+  gpointer value;
 
+  if (interfaces->flush_id > 0)
+    g_source_remove (interfaces->flush_id);
+  g_hash_table_iter_init (&iter, interfaces->interfaces);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_signal_handlers_disconnect_by_data (value, interfaces);
+  g_hash_table_unref (interfaces->dirty);
+  g_hash_table_unref (interfaces->sent);
+
+  g_queue_clear (&interfaces->lru);
+  g_hash_table_unref (interfaces->pins);
   g_hash_table_unref (interfaces->interfaces);
+  g_hash_table_unref (interfaces->entries_by_name);
+  g_hash_table_unref (interfaces->entries);
+  link_filter_free (interfaces->filter);
 
   G_OBJECT_CLASS (interfaces_parent_class)->finalize (object);
 }
@@ -111,16 +172,389 @@ interfaces_set_property (GObject *object,
     }
 }
 
+static InterfaceEntry *
+lookup_entry (Interfaces *interfaces,
+              const gchar *name)
+{
+  return g_hash_table_lookup (interfaces->entries_by_name, name);
+}
+
+static InterfaceEntry *
+lookup_entry_by_ifindex (Interfaces *interfaces,
+                         gint ifindex)
+{
+  return g_hash_table_lookup (interfaces->entries, GINT_TO_POINTER (ifindex));
+}
+
+static InterfaceEntry *
+add_entry (Interfaces *interfaces,
+           struct rtnl_link *link)
+{
+  InterfaceEntry *entry;
+
+  entry = g_slice_new0 (InterfaceEntry);
+  entry->ifindex = rtnl_link_get_ifindex (link);
+  g_strlcpy (entry->name, rtnl_link_get_name (link), sizeof (entry->name));
+
+  g_hash_table_insert (interfaces->entries_by_name, entry->name, entry);
+  g_hash_table_insert (interfaces->entries, GINT_TO_POINTER (entry->ifindex),
+                       entry);
+  interfaces->entries_changed = TRUE;
+
+  return entry;
+}
+
+static void
+remove_entry (Interfaces *interfaces,
+              InterfaceEntry *entry)
+{
+  g_hash_table_remove (interfaces->entries_by_name, entry->name);
+  g_hash_table_remove (interfaces->entries, GINT_TO_POINTER (entry->ifindex));
+  interfaces->entries_changed = TRUE;
+}
+
+static void
+set_entry_ifindex (Interfaces *interfaces,
+                   InterfaceEntry *entry,
+                   gint ifindex)
+{
+  g_hash_table_steal (interfaces->entries, GINT_TO_POINTER (entry->ifindex));
+  entry->ifindex = ifindex;
+  g_hash_table_insert (interfaces->entries, GINT_TO_POINTER (entry->ifindex),
+                       entry);
+}
+
+static gboolean
+is_pinned (Interfaces *interfaces,
+           Interface *interface)
+{
+  return g_hash_table_contains (interfaces->pins, interface);
+}
+
+static GVariant *
+get_signaled_properties (Interface *interface)
+{
+  GDBusInterfaceInfo *info;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  GVariant *properties;
+  const gchar *key;
+  GVariant *value;
+
+  info = loom_interface_interface_info ();
+  properties =
+    g_dbus_interface_skeleton_get_properties (G_DBUS_INTERFACE_SKELETON (interface));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_iter_init (&iter, properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      GDBusPropertyInfo *property;
+
+      property = g_dbus_interface_info_lookup_property (info, key);
+      if (property == NULL ||
+          g_strcmp0 (g_dbus_annotation_info_lookup (property->annotations,
+                         "org.freedesktop.DBus.Property.EmitsChangedSignal"),
+                     "false") != 0)
+        g_variant_builder_add (&builder, "{sv}", key, value);
+      g_variant_unref (value);
+    }
+  g_variant_unref (properties);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/* Adds the properties of @interface which differ from the last signaled
+ * ones to @builder and remembers them. Returns whether any were added. */
+static gboolean
+add_changed_properties (Interfaces *interfaces,
+                        Interface *interface,
+                        GVariantBuilder *builder)
+{
+  const gchar *object_path;
+  GVariant *sent;
+  GVariant *current;
+  GVariantBuilder changed;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+  gboolean any = FALSE;
+
+  object_path = interface_get_object_path (interface);
+  sent = g_hash_table_lookup (interfaces->sent, object_path);
+  current = get_signaled_properties (interface);
+
+  g_variant_builder_init (&changed, G_VARIANT_TYPE_VARDICT);
+  g_variant_iter_init (&iter, current);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      gs_unref_variant GVariant *previous = NULL;
+
+      if (sent != NULL)
+        previous = g_variant_lookup_value (sent, key, NULL);
+      if (previous == NULL || !g_variant_equal (previous, value))
+        {
+          g_variant_builder_add (&changed, "{sv}", key, value);
+          any = TRUE;
+        }
+      g_variant_unref (value);
+    }
+
+  if (any)
+    g_variant_builder_add (builder, "{o@a{sv}}", object_path,
+                           g_variant_builder_end (&changed));
+  else
+    g_variant_builder_clear (&changed);
+
+  g_hash_table_insert (interfaces->sent, g_strdup (object_path), current);
+
+  return any;
+}
+
+static gboolean
+on_flush (gpointer user_data)
+{
+  Interfaces *interfaces = INTERFACES (user_data);
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key;
+  gboolean any = FALSE;
+
+  interfaces->flush_id = 0;
+
+  if (interfaces->entries_changed)
+    update_interfaces_property (interfaces);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sv}}"));
+  g_hash_table_iter_init (&iter, interfaces->dirty);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    any |= add_changed_properties (interfaces, INTERFACE (key), &builder);
+  g_hash_table_remove_all (interfaces->dirty);
+
+  if (any)
+    loom_interfaces_emit_interfaces_changed (LOOM_INTERFACES (interfaces),
+                                             g_variant_builder_end (&builder));
+  else
+    g_variant_builder_clear (&builder);
+
+  return FALSE;
+}
+
+static void
+schedule_flush (Interfaces *interfaces)
+{
+  if (interfaces->flush_id == 0)
+    interfaces->flush_id = g_idle_add (on_flush, interfaces);
+}
+
+static void
+on_interface_notify (GObject *object,
+                     GParamSpec *pspec,
+                     gpointer user_data)
+{
+  Interfaces *interfaces = INTERFACES (user_data);
+
+  g_hash_table_add (interfaces->dirty, object);
+  schedule_flush (interfaces);
+}
+
+static void
+unexport_interface (Interfaces *interfaces,
+                    Interface *interface)
+{
+  g_queue_remove (&interfaces->lru, interface);
+
+  g_signal_handlers_disconnect_by_data (interface, interfaces);
+  g_hash_table_remove (interfaces->dirty, interface);
+  g_hash_table_remove (interfaces->sent,
+                       interface_get_object_path (interface));
+
+  g_object_ref (interface);
+  g_hash_table_remove (interfaces->interfaces,
+                       interface_get_object_path (interface));
+  interface_unexport (interface);
+  g_object_unref (interface);
+}
+
+static void
+evict_interfaces (Interfaces *interfaces)
+{
+  GList *link;
+
+  if (!interfaces->on_demand)
+    return;
+
+  link = interfaces->lru.tail;
+  while (link != NULL && link != interfaces->lru.head &&
+         g_hash_table_size (interfaces->interfaces) > interfaces->max_exported)
+    {
+      Interface *interface = link->data;
+      GList *prev = link->prev;
+
+      if (!is_pinned (interfaces, interface))
+        unexport_interface (interfaces, interface);
+
+      link = prev;
+    }
+}
+
+static void
+touch_interface (Interfaces *interfaces,
+                 Interface *interface)
+{
+  if (!interfaces->on_demand)
+    return;
+
+  g_queue_remove (&interfaces->lru, interface);
+  g_queue_push_head (&interfaces->lru, interface);
+}
+
+static Interface *
+export_interface (Interfaces *interfaces,
+                  InterfaceEntry *entry)
+{
+  Interface *interface;
+
+  interface = INTERFACE (interface_new (interfaces->daemon, entry->name));
+  interface_export (interface);
+  g_hash_table_insert (interfaces->interfaces,
+                       (gchar *)interface_get_object_path (interface),
+                       interface);
+
+  g_hash_table_insert (interfaces->sent,
+                       g_strdup (interface_get_object_path (interface)),
+                       get_signaled_properties (interface));
+  g_signal_connect (interface, "notify",
+                    G_CALLBACK (on_interface_notify), interfaces);
+
+  if (interfaces->on_demand)
+    {
+      g_queue_push_head (&interfaces->lru, interface);
+      evict_interfaces (interfaces);
+    }
+
+  return interface;
+}
+
+/* Replaces @old_path by @new_path in the ActiveInterfaces property. */
+static void
+rename_active (Interfaces *interfaces,
+               const gchar *old_path,
+               const gchar *new_path)
+{
+  const gchar * const *active_interfaces;
+  gs_unref_ptrarray GPtrArray *_active_interfaces = NULL;
+  gboolean found = FALSE;
+
+  active_interfaces =
+    loom_interfaces_get_active_interfaces (LOOM_INTERFACES (interfaces));
+  _active_interfaces = g_ptr_array_new ();
+  for (guint i = 0; active_interfaces != NULL && active_interfaces[i] != NULL;
+       i++)
+    {
+      if (g_str_equal (active_interfaces[i], old_path))
+        {
+          g_ptr_array_add (_active_interfaces, (gpointer)new_path);
+          found = TRUE;
+        }
+      else
+        {
+          g_ptr_array_add (_active_interfaces, (gpointer)active_interfaces[i]);
+        }
+    }
+  g_ptr_array_add (_active_interfaces, NULL);
+
+  if (found)
+    loom_interfaces_set_active_interfaces (LOOM_INTERFACES (interfaces),
+                              (const gchar * const *)_active_interfaces->pdata);
+}
+
+/* Follows a rename of the link of @entry. An exported #Interface keeps its
+ * identity, connections refer to it, and moves to the new object-path. */
+static void
+rename_entry (Interfaces *interfaces,
+              InterfaceEntry *entry,
+              Interface *interface,
+              const gchar *name)
+{
+  g_hash_table_remove (interfaces->entries_by_name, entry->name);
+  g_strlcpy (entry->name, name, sizeof (entry->name));
+  g_hash_table_insert (interfaces->entries_by_name, entry->name, entry);
+  interfaces->entries_changed = TRUE;
+
+  if (interface != NULL)
+    {
+      gs_free gchar *old_path = NULL;
+
+      old_path = g_strdup (interface_get_object_path (interface));
+
+      /* the key is owned by the exported object */
+      g_hash_table_steal (interfaces->interfaces, old_path);
+      g_hash_table_remove (interfaces->sent, old_path);
+      g_hash_table_remove (interfaces->dirty, interface);
+
+      interface_rename (interface, name);
+
+      g_hash_table_insert (interfaces->interfaces,
+                           (gchar *)interface_get_object_path (interface),
+                           interface);
+      g_hash_table_insert (interfaces->sent,
+                           g_strdup (interface_get_object_path (interface)),
+                           get_signaled_properties (interface));
+      rename_active (interfaces, old_path,
+                     interface_get_object_path (interface));
+    }
+
+  schedule_flush (interfaces);
+}
+
+static gint
+compare_entries (gconstpointer a,
+                 gconstpointer b)
+{
+  const InterfaceEntry *entry_a = *(InterfaceEntry * const *)a;
+  const InterfaceEntry *entry_b = *(InterfaceEntry * const *)b;
+
+  return entry_a->ifindex - entry_b->ifindex;
+}
+
+static void
+update_interfaces_property (Interfaces *interfaces)
+{
+  gs_unref_ptrarray GPtrArray *entries = NULL;
+  gs_unref_ptrarray GPtrArray *object_paths = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  interfaces->entries_changed = FALSE;
+
+  entries = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, interfaces->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (entries, value);
+  g_ptr_array_sort (entries, compare_entries);
+
+  object_paths = g_ptr_array_new_with_free_func (g_free);
+  for (guint i = 0; i < entries->len; i++)
+    {
+      InterfaceEntry *entry = g_ptr_array_index (entries, i);
+      g_ptr_array_add (object_paths, interface_build_object_path (entry->name));
+    }
+  g_ptr_array_add (object_paths, NULL);
+
+  loom_interfaces_set_interfaces (LOOM_INTERFACES (interfaces),
+                                  (const gchar * const *)object_paths->pdata);
+}
+
 static void
 create_interfaces (Interfaces *interfaces)
 {
   struct nl_sock *sock = NULL;
   struct nl_cache *cache = NULL;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
-  rtnl_link_alloc_cache (sock, AF_UNSPEC, &cache);
+  nlio_link_alloc_cache (sock, &cache);
   if (cache == NULL)
     {
       g_warning (_("Error getting link cache from kernel."));
@@ -131,17 +565,12 @@ create_interfaces (Interfaces *interfaces)
   while (object != NULL)
     {
       struct rtnl_link *link = (struct rtnl_link *) object;
-      const gchar *name = rtnl_link_get_name (link);
-      const gchar *type = rtnl_link_get_type (link);
-      guint8 flags = rtnl_link_get_flags (link);
-      if (name != NULL && !(flags & IFF_LOOPBACK) && type == NULL)
+      if (link_filter_match (interfaces->filter, link))
         {
-          Interface *interface = INTERFACE (interface_new (interfaces->daemon,
-                                                           (gchar *)name));
-          interface_export (interface);
-          g_hash_table_insert (interfaces->interfaces,
-                               (gchar *)interface_get_object_path (interface),
-                               interface);
+          InterfaceEntry *entry = add_entry (interfaces, link);
+
+          if (!interfaces->on_demand)
+            export_interface (interfaces, entry);
         }
       object = nl_cache_get_next (object);
       if (object == NULL)
@@ -159,17 +588,29 @@ static void
 interfaces_constructed (GObject *object)
 {
   Interfaces *interfaces = INTERFACES (object);
-  gs_free gchar **object_paths = NULL;
+  gs_strfreev gchar **includes = NULL;
+  gs_strfreev gchar **excludes = NULL;
 
   g_assert (interfaces_instance == NULL);
   interfaces_instance = interfaces;
 
-  create_interfaces (interfaces);
+  includes = daemon_config_get_string_list (interfaces->daemon,
+                                            "Interfaces", "Include");
+  excludes = daemon_config_get_string_list (interfaces->daemon,
+                                            "Interfaces", "Exclude");
+  interfaces->filter = link_filter_new ((const gchar * const *)includes,
+                                        (const gchar * const *)excludes);
 
-  object_paths = (gchar **)g_hash_table_get_keys_as_array (interfaces->interfaces,
-                                                           NULL);
-  loom_interfaces_set_interfaces (LOOM_INTERFACES (object),
-                                  (const gchar * const *)object_paths);
+  interfaces->on_demand = daemon_config_get_boolean (interfaces->daemon,
+                                                     "Interfaces", "OnDemand",
+                                                     FALSE);
+  interfaces->max_exported = MAX (1, daemon_config_get_integer (interfaces->daemon,
+                                                                "Interfaces",
+                                                                "MaxExported",
+                                                                64));
+
+  create_interfaces (interfaces);
+  update_interfaces_property (interfaces);
 
   if (G_OBJECT_CLASS (interfaces_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (interfaces_parent_class)->constructed (object);
@@ -223,7 +664,8 @@ interfaces_new (Daemon *daemon)
  * @interfaces: A #Interfaces.
  * @object_path: A D-Bus object-path.
  *
- * Gets a #Interface by its D-Bus object-path.
+ * Gets a #Interface by its D-Bus object-path. In on-demand mode the
+ * #Interface is exported first if it is not yet.
  *
  * Returns: A #Interface object. Do not free, the object is owned by
  * @interfaces.
@@ -235,7 +677,212 @@ interfaces_get_by_object_path (Interfaces *interfaces,
   g_return_val_if_fail (IS_INTERFACES (interfaces), NULL);
   g_return_val_if_fail (g_variant_is_object_path (object_path), NULL);
 
-  return g_hash_table_lookup (interfaces->interfaces, object_path);
+  Interface *interface;
+  InterfaceEntry *entry;
+  const gchar *name;
+
+  interface = g_hash_table_lookup (interfaces->interfaces, object_path);
+  if (interface != NULL)
+    {
+      touch_interface (interfaces, interface);
+      return interface;
+    }
+
+  if (!interfaces->on_demand)
+    return NULL;
+
+  if (!g_str_has_prefix (object_path, "/org/blackox/Loom/Interface/"))
+    return NULL;
+
+  name = object_path + strlen ("/org/blackox/Loom/Interface/");
+  entry = lookup_entry (interfaces, name);
+  if (entry == NULL)
+    return NULL;
+
+  return export_interface (interfaces, entry);
+}
+
+/**
+ * interfaces_is_managed:
+ * @interfaces: A #Interfaces.
+ * @ifindex: An interface index.
+ *
+ * Checks whether the link with @ifindex is managed, whether an #Interface
+ * is exported for it or not.
+ *
+ * Returns: %TRUE if the link is managed.
+ */
+gboolean
+interfaces_is_managed (Interfaces *interfaces,
+                       gint ifindex)
+{
+  g_return_val_if_fail (IS_INTERFACES (interfaces), FALSE);
+  return lookup_entry_by_ifindex (interfaces, ifindex) != NULL;
+}
+
+/**
+ * interfaces_handle_link_event:
+ * @interfaces: A #Interfaces.
+ * @removed: %TRUE if the link was removed.
+ * @link: A rtnl link object received with a link event.
+ *
+ * Updates the managed links from a kernel link event. New and changed
+ * links are evaluated against the configured match rules, so a link is
+ * also picked up or dropped when e.g. its parent or address changes.
+ * Removed links and links no longer matching are dropped unless a
+ * connection refers to them.
+ */
+void
+interfaces_handle_link_event (Interfaces *interfaces,
+                              gboolean removed,
+                              struct rtnl_link *link)
+{
+  g_return_if_fail (IS_INTERFACES (interfaces));
+  g_return_if_fail (link != NULL);
+
+  InterfaceEntry *entry;
+  Interface *interface = NULL;
+  gboolean match = FALSE;
+
+  LOOM_PROBE3 (link__event, rtnl_link_get_ifindex (link),
+               rtnl_link_get_name (link), removed);
+
+  entry = lookup_entry_by_ifindex (interfaces, rtnl_link_get_ifindex (link));
+  if (entry == NULL && !removed && rtnl_link_get_name (link) != NULL)
+    {
+      /* a link kept for a connection came back with a new index */
+      entry = lookup_entry (interfaces, rtnl_link_get_name (link));
+      if (entry != NULL)
+        set_entry_ifindex (interfaces, entry, rtnl_link_get_ifindex (link));
+    }
+  if (entry != NULL)
+    {
+      gs_free gchar *object_path = interface_build_object_path (entry->name);
+      interface = g_hash_table_lookup (interfaces->interfaces, object_path);
+    }
+
+  if (!removed)
+    match = link_filter_match (interfaces->filter, link);
+
+  if (entry != NULL && !match)
+    {
+      if (interface != NULL)
+        {
+          if (is_pinned (interfaces, interface))
+            {
+              if (removed)
+                g_warning (_("Interface %s in use by a connection was removed."),
+                           entry->name);
+              else
+                g_warning (_("Interface %s in use by a connection does not "
+                             "match the rules anymore."), entry->name);
+              interface_handle_link (interface, link);
+              return;
+            }
+          unexport_interface (interfaces, interface);
+        }
+
+      remove_entry (interfaces, entry);
+      schedule_flush (interfaces);
+      return;
+    }
+
+  if (entry == NULL)
+    {
+      if (!match)
+        return;
+
+      entry = add_entry (interfaces, link);
+      if (!interfaces->on_demand)
+        export_interface (interfaces, entry);
+      schedule_flush (interfaces);
+      return;
+    }
+
+  if (rtnl_link_get_name (link) != NULL &&
+      !g_str_equal (entry->name, rtnl_link_get_name (link)))
+    rename_entry (interfaces, entry, interface, rtnl_link_get_name (link));
+
+  if (interface != NULL)
+    interface_handle_link (interface, link);
+}
+
+/**
+ * interfaces_pin:
+ * @interfaces: A #Interfaces.
+ * @interface: A #Interface.
+ *
+ * Keeps @interface exported until interfaces_unpin() is called, e.g. as long
+ * as a connection refers to it. Calls can be nested.
+ */
+void
+interfaces_pin (Interfaces *interfaces,
+                Interface *interface)
+{
+  g_return_if_fail (IS_INTERFACES (interfaces));
+  g_return_if_fail (IS_INTERFACE (interface));
+
+  guint count;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (interfaces->pins, interface));
+  g_hash_table_insert (interfaces->pins, interface, GUINT_TO_POINTER (count + 1));
+}
+
+/**
+ * interfaces_unpin:
+ * @interfaces: A #Interfaces.
+ * @interface: A #Interface.
+ *
+ * Releases a pin taken with interfaces_pin(). Once unpinned @interface may be
+ * unexported again in on-demand mode.
+ */
+void
+interfaces_unpin (Interfaces *interfaces,
+                  Interface *interface)
+{
+  g_return_if_fail (IS_INTERFACES (interfaces));
+  g_return_if_fail (IS_INTERFACE (interface));
+
+  guint count;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (interfaces->pins, interface));
+  g_return_if_fail (count > 0);
+
+  if (count > 1)
+    {
+      g_hash_table_insert (interfaces->pins, interface,
+                           GUINT_TO_POINTER (count - 1));
+      return;
+    }
+
+  g_hash_table_remove (interfaces->pins, interface);
+  evict_interfaces (interfaces);
+}
+
+static gboolean
+handle_lookup (LoomInterfaces *object,
+               GDBusMethodInvocation *invocation,
+               const gchar *arg_name)
+{
+  Interfaces *interfaces = INTERFACES (object);
+  GError *error = NULL;
+  gs_free gchar *object_path = NULL;
+
+  if (lookup_entry (interfaces, arg_name) == NULL)
+    {
+      error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                           _("no such 'interface' object found"));
+      g_dbus_method_invocation_take_error (invocation, error);
+
+      return TRUE;
+    }
+
+  object_path = interface_build_object_path (arg_name);
+  interfaces_get_by_object_path (interfaces, object_path);
+
+  loom_interfaces_complete_lookup (object, invocation, object_path);
+
+  return TRUE;
 }
 
 /**
@@ -319,4 +966,114 @@ interfaces_remove_from_actives (Interfaces *interfaces,
 static void
 interfaces_iface_init (LoomInterfacesIface *iface)
 {
+  iface->handle_lookup = handle_lookup;
+}
+
+/**
+ * interfaces_handle_address_event:
+ * @interfaces: A #Interfaces.
+ * @removed: %TRUE if the address was removed.
+ * @addr: A rtnl address object received with an address event.
+ *
+ * Forwards a kernel address event to the exported #Interface of the link.
+ */
+void
+interfaces_handle_address_event (Interfaces *interfaces,
+                                 gboolean removed,
+                                 struct rtnl_addr *addr)
+{
+  g_return_if_fail (IS_INTERFACES (interfaces));
+  g_return_if_fail (addr != NULL);
+
+  InterfaceEntry *entry;
+  Interface *interface;
+  gs_free gchar *object_path = NULL;
+
+  LOOM_PROBE2 (address__event, rtnl_addr_get_ifindex (addr), removed);
+
+  entry = lookup_entry_by_ifindex (interfaces, rtnl_addr_get_ifindex (addr));
+  if (entry == NULL)
+    return;
+
+  object_path = interface_build_object_path (entry->name);
+  interface = g_hash_table_lookup (interfaces->interfaces, object_path);
+  if (interface != NULL)
+    interface_handle_address (interface, removed, addr);
+}
+
+/**
+ * interfaces_resync_links:
+ * @interfaces: A #Interfaces.
+ * @cache: A rtnl link cache dumped from the kernel.
+ *
+ * Brings the managed links in line with @cache after link events were
+ * lost. Only differences are applied and signalled.
+ */
+void
+interfaces_resync_links (Interfaces *interfaces,
+                         struct nl_cache *cache)
+{
+  g_return_if_fail (IS_INTERFACES (interfaces));
+  g_return_if_fail (cache != NULL);
+
+  gs_unref_hashtable GHashTable *present = NULL;
+  gs_unref_ptrarray GPtrArray *gone = NULL;
+  struct nl_object *object;
+  GHashTableIter iter;
+  gpointer value;
+
+  present = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (object = nl_cache_get_first (cache); object != NULL;
+       object = nl_cache_get_next (object))
+    g_hash_table_add (present, GINT_TO_POINTER (
+                        rtnl_link_get_ifindex ((struct rtnl_link *) object)));
+
+  /* links removed while events were lost, collected first as entries
+   * may go */
+  gone = g_ptr_array_new_with_free_func ((GDestroyNotify) rtnl_link_put);
+  g_hash_table_iter_init (&iter, interfaces->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      InterfaceEntry *entry = value;
+      struct rtnl_link *link;
+
+      if (g_hash_table_contains (present, GINT_TO_POINTER (entry->ifindex)))
+        continue;
+
+      link = rtnl_link_alloc ();
+      rtnl_link_set_ifindex (link, entry->ifindex);
+      rtnl_link_set_name (link, entry->name);
+      g_ptr_array_add (gone, link);
+    }
+  for (guint i = 0; i < gone->len; i++)
+    interfaces_handle_link_event (interfaces, TRUE, g_ptr_array_index (gone, i));
+
+  /* links added or changed, unchanged ones do not emit anything */
+  for (object = nl_cache_get_first (cache); object != NULL;
+       object = nl_cache_get_next (object))
+    interfaces_handle_link_event (interfaces, FALSE,
+                                  (struct rtnl_link *) object);
+}
+
+/**
+ * interfaces_resync_addresses:
+ * @interfaces: A #Interfaces.
+ * @cache: A rtnl address cache dumped from the kernel.
+ *
+ * Brings the addresses of the exported interfaces in line with @cache after
+ * address events were lost.
+ */
+void
+interfaces_resync_addresses (Interfaces *interfaces,
+                             struct nl_cache *cache)
+{
+  g_return_if_fail (IS_INTERFACES (interfaces));
+  g_return_if_fail (cache != NULL);
+
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, interfaces->interfaces);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    interface_sync_addresses (INTERFACE (value), cache);
 }
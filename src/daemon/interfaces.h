@@ -24,6 +24,10 @@
 
 G_BEGIN_DECLS
 
+struct rtnl_link;
+struct rtnl_addr;
+struct nl_cache;
+
 #define TYPE_INTERFACES  (interfaces_get_type ())
 #define INTERFACES(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), \
                           TYPE_INTERFACES, Interfaces))
@@ -35,6 +39,22 @@ LoomInterfaces * interfaces_new      (Daemon *daemon);
 
 Interface * interfaces_get_by_object_path (Interfaces *interfaces,
                                            const gchar* object_path);
+gboolean    interfaces_is_managed         (Interfaces *interfaces,
+                                           gint ifindex);
+
+void interfaces_handle_link_event (Interfaces *interfaces,
+                                   gboolean removed,
+                                   struct rtnl_link *link);
+void interfaces_handle_address_event (Interfaces *interfaces,
+                                      gboolean removed,
+                                      struct rtnl_addr *addr);
+void interfaces_resync_links         (Interfaces *interfaces,
+                                      struct nl_cache *cache);
+void interfaces_resync_addresses     (Interfaces *interfaces,
+                                      struct nl_cache *cache);
+
+void interfaces_pin   (Interfaces *interfaces, Interface *interface);
+void interfaces_unpin (Interfaces *interfaces, Interface *interface);
 
 void interfaces_add_to_actives      (Interfaces *interfaces,
                                      Interface *interface);
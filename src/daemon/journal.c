@@ -0,0 +1,216 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "journal.h"
+
+/**
+ * SECTION: Journal
+ * @title: Journal
+ * @short_description: Bounded journal of state changes.
+ *
+ * Records changes of exported objects in a ring buffer, each tagged with a
+ * monotonically increasing sequence number. Clients catching up after a
+ * reconnect fetch the changes since the last sequence they have seen; once
+ * that sequence has been overwritten they have to fetch the full state.
+ */
+
+typedef struct
+{
+  guint64 sequence;
+  ChangeKind kind;
+  ChangeOp op;
+  gchar *object_path;
+} JournalEntry;
+
+struct _Journal
+{
+  JournalEntry *entries;
+  guint capacity;
+  guint head;
+  guint length;
+
+  guint64 sequence;
+  guint64 first_sequence;
+};
+
+/**
+ * journal_new:
+ * @capacity: Maximum number of changes kept.
+ * @sequence: The sequence number to start from.
+ *
+ * Creates a new, empty #Journal. The first recorded change gets sequence
+ * number @sequence + 1.
+ *
+ * Returns: A new #Journal. Free with journal_free().
+ */
+Journal *
+journal_new (guint capacity,
+             guint64 sequence)
+{
+  Journal *journal;
+
+  journal = g_slice_new0 (Journal);
+  journal->capacity = MAX (capacity, 1);
+  journal->entries = g_new0 (JournalEntry, journal->capacity);
+  journal->sequence = sequence;
+  journal->first_sequence = sequence + 1;
+
+  return journal;
+}
+
+/**
+ * journal_free:
+ * @journal: A #Journal.
+ *
+ * Frees @journal.
+ */
+void
+journal_free (Journal *journal)
+{
+  if (journal == NULL)
+    return;
+
+  for (guint i = 0; i < journal->capacity; i++)
+    g_free (journal->entries[i].object_path);
+  g_free (journal->entries);
+  g_slice_free (Journal, journal);
+}
+
+static JournalEntry *
+journal_nth (Journal *journal,
+             guint n)
+{
+  return &journal->entries[(journal->head + n) % journal->capacity];
+}
+
+/**
+ * journal_append:
+ * @journal: A #Journal.
+ * @kind: The kind of change.
+ * @op: The operation.
+ * @object_path: The object-path of the changed object.
+ *
+ * Records a change. A change of the same object repeating the most recent
+ * one is merged into it and only gets the new sequence number.
+ *
+ * Returns: The sequence number of the change.
+ */
+guint64
+journal_append (Journal *journal,
+                ChangeKind kind,
+                ChangeOp op,
+                const gchar *object_path)
+{
+  g_return_val_if_fail (journal != NULL, 0);
+  g_return_val_if_fail (object_path != NULL, 0);
+
+  JournalEntry *entry;
+
+  journal->sequence++;
+
+  if (journal->length > 0)
+    {
+      entry = journal_nth (journal, journal->length - 1);
+      if (entry->kind == kind && entry->op == op &&
+          op == CHANGE_OP_CHANGED &&
+          g_str_equal (entry->object_path, object_path))
+        {
+          entry->sequence = journal->sequence;
+          return journal->sequence;
+        }
+    }
+
+  if (journal->length == journal->capacity)
+    {
+      journal->first_sequence = journal_nth (journal, 0)->sequence + 1;
+      journal->head = (journal->head + 1) % journal->capacity;
+      journal->length--;
+    }
+
+  entry = journal_nth (journal, journal->length);
+  entry->sequence = journal->sequence;
+  entry->kind = kind;
+  entry->op = op;
+  g_free (entry->object_path);
+  entry->object_path = g_strdup (object_path);
+  journal->length++;
+
+  return journal->sequence;
+}
+
+/**
+ * journal_get_sequence:
+ * @journal: A #Journal.
+ *
+ * Returns: The sequence number of the most recent change.
+ */
+guint64
+journal_get_sequence (Journal *journal)
+{
+  g_return_val_if_fail (journal != NULL, 0);
+  return journal->sequence;
+}
+
+/**
+ * journal_get_changes_since:
+ * @journal: A #Journal.
+ * @sequence: The last sequence number seen by the caller.
+ * @resync: (out): Return location for whether the changes since @sequence
+ * are no longer known and the caller has to fetch the full state.
+ *
+ * Gets the changes recorded after @sequence as array of (sequence, kind,
+ * operation, object-path) tuples.
+ *
+ * Returns: A floating #GVariant of type a(tuuo), empty if @resync is set.
+ */
+GVariant *
+journal_get_changes_since (Journal *journal,
+                           guint64 sequence,
+                           gboolean *resync)
+{
+  g_return_val_if_fail (journal != NULL, NULL);
+  g_return_val_if_fail (resync != NULL, NULL);
+
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(tuuo)"));
+
+  *resync = sequence > journal->sequence ||
+            sequence + 1 < journal->first_sequence;
+  if (*resync)
+    return g_variant_builder_end (&builder);
+
+  for (guint i = 0; i < journal->length; i++)
+    {
+      JournalEntry *entry = journal_nth (journal, i);
+
+      if (entry->sequence <= sequence)
+        continue;
+
+      g_variant_builder_add (&builder, "(tuuo)",
+                             entry->sequence,
+                             (guint32) entry->kind,
+                             (guint32) entry->op,
+                             entry->object_path);
+    }
+
+  return g_variant_builder_end (&builder);
+}
@@ -0,0 +1,77 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_JOURNAL_H
+#define LOOM_JOURNAL_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _Journal Journal;
+
+/**
+ * ChangeKind:
+ * @CHANGE_KIND_LINK: An interface object changed.
+ * @CHANGE_KIND_ADDRESS: The address of an interface changed.
+ * @CHANGE_KIND_SETTING: A setting object changed.
+ * @CHANGE_KIND_CONNECTION: A connection object changed.
+ *
+ * Kind of a recorded change. The values are flags so sets of kinds can be
+ * expressed as a mask.
+ */
+typedef enum
+{
+  CHANGE_KIND_LINK       = 1 << 0,
+  CHANGE_KIND_ADDRESS    = 1 << 1,
+  CHANGE_KIND_SETTING    = 1 << 2,
+  CHANGE_KIND_CONNECTION = 1 << 3,
+} ChangeKind;
+
+/**
+ * ChangeOp:
+ * @CHANGE_OP_ADDED: The object was exported.
+ * @CHANGE_OP_REMOVED: The object was unexported.
+ * @CHANGE_OP_CHANGED: Properties of the object changed.
+ *
+ * Operation of a recorded change.
+ */
+typedef enum
+{
+  CHANGE_OP_ADDED   = 1,
+  CHANGE_OP_REMOVED = 2,
+  CHANGE_OP_CHANGED = 3,
+} ChangeOp;
+
+Journal * journal_new  (guint capacity,
+                        guint64 sequence);
+void      journal_free (Journal *journal);
+
+guint64    journal_append              (Journal *journal,
+                                        ChangeKind kind,
+                                        ChangeOp op,
+                                        const gchar *object_path);
+guint64    journal_get_sequence        (Journal *journal);
+GVariant * journal_get_changes_since   (Journal *journal,
+                                        guint64 sequence,
+                                        gboolean *resync);
+
+G_END_DECLS
+
+#endif /* LOOM_JOURNAL_H */
@@ -0,0 +1,310 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+
+#include "linkfilter.h"
+
+/**
+ * SECTION: LinkFilter
+ * @title: LinkFilter
+ * @short_description: Include and exclude rules for managed links.
+ *
+ * A #LinkFilter decides which kernel links the daemon manages. Rules are
+ * given as strings of the form <literal>match:value</literal> and compiled
+ * once:
+ *
+ * <literal>name:GLOB</literal> matches the link name,
+ * <literal>kind:GLOB</literal> matches the link kind, e.g. vlan or veth,
+ * <literal>mac:PREFIX</literal> matches the start of the hardware address,
+ * <literal>driver:GLOB</literal> matches the name of the device driver and
+ * <literal>parent:IFINDEX</literal> matches the index of the parent link.
+ * A rule without a match is taken as name glob.
+ *
+ * Loopback links never match. Without include rules only links without a
+ * kind, i.e. physical devices, are included. Exclude rules always win.
+ */
+
+typedef enum
+{
+  RULE_NAME,
+  RULE_KIND,
+  RULE_MAC,
+  RULE_DRIVER,
+  RULE_PARENT,
+} RuleType;
+
+typedef struct
+{
+  RuleType type;
+  GPatternSpec *pattern;
+  gchar *prefix;
+  gint ifindex;
+} Rule;
+
+struct _LinkFilter
+{
+  GArray *includes;
+  GArray *excludes;
+  gboolean need_driver;
+};
+
+static void
+rule_clear (Rule *rule)
+{
+  if (rule->pattern != NULL)
+    g_pattern_spec_free (rule->pattern);
+  g_free (rule->prefix);
+}
+
+static gboolean
+rule_parse (const gchar *str,
+            Rule *rule)
+{
+  const gchar *value;
+  gchar *end = NULL;
+
+  memset (rule, 0, sizeof (Rule));
+
+  value = strchr (str, ':');
+  if (value == NULL || g_str_has_prefix (str, "name:"))
+    {
+      rule->type = RULE_NAME;
+      rule->pattern = g_pattern_spec_new (value != NULL ? value + 1 : str);
+      return TRUE;
+    }
+  value++;
+
+  if (g_str_has_prefix (str, "kind:"))
+    {
+      rule->type = RULE_KIND;
+      rule->pattern = g_pattern_spec_new (value);
+    }
+  else if (g_str_has_prefix (str, "mac:"))
+    {
+      rule->type = RULE_MAC;
+      rule->prefix = g_ascii_strdown (value, -1);
+    }
+  else if (g_str_has_prefix (str, "driver:"))
+    {
+      rule->type = RULE_DRIVER;
+      rule->pattern = g_pattern_spec_new (value);
+    }
+  else if (g_str_has_prefix (str, "parent:"))
+    {
+      rule->type = RULE_PARENT;
+      rule->ifindex = (gint) g_ascii_strtoll (value, &end, 10);
+      if (end == value || *end != '\0' || rule->ifindex <= 0)
+        return FALSE;
+    }
+  else
+    {
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static GArray *
+compile_rules (const gchar * const *rules,
+               gboolean *need_driver)
+{
+  GArray *array;
+
+  array = g_array_new (FALSE, TRUE, sizeof (Rule));
+  g_array_set_clear_func (array, (GDestroyNotify) rule_clear);
+
+  if (rules == NULL)
+    return array;
+
+  for (guint i = 0; rules[i] != NULL; i++)
+    {
+      Rule rule;
+      gs_free gchar *str = g_strstrip (g_strdup (rules[i]));
+
+      if (*str == '\0')
+        continue;
+
+      if (!rule_parse (str, &rule))
+        {
+          g_warning (_("Ignoring invalid interface match rule '%s'."), str);
+          rule_clear (&rule);
+          continue;
+        }
+
+      if (rule.type == RULE_DRIVER)
+        *need_driver = TRUE;
+
+      g_array_append_val (array, rule);
+    }
+
+  return array;
+}
+
+/**
+ * link_filter_new:
+ * @includes: (allow-none): A %NULL-terminated array of include rules.
+ * @excludes: (allow-none): A %NULL-terminated array of exclude rules.
+ *
+ * Compiles a new #LinkFilter. Invalid rules are skipped with a warning.
+ *
+ * Returns: A new #LinkFilter. Free with link_filter_free().
+ */
+LinkFilter *
+link_filter_new (const gchar * const *includes,
+                 const gchar * const *excludes)
+{
+  LinkFilter *filter;
+
+  filter = g_slice_new0 (LinkFilter);
+  filter->includes = compile_rules (includes, &filter->need_driver);
+  filter->excludes = compile_rules (excludes, &filter->need_driver);
+
+  return filter;
+}
+
+/**
+ * link_filter_free:
+ * @filter: A #LinkFilter.
+ *
+ * Frees @filter.
+ */
+void
+link_filter_free (LinkFilter *filter)
+{
+  if (filter == NULL)
+    return;
+
+  g_array_unref (filter->includes);
+  g_array_unref (filter->excludes);
+  g_slice_free (LinkFilter, filter);
+}
+
+static gchar *
+read_link_driver (const gchar *name)
+{
+  gs_free gchar *path = NULL;
+  gs_free gchar *target = NULL;
+
+  path = g_build_filename ("/sys/class/net", name, "device", "driver", NULL);
+  target = g_file_read_link (path, NULL);
+  if (target == NULL)
+    return NULL;
+
+  return g_path_get_basename (target);
+}
+
+static gboolean
+match_rules (GArray *rules,
+             const gchar *name,
+             const gchar *kind,
+             const gchar *mac,
+             const gchar *driver,
+             gint parent)
+{
+  for (guint i = 0; i < rules->len; i++)
+    {
+      Rule *rule = &g_array_index (rules, Rule, i);
+
+      switch (rule->type)
+        {
+        case RULE_NAME:
+          if (g_pattern_match_string (rule->pattern, name))
+            return TRUE;
+          break;
+
+        case RULE_KIND:
+          if (kind != NULL && g_pattern_match_string (rule->pattern, kind))
+            return TRUE;
+          break;
+
+        case RULE_MAC:
+          if (g_str_has_prefix (mac, rule->prefix))
+            return TRUE;
+          break;
+
+        case RULE_DRIVER:
+          if (driver != NULL && g_pattern_match_string (rule->pattern, driver))
+            return TRUE;
+          break;
+
+        case RULE_PARENT:
+          if (parent == rule->ifindex)
+            return TRUE;
+          break;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * link_filter_match:
+ * @filter: A #LinkFilter.
+ * @link: A rtnl link object.
+ *
+ * Evaluates @filter for @link.
+ *
+ * Returns: %TRUE if @link should be managed.
+ */
+gboolean
+link_filter_match (LinkFilter *filter,
+                   struct rtnl_link *link)
+{
+  g_return_val_if_fail (filter != NULL, FALSE);
+  g_return_val_if_fail (link != NULL, FALSE);
+
+  const gchar *name;
+  const gchar *kind;
+  gchar mac[32] = { 0, };
+  gs_free gchar *driver = NULL;
+  struct nl_addr *addr;
+  gint parent;
+
+  name = rtnl_link_get_name (link);
+  if (name == NULL || rtnl_link_get_flags (link) & IFF_LOOPBACK)
+    return FALSE;
+
+  kind = rtnl_link_get_type (link);
+  parent = rtnl_link_get_link (link);
+
+  addr = rtnl_link_get_addr (link);
+  if (addr != NULL)
+    nl_addr2str (addr, mac, sizeof (mac));
+
+  if (filter->need_driver)
+    driver = read_link_driver (name);
+
+  if (match_rules (filter->excludes, name, kind, mac, driver, parent))
+    return FALSE;
+
+  if (filter->includes->len == 0)
+    return kind == NULL;
+
+  return match_rules (filter->includes, name, kind, mac, driver, parent);
+}
@@ -0,0 +1,39 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_LINK_FILTER_H
+#define LOOM_LINK_FILTER_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+struct rtnl_link;
+
+typedef struct _LinkFilter LinkFilter;
+
+LinkFilter * link_filter_new   (const gchar * const *includes,
+                                const gchar * const *excludes);
+void         link_filter_free  (LinkFilter *filter);
+gboolean     link_filter_match (LinkFilter *filter,
+                                struct rtnl_link *link);
+
+G_END_DECLS
+
+#endif /* LOOM_LINK_FILTER_H */
@@ -0,0 +1,200 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_STATS_H
+#define LOOM_STATS_H
+
+/**
+ * SECTION: loom-stats
+ * @title: Stats page
+ * @short_description: Layout of the shared memory stats page.
+ *
+ * The daemon publishes the link state and counters of the managed
+ * interfaces in a file, set with Path= in the [Stats] section of loomd.conf
+ * and off by default, meant to be mapped read-only with mmap() by local
+ * readers. Reading it takes no system calls and no work in the daemon.
+ *
+ * The file starts with a #LoomStatsHeader followed by
+ * @max_interfaces slots of @interface_size bytes each, a
+ * #LoomStatsInterface. Readers must use the sizes from the header, later
+ * versions may append fields. Slots with an @ifindex of 0 are unused; only
+ * the first @n_interfaces slots were ever used.
+ *
+ * Each slot is guarded by a sequence lock: the daemon makes @seq odd
+ * before and even again after updating the slot. A reader copies the slot
+ * and retries while @seq was odd or changed meanwhile, see
+ * loom_stats_read_interface(). A slot staying odd belongs to a daemon that
+ * died during an update.
+ *
+ * The file is replaced when the daemon restarts and removed when it stops;
+ * readers should check @pid and @updated to detect a stale mapping.
+ */
+
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOOM_STATS_MAGIC   0x4d4f4f4cU /* "LOOM" */
+#define LOOM_STATS_VERSION 1
+
+#define LOOM_STATS_NAME_SIZE 16
+
+/**
+ * LoomStatsFlags:
+ * @LOOM_STATS_UP: The interface is administratively up.
+ * @LOOM_STATS_CARRIER: The interface has carrier.
+ *
+ * Flags of a #LoomStatsInterface.
+ */
+enum
+{
+  LOOM_STATS_UP      = 1 << 0,
+  LOOM_STATS_CARRIER = 1 << 1,
+};
+
+/**
+ * LoomStatsHeader:
+ * @magic: %LOOM_STATS_MAGIC.
+ * @version: %LOOM_STATS_VERSION.
+ * @header_size: Size of the header in bytes.
+ * @interface_size: Size of an interface slot in bytes.
+ * @max_interfaces: Number of interface slots.
+ * @n_interfaces: Number of slots used so far.
+ * @pid: Process id of the daemon.
+ * @interval: Update period in milli-seconds.
+ * @updated: CLOCK_MONOTONIC time of the last update in micro-seconds.
+ *
+ * Header of the stats page.
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t interface_size;
+  uint32_t max_interfaces;
+  uint32_t n_interfaces;
+  uint32_t pid;
+  uint32_t interval;
+  uint64_t updated;
+  uint8_t  reserved[24];
+} LoomStatsHeader;
+
+/**
+ * LoomStatsInterface:
+ * @seq: Sequence lock, odd while the slot is updated.
+ * @ifindex: Interface index, 0 if the slot is unused.
+ * @name: Interface name, NUL-terminated.
+ * @flags: #LoomStatsFlags.
+ * @mtu: MTU of the interface.
+ * @rx_bytes: Bytes received.
+ * @tx_bytes: Bytes transmitted.
+ * @rx_packets: Packets received.
+ * @tx_packets: Packets transmitted.
+ * @rx_errors: Receive errors.
+ * @tx_errors: Transmit errors.
+ * @rx_dropped: Received packets dropped.
+ * @tx_dropped: Packets to transmit dropped.
+ * @updated: CLOCK_MONOTONIC time of the last update in micro-seconds.
+ *
+ * Slot of an interface.
+ */
+typedef struct
+{
+  uint32_t seq;
+  int32_t  ifindex;
+  char     name[LOOM_STATS_NAME_SIZE];
+  uint32_t flags;
+  uint32_t mtu;
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  uint64_t rx_packets;
+  uint64_t tx_packets;
+  uint64_t rx_errors;
+  uint64_t tx_errors;
+  uint64_t rx_dropped;
+  uint64_t tx_dropped;
+  uint64_t updated;
+  uint8_t  reserved[24];
+} LoomStatsInterface;
+
+/**
+ * loom_stats_get_interface:
+ * @header: The mapped stats page.
+ * @index: A slot index less than @max_interfaces.
+ *
+ * Returns: The slot at @index.
+ */
+static inline const LoomStatsInterface *
+loom_stats_get_interface (const LoomStatsHeader *header,
+                          uint32_t index)
+{
+  return (const LoomStatsInterface *)
+    ((const char *) header + header->header_size +
+     (size_t) index * header->interface_size);
+}
+
+/**
+ * LOOM_STATS_READ_RETRIES:
+ *
+ * Number of attempts loom_stats_read_interface() makes before giving up on
+ * a slot, e.g. one left odd by a daemon that died during an update.
+ */
+#define LOOM_STATS_READ_RETRIES 1000
+
+/**
+ * loom_stats_read_interface:
+ * @slot: A slot of the mapped stats page.
+ * @copy: Return location for a consistent copy of @slot.
+ *
+ * Copies @slot, retrying while the daemon updates it. The CPU is yielded
+ * between attempts.
+ *
+ * Returns: 0 on success, -1 if @slot did not settle within
+ * #LOOM_STATS_READ_RETRIES attempts.
+ */
+static inline int
+loom_stats_read_interface (const LoomStatsInterface *slot,
+                           LoomStatsInterface *copy)
+{
+  uint32_t seq;
+
+  for (int i = 0; i < LOOM_STATS_READ_RETRIES; i++)
+    {
+      if (i > 0)
+        sched_yield ();
+
+      seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+      if (seq & 1)
+        continue;
+
+      memcpy (copy, slot, sizeof (LoomStatsInterface));
+
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+      if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) == seq)
+        {
+          copy->seq = seq;
+          return 0;
+        }
+    }
+
+  return -1;
+}
+
+#endif /* LOOM_STATS_H */
@@ -28,8 +28,18 @@
 
 static GMainLoop *loop = NULL;
 static Daemon *the_daemon = NULL;
+static GKeyFile *config = NULL;
 static gboolean name_acquired;
 
+static gchar *opt_config = NULL;
+
+static GOptionEntry opt_entries[] =
+{
+  { "config", 'c', 0, G_OPTION_ARG_FILENAME, &opt_config,
+    N_("Configuration file to use"), N_("FILE") },
+  { NULL }
+};
+
 static void
 on_bus_acquired (GDBusConnection *connection,
                  const gchar *name,
@@ -37,7 +47,7 @@ on_bus_acquired (GDBusConnection *connection,
 {
   name = name;
   user_data = user_data;
-  the_daemon = daemon_new (connection);
+  the_daemon = daemon_new (connection, config);
 }
 
 static void
@@ -78,6 +88,8 @@ main (int argc,
   guint name_owner_id;
   gint ret;
   guint sigint_id;
+  GOptionContext *context;
+  GError *error = NULL;
 
   setlocale(LC_ALL, "");
 
@@ -90,6 +102,30 @@ main (int argc,
   name_owner_id = 0;
   sigint_id = 0;
 
+  context = g_option_context_new (NULL);
+  g_option_context_set_translation_domain (context, GETTEXT_PACKAGE);
+  g_option_context_add_main_entries (context, opt_entries, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      g_option_context_free (context);
+      return ret;
+    }
+  g_option_context_free (context);
+
+  if (opt_config == NULL)
+    opt_config = g_build_filename (LOOM_SYSCONFDIR, "loom", "loomd.conf", NULL);
+
+  config = g_key_file_new ();
+  if (!g_key_file_load_from_file (config, opt_config, G_KEY_FILE_NONE, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning (_("Failed to load configuration file %s: %s"),
+                   opt_config, error->message);
+      g_clear_error (&error);
+    }
+
   signal (SIGPIPE, SIG_IGN);
   sigint_id = g_unix_signal_add_full (G_PRIORITY_DEFAULT,
                                       SIGINT,
@@ -128,6 +164,8 @@ main (int argc,
     g_bus_unown_name (name_owner_id);
   if (loop != NULL)
     g_main_loop_unref (loop);
+  g_key_file_unref (config);
+  g_free (opt_config);
 
   return ret;
 }
@@ -0,0 +1,796 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+
+#include "daemon.h"
+#include "manager.h"
+#include "journal.h"
+#include "subscriptions.h"
+#include "waiters.h"
+#include "snapshot.h"
+
+/**
+ * SECTION: Manager
+ * @title: Manager
+ * @short_description: Implementation of #LoomManager for state retrieval.
+ *
+ * This type provides an implementation of the #LoomManager interface.
+ *
+ * The manager watches all objects exported by the daemon object manager and
+ * records every change in a #Journal. The state returned by GetState() and
+ * List() is taken from an immutable #Snapshot, serialized once per
+ * generation, the sequence number of the most recent change, and handed
+ * out unchanged until the next change. A change only marks the snapshot
+ * stale, the next GetState() or List() call or manager_acquire_snapshot()
+ * builds a new one, so changes nobody reads cost no serialization. A
+ * snapshot, once acquired, may be read by any thread. Reconnecting
+ * clients fetch the changes since the generation they know with
+ * GetChangesSince(). Clients interested in a few objects only subscribe to
+ * their changes with Subscribe() and receive them as unicast Event
+ * signals.
+ *
+ * Interface, setting and connection objects are kept in ordered indexes of
+ * their object-paths, so snapshots list them sorted and List() can hand out
+ * bounded pages starting at a cursor with a binary search.
+ *
+ * WaitFor() invocations are completed from the same change notifications,
+ * so clients learn about readiness without polling.
+ */
+
+/* Version of the GetState() reply layout. */
+#define STATE_VERSION 1
+
+/* Default number of changes kept for GetChangesSince(). */
+#define JOURNAL_SIZE 1024
+
+/* Default and maximum number of objects per List() page. */
+#define PAGE_SIZE     64
+#define MAX_PAGE_SIZE 256
+
+typedef struct _ManagerClass ManagerClass;
+
+/**
+ * Manager:
+ *
+ * The #Manager structure contains only private data and should only be
+ * accessed using the provided API.
+ */
+struct _Manager
+{
+  LoomManagerSkeleton parent_instance;
+  Daemon *daemon;
+  GDBusObjectManager *object_manager;
+
+  Journal *journal;
+  Subscriptions *subscriptions;
+  Waiters *waiters;
+
+  Snapshot *snapshot;
+  gboolean stale;
+
+  GSequence *indexes[N_SNAPSHOT_KINDS];
+};
+
+struct _ManagerClass
+{
+  LoomManagerSkeletonClass parent_class;
+};
+
+enum
+{
+  PROP_0,
+  PROP_DAEMON,
+};
+
+static void manager_iface_init (LoomManagerIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (Manager, manager,
+                         LOOM_TYPE_MANAGER_SKELETON,
+                         G_IMPLEMENT_INTERFACE (LOOM_TYPE_MANAGER,
+                                                manager_iface_init));
+
+static ChangeKind
+get_change_kind (GDBusInterface *interface,
+                 const gchar *property)
+{
+  if (LOOM_IS_INTERFACE (interface))
+    {
+      if (g_strcmp0 (property, "address") == 0 ||
+          g_strcmp0 (property, "addresses") == 0)
+        return CHANGE_KIND_ADDRESS;
+      return CHANGE_KIND_LINK;
+    }
+  if (LOOM_IS_INTERFACES (interface))
+    return CHANGE_KIND_LINK;
+  if (LOOM_IS_SETTING (interface) || LOOM_IS_SETTINGS (interface))
+    return CHANGE_KIND_SETTING;
+  if (LOOM_IS_CONNECTION (interface) || LOOM_IS_CONNECTIONS (interface))
+    return CHANGE_KIND_CONNECTION;
+
+  return 0;
+}
+
+static void
+record_change (Manager *manager,
+               ChangeKind kind,
+               ChangeOp op,
+               const gchar *object_path)
+{
+  guint64 sequence;
+
+  if (kind == 0)
+    return;
+
+  sequence = journal_append (manager->journal, kind, op, object_path);
+  subscriptions_dispatch (manager->subscriptions, sequence, kind, op,
+                          object_path);
+  if (op == CHANGE_OP_REMOVED)
+    waiters_object_removed (manager->waiters, object_path);
+  else
+    waiters_check (manager->waiters, object_path);
+
+  manager->stale = TRUE;
+}
+
+static void
+record_object_change (Manager *manager,
+                      GDBusObject *object,
+                      ChangeOp op)
+{
+  GList *interfaces;
+  ChangeKind kind = 0;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL && kind == 0; l = l->next)
+    kind = get_change_kind (G_DBUS_INTERFACE (l->data), NULL);
+  g_list_free_full (interfaces, g_object_unref);
+
+  record_change (manager, kind, op, g_dbus_object_get_object_path (object));
+}
+
+static void
+on_property_notify (GObject *object,
+                    GParamSpec *pspec,
+                    gpointer user_data)
+{
+  Manager *manager = MANAGER (user_data);
+  GDBusInterface *interface = G_DBUS_INTERFACE (object);
+  GDBusObject *_object;
+
+  _object = g_dbus_interface_get_object (interface);
+  if (_object == NULL)
+    return;
+
+  record_change (manager, get_change_kind (interface, pspec->name),
+                 CHANGE_OP_CHANGED, g_dbus_object_get_object_path (_object));
+}
+
+/* All handlers are connected with g_signal_connect_object() and go away
+ * with the manager, watched objects may outlive it during shutdown. */
+
+static void
+watch_interface (Manager *manager,
+                 GDBusInterface *interface)
+{
+  if ((gpointer) interface == (gpointer) manager)
+    return;
+
+  g_signal_connect_object (interface, "notify",
+                            G_CALLBACK (on_property_notify), manager, 0);
+}
+
+static void
+on_interface_added (GDBusObject *object,
+                    GDBusInterface *interface,
+                    gpointer user_data)
+{
+  Manager *manager = MANAGER (user_data);
+
+  watch_interface (manager, interface);
+  record_object_change (manager, object, CHANGE_OP_CHANGED);
+}
+
+static void
+on_interface_removed (GDBusObject *object,
+                      GDBusInterface *interface,
+                      gpointer user_data)
+{
+  Manager *manager = MANAGER (user_data);
+
+  g_signal_handlers_disconnect_by_data (interface, manager);
+  record_object_change (manager, object, CHANGE_OP_CHANGED);
+}
+
+static gint
+compare_object_paths (gconstpointer a,
+                      gconstpointer b,
+                      gpointer user_data)
+{
+  return strcmp (a, b);
+}
+
+/* Gets the index for objects of @object's type, -1 for singletons. */
+static gint
+get_index_type (GDBusObject *object)
+{
+  LoomObject *_object = LOOM_OBJECT (object);
+
+  if (loom_object_peek_interface (_object) != NULL)
+    return SNAPSHOT_INTERFACES;
+  if (loom_object_peek_setting (_object) != NULL)
+    return SNAPSHOT_SETTINGS;
+  if (loom_object_peek_connection (_object) != NULL)
+    return SNAPSHOT_CONNECTIONS;
+
+  return -1;
+}
+
+static void
+index_object (Manager *manager,
+              GDBusObject *object)
+{
+  gint type = get_index_type (object);
+
+  if (type < 0)
+    return;
+
+  g_sequence_insert_sorted (manager->indexes[type],
+                            g_strdup (g_dbus_object_get_object_path (object)),
+                            compare_object_paths, NULL);
+}
+
+static void
+unindex_object (Manager *manager,
+                GDBusObject *object)
+{
+  GSequenceIter *iter;
+  gint type = get_index_type (object);
+
+  if (type < 0)
+    return;
+
+  iter = g_sequence_lookup (manager->indexes[type],
+                            (gpointer) g_dbus_object_get_object_path (object),
+                            compare_object_paths, NULL);
+  if (iter != NULL)
+    g_sequence_remove (iter);
+}
+
+static void
+watch_object (Manager *manager,
+              GDBusObject *object)
+{
+  GList *interfaces;
+
+  index_object (manager, object);
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL; l = l->next)
+    watch_interface (manager, G_DBUS_INTERFACE (l->data));
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_signal_connect_object (object, "interface-added",
+                            G_CALLBACK (on_interface_added), manager, 0);
+  g_signal_connect_object (object, "interface-removed",
+                            G_CALLBACK (on_interface_removed), manager, 0);
+}
+
+static void
+unwatch_object (Manager *manager,
+                GDBusObject *object)
+{
+  GList *interfaces;
+
+  unindex_object (manager, object);
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL; l = l->next)
+    g_signal_handlers_disconnect_by_data (l->data, manager);
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_signal_handlers_disconnect_by_data (object, manager);
+}
+
+static void
+on_object_added (GDBusObjectManager *object_manager,
+                 GDBusObject *object,
+                 gpointer user_data)
+{
+  Manager *manager = MANAGER (user_data);
+
+  watch_object (manager, object);
+  record_object_change (manager, object, CHANGE_OP_ADDED);
+}
+
+static void
+on_object_removed (GDBusObjectManager *object_manager,
+                   GDBusObject *object,
+                   gpointer user_data)
+{
+  Manager *manager = MANAGER (user_data);
+
+  unwatch_object (manager, object);
+  record_object_change (manager, object, CHANGE_OP_REMOVED);
+}
+
+static void
+manager_init (Manager *manager)
+{
+  for (guint i = 0; i < N_SNAPSHOT_KINDS; i++)
+    manager->indexes[i] = g_sequence_new (g_free);
+  manager->stale = TRUE;
+}
+
+static void
+manager_finalize (GObject *object)
+{
+  Manager *manager = MANAGER (object);
+
+  snapshot_publish (&manager->snapshot, NULL);
+  journal_free (manager->journal);
+  for (guint i = 0; i < N_SNAPSHOT_KINDS; i++)
+    g_sequence_free (manager->indexes[i]);
+  subscriptions_free (manager->subscriptions);
+  waiters_free (manager->waiters);
+
+  G_OBJECT_CLASS (manager_parent_class)->finalize (object);
+}
+
+static void
+manager_set_property (GObject *object,
+                      guint prop_id,
+                      const GValue *value,
+                      GParamSpec *pspec)
+{
+  Manager *manager = MANAGER (object);
+
+  switch (prop_id)
+    {
+    case PROP_DAEMON:
+      g_assert (manager->daemon == NULL);
+      manager->daemon = g_value_get_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+manager_constructed (GObject *object)
+{
+  Manager *manager = MANAGER (object);
+  GList *objects;
+
+  manager->object_manager =
+    G_DBUS_OBJECT_MANAGER (daemon_get_object_manager (manager->daemon));
+
+  /* Start from the wall clock so sequence numbers keep increasing across
+   * daemon restarts and stale client sequences force a resync. */
+  manager->journal =
+    journal_new (daemon_config_get_integer (manager->daemon,
+                                            "Manager", "JournalSize",
+                                            JOURNAL_SIZE),
+                 g_get_real_time ());
+  manager->subscriptions =
+    subscriptions_new (daemon_get_connection (manager->daemon),
+                       "/org/blackox/Loom/Manager",
+                       "org.blackox.Loom.Manager");
+  manager->waiters = waiters_new (manager->object_manager);
+
+  objects = g_dbus_object_manager_get_objects (manager->object_manager);
+  for (GList *l = objects; l != NULL; l = l->next)
+    watch_object (manager, G_DBUS_OBJECT (l->data));
+  g_list_free_full (objects, g_object_unref);
+
+  g_signal_connect_object (manager->object_manager, "object-added",
+                            G_CALLBACK (on_object_added), manager, 0);
+  g_signal_connect_object (manager->object_manager, "object-removed",
+                            G_CALLBACK (on_object_removed), manager, 0);
+
+  if (G_OBJECT_CLASS (manager_parent_class)->constructed != NULL)
+    G_OBJECT_CLASS (manager_parent_class)->constructed (object);
+}
+
+static void
+manager_class_init (ManagerClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = manager_finalize;
+  gobject_class->constructed = manager_constructed;
+  gobject_class->set_property = manager_set_property;
+
+  /**
+   * Manager:daemon:
+   *
+   * The #Daemon for the object.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_DAEMON,
+                                   g_param_spec_object ("daemon",
+                                                        NULL,
+                                                        NULL,
+                                                        TYPE_DAEMON,
+                                                        G_PARAM_WRITABLE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * manager_new:
+ * @daemon: A #Daemon.
+ *
+ * Creates a new #Manager instance watching the objects exported by the
+ * object manager of @daemon.
+ *
+ * Returns: A new #Manager. Free with g_object_unref().
+ */
+LoomManager *
+manager_new (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return LOOM_MANAGER (g_object_new (TYPE_MANAGER,
+                                     "daemon", daemon,
+                                     NULL));
+}
+
+/**
+ * manager_get_generation:
+ * @manager: A #Manager.
+ *
+ * Gets the current state generation. The generation is incremented on every
+ * change of an exported object.
+ *
+ * Returns: The state generation.
+ */
+guint64
+manager_get_generation (Manager *manager)
+{
+  g_return_val_if_fail (IS_MANAGER (manager), 0);
+  return journal_get_sequence (manager->journal);
+}
+
+static const struct
+{
+  const gchar *interface_name;
+  const gchar *list_path;
+  const gchar *list_interface_name;
+  const gchar *active_property;
+} index_info[N_SNAPSHOT_KINDS] =
+{
+  { "org.blackox.Loom.Interface", "/org/blackox/Loom/Interfaces",
+    "org.blackox.Loom.Interfaces", "active-interfaces" },
+  { "org.blackox.Loom.Setting", "/org/blackox/Loom/Settings",
+    "org.blackox.Loom.Settings", "active-settings" },
+  { "org.blackox.Loom.Connection", "/org/blackox/Loom/Connections",
+    "org.blackox.Loom.Connections", "active-connections" },
+};
+
+static gchar **
+get_active_object_paths (Manager *manager,
+                         SnapshotKind kind)
+{
+  gs_unref_object GDBusInterface *interface = NULL;
+  gchar **active = NULL;
+
+  interface = g_dbus_object_manager_get_interface (manager->object_manager,
+                                         index_info[kind].list_path,
+                                         index_info[kind].list_interface_name);
+  if (interface != NULL)
+    g_object_get (interface, index_info[kind].active_property, &active, NULL);
+
+  return active;
+}
+
+static GVariant *
+build_objects (Manager *manager,
+               SnapshotKind kind)
+{
+  GVariantBuilder builder;
+  GSequenceIter *iter;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sv}}"));
+
+  for (iter = g_sequence_get_begin_iter (manager->indexes[kind]);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      const gchar *object_path = g_sequence_get (iter);
+      gs_unref_object GDBusInterface *interface = NULL;
+      GVariant *properties;
+
+      interface = g_dbus_object_manager_get_interface (manager->object_manager,
+                                              object_path,
+                                              index_info[kind].interface_name);
+      if (interface == NULL)
+        continue;
+
+      properties =
+        g_dbus_interface_skeleton_get_properties (G_DBUS_INTERFACE_SKELETON (interface));
+      g_variant_builder_add (&builder, "{o@a{sv}}", object_path, properties);
+      g_variant_unref (properties);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+rebuild_snapshot (Manager *manager)
+{
+  GVariant *objects[N_SNAPSHOT_KINDS];
+  gchar **active[N_SNAPSHOT_KINDS];
+
+  for (guint i = 0; i < N_SNAPSHOT_KINDS; i++)
+    {
+      objects[i] = build_objects (manager, i);
+      active[i] = get_active_object_paths (manager, i);
+    }
+
+  snapshot_publish (&manager->snapshot,
+                    snapshot_new (STATE_VERSION,
+                                  journal_get_sequence (manager->journal),
+                                  objects, active));
+
+  manager->stale = FALSE;
+}
+
+/* Gets an up to date snapshot, to be called from the main thread. */
+static Snapshot *
+get_snapshot (Manager *manager)
+{
+  if (manager->stale)
+    rebuild_snapshot (manager);
+
+  return snapshot_acquire (&manager->snapshot);
+}
+
+/**
+ * manager_acquire_snapshot:
+ * @manager: A #Manager.
+ *
+ * Gets an up to date state snapshot, building it first if objects changed
+ * since the last one. To be called from the main thread; the snapshot
+ * returned can be handed to other threads.
+ *
+ * Returns: A #Snapshot. Free with snapshot_unref().
+ */
+Snapshot *
+manager_acquire_snapshot (Manager *manager)
+{
+  g_return_val_if_fail (IS_MANAGER (manager), NULL);
+  return get_snapshot (manager);
+}
+
+static gboolean
+handle_get_state (LoomManager *object,
+                  GDBusMethodInvocation *invocation)
+{
+  Manager *manager = MANAGER (object);
+  Snapshot *snapshot;
+
+  snapshot = get_snapshot (manager);
+  g_dbus_method_invocation_return_value (invocation,
+                                         snapshot_get_state (snapshot));
+  snapshot_unref (snapshot);
+
+  return TRUE;
+}
+
+static gboolean
+handle_get_changes_since (LoomManager *object,
+                          GDBusMethodInvocation *invocation,
+                          guint64 arg_generation)
+{
+  Manager *manager = MANAGER (object);
+  GVariant *changes;
+  gboolean resync;
+
+  changes = journal_get_changes_since (manager->journal, arg_generation,
+                                       &resync);
+
+  loom_manager_complete_get_changes_since (object, invocation, resync,
+                                          journal_get_sequence (manager->journal),
+                                          changes);
+
+  return TRUE;
+}
+
+static gboolean
+handle_subscribe (LoomManager *object,
+                  GDBusMethodInvocation *invocation,
+                  GVariant *arg_filter)
+{
+  Manager *manager = MANAGER (object);
+
+  GError *error = NULL;
+  guint id;
+
+  id = subscriptions_add (manager->subscriptions,
+                          g_dbus_method_invocation_get_sender (invocation),
+                          arg_filter, &error);
+  if (id == 0)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+
+      return TRUE;
+    }
+
+  loom_manager_complete_subscribe (object, invocation, id);
+
+  return TRUE;
+}
+
+static gboolean
+handle_unsubscribe (LoomManager *object,
+                    GDBusMethodInvocation *invocation,
+                    guint arg_subscription)
+{
+  Manager *manager = MANAGER (object);
+
+  GError *error = NULL;
+
+  if (!subscriptions_remove (manager->subscriptions,
+                             g_dbus_method_invocation_get_sender (invocation),
+                             arg_subscription))
+    {
+      error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                           _("no such subscription found"));
+      g_dbus_method_invocation_take_error (invocation, error);
+
+      return TRUE;
+    }
+
+  loom_manager_complete_unsubscribe (object, invocation);
+
+  return TRUE;
+}
+
+static gboolean
+handle_wait_for (LoomManager *object,
+                 GDBusMethodInvocation *invocation,
+                 const gchar *arg_object,
+                 const gchar *arg_condition,
+                 guint arg_timeout)
+{
+  Manager *manager = MANAGER (object);
+
+  waiters_add (manager->waiters, invocation, arg_object, arg_condition,
+               arg_timeout);
+
+  return TRUE;
+}
+
+static gboolean
+handle_list (LoomManager *object,
+             GDBusMethodInvocation *invocation,
+             guint arg_kind,
+             GVariant *arg_filter,
+             const gchar *arg_cursor,
+             guint arg_limit)
+{
+  Manager *manager = MANAGER (object);
+
+  GError *error = NULL;
+  SnapshotKind kind;
+  GVariantDict dict;
+  gboolean active_only = FALSE;
+  gboolean active = FALSE;
+  const gchar *match = NULL;
+  GPatternSpec *pattern = NULL;
+  Snapshot *snapshot;
+  GVariant *objects;
+  GVariantBuilder builder;
+  const gchar *cursor = "";
+  gsize n_objects;
+  gsize i;
+  guint count = 0;
+
+  switch (arg_kind)
+    {
+    case CHANGE_KIND_LINK:
+      kind = SNAPSHOT_INTERFACES;
+      break;
+
+    case CHANGE_KIND_SETTING:
+      kind = SNAPSHOT_SETTINGS;
+      break;
+
+    case CHANGE_KIND_CONNECTION:
+      kind = SNAPSHOT_CONNECTIONS;
+      break;
+
+    default:
+      error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                           _("'kind' must be one of link, setting or "
+                             "connection"));
+      g_dbus_method_invocation_take_error (invocation, error);
+
+      return TRUE;
+    }
+
+  g_variant_dict_init (&dict, arg_filter);
+  active_only = g_variant_dict_lookup (&dict, "active", "b", &active);
+  g_variant_dict_lookup (&dict, "match", "&s", &match);
+  if (match != NULL)
+    pattern = g_pattern_spec_new (match);
+
+  if (arg_limit == 0)
+    arg_limit = PAGE_SIZE;
+  arg_limit = MIN (arg_limit, MAX_PAGE_SIZE);
+
+  snapshot = get_snapshot (manager);
+  objects = snapshot_get_objects (snapshot, kind);
+  n_objects = g_variant_n_children (objects);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sv}}"));
+  for (i = snapshot_find (snapshot, kind, arg_cursor);
+       i < n_objects && count < arg_limit; i++)
+    {
+      gs_unref_variant GVariant *entry = NULL;
+      const gchar *object_path;
+
+      entry = g_variant_get_child_value (objects, i);
+      g_variant_get_child (entry, 0, "&o", &object_path);
+
+      if (pattern != NULL && !g_pattern_match_string (pattern, object_path))
+        continue;
+      if (active_only &&
+          snapshot_is_active (snapshot, kind, object_path) != active)
+        continue;
+
+      g_variant_builder_add_value (&builder, entry);
+
+      cursor = object_path;
+      count++;
+    }
+
+  if (i == n_objects)
+    cursor = "";
+
+  loom_manager_complete_list (object, invocation,
+                              g_variant_builder_end (&builder), cursor);
+
+  snapshot_unref (snapshot);
+  g_variant_dict_clear (&dict);
+  if (pattern != NULL)
+    g_pattern_spec_free (pattern);
+
+  return TRUE;
+}
+
+static void
+manager_iface_init (LoomManagerIface *iface)
+{
+  iface->handle_get_state = handle_get_state;
+  iface->handle_get_changes_since = handle_get_changes_since;
+  iface->handle_subscribe = handle_subscribe;
+  iface->handle_unsubscribe = handle_unsubscribe;
+  iface->handle_list = handle_list;
+  iface->handle_wait_for = handle_wait_for;
+}
@@ -0,0 +1,40 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_MANAGER_H
+#define LOOM_MANAGER_H
+
+#include "types.h"
+#include "snapshot.h"
+
+G_BEGIN_DECLS
+
+#define TYPE_MANAGER  (manager_get_type ())
+#define MANAGER(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), TYPE_MANAGER, Manager))
+#define IS_MANAGER(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), TYPE_MANAGER))
+
+GType         manager_get_type (void) G_GNUC_CONST;
+LoomManager * manager_new      (Daemon *daemon);
+
+guint64    manager_get_generation   (Manager *manager);
+Snapshot * manager_acquire_snapshot (Manager *manager);
+
+G_END_DECLS
+
+#endif /* LOOM_MANAGER_H */
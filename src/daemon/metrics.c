@@ -0,0 +1,787 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+
+#include <netlink/errno.h>
+
+#include "daemon.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "nlio.h"
+
+/**
+ * SECTION: Metrics
+ * @title: Metrics
+ * @short_description: Implementation of #LoomMetrics for runtime metrics.
+ *
+ * This type provides an implementation of the #LoomMetrics interface.
+ *
+ * Every method call on an exported object is timed from its dispatch in
+ * the main context, in a handler of the handle-* signal, until its reply is
+ * handed to the connection or its invocation is released, whichever comes
+ * first, so calls completed later, e.g. Connections.Add(), are measured in
+ * full. Replies are caught by a message filter of the connection, which
+ * also tells errors from regular replies. Latencies are fed into a
+ * #Histogram per method. Property accesses are not dispatched by signals
+ * and are not timed.
+ *
+ * The accounting of netlink requests and the main loop stalls are kept by
+ * the Nlio wrappers and the #Watchdog and only reported here.
+ */
+
+#define TRACKER_KEY "loom-metrics-tracker"
+
+/* Time in micro-seconds a released call waits for its reply to be seen. */
+#define RELEASE_GRACE (10 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  gchar *interface_name;
+  gchar *method_name;
+  Histogram latency;
+  gint errors;
+} MethodStats;
+
+/* Shared with the trackers of connections, which may outlive #Metrics. The
+ * methods are fixed at creation, lookups need no lock. */
+typedef struct
+{
+  gint ref_count;
+  GHashTable *index;
+  GArray *methods;
+} MethodTable;
+
+typedef struct _Tracker Tracker;
+
+/* A call is done once its latency is recorded. It is freed when both its
+ * reply went out and its invocation was released; a call released without
+ * reply, or whose reply is not seen, is dropped after RELEASE_GRACE. */
+typedef struct
+{
+  Tracker *tracker;
+  gchar *key;
+  MethodStats *method;
+  gint64 start;
+  gboolean done;
+  gboolean replied;
+  gint64 released;
+  GList link;
+} Pending;
+
+/* Calls awaiting their reply on a connection, keyed by sender and serial:
+ * on a bus connection each client numbers its calls on its own. */
+struct _Tracker
+{
+  MethodTable *table;
+  GMutex lock;
+  GHashTable *pending;
+  GQueue released;
+};
+
+typedef struct _MetricsClass MetricsClass;
+
+/**
+ * Metrics:
+ *
+ * The #Metrics structure contains only private data and should only be
+ * accessed using the provided API.
+ */
+struct _Metrics
+{
+  LoomMetricsSkeleton parent_instance;
+  Daemon *daemon;
+  GDBusObjectManager *object_manager;
+
+  MethodTable *table;
+};
+
+struct _MetricsClass
+{
+  LoomMetricsSkeletonClass parent_class;
+};
+
+enum
+{
+  PROP_0,
+  PROP_DAEMON,
+};
+
+static void metrics_iface_init (LoomMetricsIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (Metrics, metrics,
+                         LOOM_TYPE_METRICS_SKELETON,
+                         G_IMPLEMENT_INTERFACE (LOOM_TYPE_METRICS,
+                                                metrics_iface_init));
+
+static GDBusInterfaceInfo * (*interface_infos[]) (void) =
+{
+  loom_manager_interface_info,
+  loom_interfaces_interface_info,
+  loom_interface_interface_info,
+  loom_settings_interface_info,
+  loom_setting_interface_info,
+  loom_connections_interface_info,
+  loom_connection_interface_info,
+  loom_metrics_interface_info,
+};
+
+static GType (*interface_types[]) (void) =
+{
+  loom_manager_get_type,
+  loom_interfaces_get_type,
+  loom_interface_get_type,
+  loom_settings_get_type,
+  loom_setting_get_type,
+  loom_connections_get_type,
+  loom_connection_get_type,
+  loom_metrics_get_type,
+};
+
+static void
+add_method (MethodTable *table,
+            const gchar *interface_name,
+            const gchar *method_name)
+{
+  MethodStats method = { 0, };
+
+  method.interface_name = g_strdup (interface_name);
+  method.method_name = g_strdup (method_name);
+  g_array_append_val (table->methods, method);
+}
+
+static MethodTable *
+method_table_new (void)
+{
+  MethodTable *table;
+
+  table = g_slice_new0 (MethodTable);
+  table->ref_count = 1;
+  table->methods = g_array_new (FALSE, FALSE, sizeof (MethodStats));
+
+  for (guint i = 0; i < G_N_ELEMENTS (interface_infos); i++)
+    {
+      GDBusInterfaceInfo *info = interface_infos[i] ();
+
+      for (guint j = 0; info->methods != NULL && info->methods[j] != NULL; j++)
+        add_method (table, info->name, info->methods[j]->name);
+    }
+
+  /* index after all appends, the array does not move anymore */
+  table->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (guint i = 0; i < table->methods->len; i++)
+    {
+      MethodStats *method = &g_array_index (table->methods, MethodStats, i);
+
+      g_hash_table_insert (table->index,
+                           g_strconcat (method->interface_name, ".",
+                                        method->method_name, NULL),
+                           method);
+    }
+
+  return table;
+}
+
+static MethodTable *
+method_table_ref (MethodTable *table)
+{
+  g_atomic_int_inc (&table->ref_count);
+  return table;
+}
+
+static void
+method_table_unref (MethodTable *table)
+{
+  if (!g_atomic_int_dec_and_test (&table->ref_count))
+    return;
+
+  for (guint i = 0; i < table->methods->len; i++)
+    {
+      MethodStats *method = &g_array_index (table->methods, MethodStats, i);
+
+      g_free (method->interface_name);
+      g_free (method->method_name);
+    }
+  g_array_unref (table->methods);
+  g_hash_table_unref (table->index);
+  g_slice_free (MethodTable, table);
+}
+
+static void
+pending_free (Pending *pending)
+{
+  g_free (pending->key);
+  g_slice_free (Pending, pending);
+}
+
+static gchar *
+pending_key (const gchar *sender,
+             guint32 serial)
+{
+  /* peer connections have no sender */
+  return g_strdup_printf ("%s %u", sender != NULL ? sender : "", serial);
+}
+
+static void
+tracker_free (Tracker *tracker)
+{
+  g_hash_table_unref (tracker->pending);
+  g_mutex_clear (&tracker->lock);
+  method_table_unref (tracker->table);
+  g_slice_free (Tracker, tracker);
+}
+
+/* Records the latency of @pending once. Called with the tracker lock. */
+static void
+pending_done (Pending *pending)
+{
+  if (pending->done)
+    return;
+
+  histogram_record (&pending->method->latency,
+                    g_get_monotonic_time () - pending->start);
+  pending->done = TRUE;
+}
+
+/* Drops released calls whose reply did not show up. Called with the
+ * tracker lock. */
+static void
+tracker_reap (Tracker *tracker,
+              gint64 now)
+{
+  GList *link;
+
+  while ((link = g_queue_peek_head_link (&tracker->released)) != NULL)
+    {
+      Pending *pending = link->data;
+
+      if (now - pending->released < RELEASE_GRACE)
+        break;
+
+      g_queue_unlink (&tracker->released, link);
+      g_hash_table_remove (tracker->pending, pending->key);
+    }
+}
+
+/* Takes @pending out of the table, freeing it if it was released. Called
+ * with the tracker lock. */
+static void
+tracker_take (Tracker *tracker,
+              Pending *pending)
+{
+  g_hash_table_steal (tracker->pending, pending->key);
+  if (pending->released != 0)
+    {
+      g_queue_unlink (&tracker->released, &pending->link);
+      pending_free (pending);
+    }
+  else
+    {
+      /* freed once the invocation is released */
+      pending->replied = TRUE;
+    }
+}
+
+/* Runs in the worker thread of the connection. */
+static GDBusMessage *
+on_message (GDBusConnection *connection,
+            GDBusMessage *message,
+            gboolean incoming,
+            gpointer user_data)
+{
+  Tracker *tracker = user_data;
+  GDBusMessageType type;
+  Pending *pending;
+  gs_free gchar *key = NULL;
+
+  type = g_dbus_message_get_message_type (message);
+  if (incoming || (type != G_DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+                   type != G_DBUS_MESSAGE_TYPE_ERROR))
+    return message;
+
+  key = pending_key (g_dbus_message_get_destination (message),
+                     g_dbus_message_get_reply_serial (message));
+
+  g_mutex_lock (&tracker->lock);
+  pending = g_hash_table_lookup (tracker->pending, key);
+  if (pending != NULL)
+    {
+      pending_done (pending);
+      if (type == G_DBUS_MESSAGE_TYPE_ERROR)
+        g_atomic_int_inc (&pending->method->errors);
+      tracker_take (tracker, pending);
+    }
+  g_mutex_unlock (&tracker->lock);
+
+  return message;
+}
+
+static void
+on_invocation_finalized (gpointer data,
+                         GObject *where_the_object_was)
+{
+  Pending *pending = data;
+  Tracker *tracker = pending->tracker;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&tracker->lock);
+  pending_done (pending);
+  if (pending->replied)
+    {
+      pending_free (pending);
+    }
+  else
+    {
+      /* the reply, if any, may still be on its way through the filter */
+      pending->released = now;
+      g_queue_push_tail_link (&tracker->released, &pending->link);
+    }
+  tracker_reap (tracker, now);
+  g_mutex_unlock (&tracker->lock);
+}
+
+static Tracker *
+get_tracker (Metrics *metrics,
+             GDBusConnection *connection)
+{
+  Tracker *tracker;
+
+  tracker = g_object_get_data (G_OBJECT (connection), TRACKER_KEY);
+  if (tracker == NULL)
+    {
+      tracker = g_slice_new0 (Tracker);
+      tracker->table = method_table_ref (metrics->table);
+      g_mutex_init (&tracker->lock);
+      tracker->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL,
+                                                (GDestroyNotify) pending_free);
+      g_queue_init (&tracker->released);
+
+      /* the filter goes with the connection, so does the tracker; the
+       * invocations hold the connection until they are released */
+      g_dbus_connection_add_filter (connection, on_message, tracker, NULL);
+      g_object_set_data_full (G_OBJECT (connection), TRACKER_KEY, tracker,
+                              (GDestroyNotify) tracker_free);
+    }
+
+  return tracker;
+}
+
+static void
+track_call (Metrics *metrics,
+            GDBusMethodInvocation *invocation)
+{
+  GDBusMessage *message;
+  MethodStats *method;
+  Tracker *tracker;
+  Pending *pending;
+  Pending *displaced;
+  gs_free gchar *key = NULL;
+
+  message = g_dbus_method_invocation_get_message (invocation);
+  if (g_dbus_message_get_flags (message) &
+      G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED)
+    return;
+
+  key = g_strconcat (g_dbus_method_invocation_get_interface_name (invocation),
+                     ".", g_dbus_method_invocation_get_method_name (invocation),
+                     NULL);
+  method = g_hash_table_lookup (metrics->table->index, key);
+  if (method == NULL)
+    return;
+
+  tracker = get_tracker (metrics,
+                         g_dbus_method_invocation_get_connection (invocation));
+
+  pending = g_slice_new0 (Pending);
+  pending->tracker = tracker;
+  pending->key = pending_key (g_dbus_message_get_sender (message),
+                              g_dbus_message_get_serial (message));
+  pending->method = method;
+  pending->start = g_get_monotonic_time ();
+  pending->link.data = pending;
+
+  g_mutex_lock (&tracker->lock);
+  displaced = g_hash_table_lookup (tracker->pending, pending->key);
+  if (displaced != NULL)
+    tracker_take (tracker, displaced);
+  g_hash_table_insert (tracker->pending, pending->key, pending);
+  g_mutex_unlock (&tracker->lock);
+
+  g_object_weak_ref (G_OBJECT (invocation), on_invocation_finalized, pending);
+}
+
+/* Marshals any handle-* signal, whose second argument is the invocation.
+ * The call is left to the next handler. */
+static void
+on_method_call (GClosure *closure,
+                GValue *return_value,
+                guint n_param_values,
+                const GValue *param_values,
+                gpointer invocation_hint,
+                gpointer marshal_data)
+{
+  track_call (closure->data, g_value_get_object (&param_values[1]));
+  if (return_value != NULL)
+    g_value_set_boolean (return_value, FALSE);
+}
+
+static void
+watch_interface (Metrics *metrics,
+                 GDBusInterface *interface)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (interface_types); i++)
+    {
+      GType type = interface_types[i] ();
+      guint *ids;
+      guint n_ids;
+
+      if (!G_TYPE_CHECK_INSTANCE_TYPE (interface, type))
+        continue;
+
+      ids = g_signal_list_ids (type, &n_ids);
+      for (guint j = 0; j < n_ids; j++)
+        {
+          GClosure *closure;
+
+          if (!g_str_has_prefix (g_signal_name (ids[j]), "handle-"))
+            continue;
+
+          closure = g_closure_new_simple (sizeof (GClosure), metrics);
+          g_closure_set_marshal (closure, on_method_call);
+          g_object_watch_closure (G_OBJECT (metrics), closure);
+          g_signal_connect_closure_by_id (interface, ids[j], 0, closure,
+                                          FALSE);
+        }
+      g_free (ids);
+    }
+}
+
+static void
+on_interface_added (GDBusObject *object,
+                    GDBusInterface *interface,
+                    gpointer user_data)
+{
+  watch_interface (METRICS (user_data), interface);
+}
+
+static void
+on_interface_removed (GDBusObject *object,
+                      GDBusInterface *interface,
+                      gpointer user_data)
+{
+  g_signal_handlers_disconnect_by_data (interface, user_data);
+}
+
+static void
+watch_object (Metrics *metrics,
+              GDBusObject *object)
+{
+  GList *interfaces;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL; l = l->next)
+    watch_interface (metrics, G_DBUS_INTERFACE (l->data));
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_signal_connect_object (object, "interface-added",
+                           G_CALLBACK (on_interface_added), metrics, 0);
+  g_signal_connect_object (object, "interface-removed",
+                           G_CALLBACK (on_interface_removed), metrics, 0);
+}
+
+static void
+unwatch_object (Metrics *metrics,
+                GDBusObject *object)
+{
+  GList *interfaces;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL; l = l->next)
+    g_signal_handlers_disconnect_by_data (l->data, metrics);
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_signal_handlers_disconnect_by_data (object, metrics);
+}
+
+static void
+on_object_added (GDBusObjectManager *object_manager,
+                 GDBusObject *object,
+                 gpointer user_data)
+{
+  watch_object (METRICS (user_data), object);
+}
+
+static void
+on_object_removed (GDBusObjectManager *object_manager,
+                   GDBusObject *object,
+                   gpointer user_data)
+{
+  unwatch_object (METRICS (user_data), object);
+}
+
+static void
+metrics_init (Metrics *metrics)
+{
+}
+
+static void
+metrics_finalize (GObject *object)
+{
+  Metrics *metrics = METRICS (object);
+
+  method_table_unref (metrics->table);
+
+  G_OBJECT_CLASS (metrics_parent_class)->finalize (object);
+}
+
+static void
+metrics_set_property (GObject *object,
+                      guint prop_id,
+                      const GValue *value,
+                      GParamSpec *pspec)
+{
+  Metrics *metrics = METRICS (object);
+
+  switch (prop_id)
+    {
+    case PROP_DAEMON:
+      g_assert (metrics->daemon == NULL);
+      metrics->daemon = g_value_get_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+metrics_constructed (GObject *object)
+{
+  Metrics *metrics = METRICS (object);
+  GList *objects;
+
+  metrics->object_manager =
+    G_DBUS_OBJECT_MANAGER (daemon_get_object_manager (metrics->daemon));
+  metrics->table = method_table_new ();
+
+  objects = g_dbus_object_manager_get_objects (metrics->object_manager);
+  for (GList *l = objects; l != NULL; l = l->next)
+    watch_object (metrics, G_DBUS_OBJECT (l->data));
+  g_list_free_full (objects, g_object_unref);
+
+  g_signal_connect_object (metrics->object_manager, "object-added",
+                           G_CALLBACK (on_object_added), metrics, 0);
+  g_signal_connect_object (metrics->object_manager, "object-removed",
+                           G_CALLBACK (on_object_removed), metrics, 0);
+
+  if (G_OBJECT_CLASS (metrics_parent_class)->constructed != NULL)
+    G_OBJECT_CLASS (metrics_parent_class)->constructed (object);
+}
+
+static void
+metrics_class_init (MetricsClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = metrics_finalize;
+  gobject_class->constructed = metrics_constructed;
+  gobject_class->set_property = metrics_set_property;
+
+  /**
+   * Metrics:daemon:
+   *
+   * The #Daemon for the object.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_DAEMON,
+                                   g_param_spec_object ("daemon",
+                                                        NULL,
+                                                        NULL,
+                                                        TYPE_DAEMON,
+                                                        G_PARAM_WRITABLE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * metrics_new:
+ * @daemon: A #Daemon.
+ *
+ * Creates a new #Metrics instance timing the method calls on the objects
+ * exported by the object manager of @daemon.
+ *
+ * Returns: A new #Metrics. Free with g_object_unref().
+ */
+LoomMetrics *
+metrics_new (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  return LOOM_METRICS (g_object_new (TYPE_METRICS,
+                                     "daemon", daemon,
+                                     NULL));
+}
+
+/**
+ * metrics_foreach_method:
+ * @metrics: A #Metrics.
+ * @func: The function to call.
+ * @user_data: Data to pass to @func.
+ *
+ * Calls @func for each method timed, whether it was called or not.
+ */
+void
+metrics_foreach_method (Metrics *metrics,
+                        MetricsMethodFunc func,
+                        gpointer user_data)
+{
+  g_return_if_fail (IS_METRICS (metrics));
+
+  for (guint i = 0; i < metrics->table->methods->len; i++)
+    {
+      MethodStats *method = &g_array_index (metrics->table->methods,
+                                            MethodStats, i);
+
+      func (method->interface_name, method->method_name, &method->latency,
+            g_atomic_int_get (&method->errors), user_data);
+    }
+}
+
+static gboolean
+handle_get_latencies (LoomMetrics *object,
+                      GDBusMethodInvocation *invocation)
+{
+  Metrics *metrics = METRICS (object);
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssuuuuuu)"));
+  for (guint i = 0; i < metrics->table->methods->len; i++)
+    {
+      MethodStats *method = &g_array_index (metrics->table->methods,
+                                            MethodStats, i);
+      guint count, p50, p90, p99, max;
+
+      histogram_summarize (&method->latency, &count, &p50, &p90, &p99, &max);
+      if (count == 0)
+        continue;
+
+      g_variant_builder_add (&builder, "(ssuuuuuu)",
+                             method->interface_name, method->method_name,
+                             count, g_atomic_int_get (&method->errors),
+                             p50, p90, p99, max);
+    }
+
+  loom_metrics_complete_get_latencies (object, invocation,
+                                       g_variant_builder_end (&builder));
+
+  return TRUE;
+}
+
+static gboolean
+handle_get_netlink_stats (LoomMetrics *object,
+                          GDBusMethodInvocation *invocation)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(stttttuuuua{su})"));
+  for (NlioOperation operation = 0; operation < N_NLIO_OPERATIONS; operation++)
+    {
+      NlioStats stats;
+      GVariantBuilder errors;
+
+      nlio_get_stats (operation, &stats);
+      if (stats.calls == 0)
+        continue;
+
+      g_variant_builder_init (&errors, G_VARIANT_TYPE ("a{su}"));
+      for (guint i = 1; i < NLIO_N_ERRORS; i++)
+        {
+          if (stats.errors[i] > 0)
+            g_variant_builder_add (&errors, "{su}", nl_geterror (i),
+                                   (guint32) MIN (stats.errors[i], G_MAXUINT32));
+        }
+
+      g_variant_builder_add (&builder, "(stttttuuuua{su})",
+                             nlio_operation_to_string (operation),
+                             stats.calls,
+                             stats.messages_sent, stats.messages_received,
+                             stats.bytes_sent, stats.bytes_received,
+                             stats.p50, stats.p90, stats.p99, stats.max,
+                             &errors);
+    }
+
+  loom_metrics_complete_get_netlink_stats (object, invocation,
+                                           g_variant_builder_end (&builder));
+
+  return TRUE;
+}
+
+static gboolean
+handle_get_stalls (LoomMetrics *object,
+                   GDBusMethodInvocation *invocation)
+{
+  Metrics *metrics = METRICS (object);
+  Watchdog *watchdog;
+
+  watchdog = daemon_get_watchdog (metrics->daemon);
+  loom_metrics_complete_get_stalls (object, invocation,
+                                    watchdog_get_counters (watchdog),
+                                    watchdog_get_stalls (watchdog));
+
+  return TRUE;
+}
+
+static gboolean
+handle_reset (LoomMetrics *object,
+              GDBusMethodInvocation *invocation)
+{
+  Metrics *metrics = METRICS (object);
+
+  for (guint i = 0; i < metrics->table->methods->len; i++)
+    {
+      MethodStats *method = &g_array_index (metrics->table->methods,
+                                            MethodStats, i);
+
+      histogram_reset (&method->latency);
+      g_atomic_int_set (&method->errors, 0);
+    }
+  nlio_reset ();
+  watchdog_reset (daemon_get_watchdog (metrics->daemon));
+
+  loom_metrics_complete_reset (object, invocation);
+
+  return TRUE;
+}
+
+static void
+metrics_iface_init (LoomMetricsIface *iface)
+{
+  iface->handle_get_latencies = handle_get_latencies;
+  iface->handle_get_netlink_stats = handle_get_netlink_stats;
+  iface->handle_get_stalls = handle_get_stalls;
+  iface->handle_reset = handle_reset;
+}
@@ -0,0 +1,57 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_METRICS_H
+#define LOOM_METRICS_H
+
+#include "types.h"
+#include "histogram.h"
+
+G_BEGIN_DECLS
+
+#define TYPE_METRICS  (metrics_get_type ())
+#define METRICS(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), TYPE_METRICS, Metrics))
+#define IS_METRICS(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), TYPE_METRICS))
+
+/**
+ * MetricsMethodFunc:
+ * @interface_name: The D-Bus interface of the method.
+ * @method_name: The name of the method.
+ * @latency: The latency histogram of the method.
+ * @errors: The number of calls replied with an error.
+ * @user_data: Data passed to metrics_foreach_method().
+ *
+ * Called for each method timed by #Metrics.
+ */
+typedef void (*MetricsMethodFunc) (const gchar *interface_name,
+                                   const gchar *method_name,
+                                   Histogram *latency,
+                                   guint errors,
+                                   gpointer user_data);
+
+GType         metrics_get_type (void) G_GNUC_CONST;
+LoomMetrics * metrics_new      (Daemon *daemon);
+
+void metrics_foreach_method (Metrics *metrics,
+                             MetricsMethodFunc func,
+                             gpointer user_data);
+
+G_END_DECLS
+
+#endif /* LOOM_METRICS_H */
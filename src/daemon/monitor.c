@@ -0,0 +1,541 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <glib/gi18n.h>
+#include <glib-unix.h>
+
+#include <netlink/netlink.h>
+#include <netlink/socket.h>
+#include <netlink/msg.h>
+#include <netlink/cache.h>
+#include <netlink/route/rtnl.h>
+#include <netlink/route/link.h>
+#include <netlink/route/addr.h>
+
+#include "monitor.h"
+#include "nlio.h"
+
+/**
+ * SECTION: Monitor
+ * @title: Monitor
+ * @short_description: Kernel link event monitor.
+ *
+ * Subscribes to the rtnetlink link and IPv4 address multicast groups and
+ * reports link and address events as they arrive instead of waiting for
+ * the next poll.
+ *
+ * The multicast sockets, one per group, are drained by a dedicated thread
+ * running its own main context, so a burst of events is read off the
+ * sockets even while the main thread is busy with method calls. Decoded
+ * events are pushed onto a lock-free queue; the main thread is woken up
+ * through an eventfd once per batch and dispatches the events at high
+ * priority, ahead of D-Bus method calls.
+ *
+ * Should a socket overrun nevertheless, the kernel reports ENOBUFS once
+ * and the events dropped are lost. The receive buffer of the socket is
+ * grown then and its object family, links or addresses, is dumped; the
+ * dump is passed on in place of the lost events so the state can be
+ * resynchronised without polling.
+ */
+
+/* Initial and maximum receive buffer sizes of the multicast sockets. */
+#define RCVBUF_SIZE     (256 * 1024)
+#define RCVBUF_MAX_SIZE (16 * 1024 * 1024)
+
+typedef enum
+{
+  EVENT_LINK,
+  EVENT_ADDRESS,
+  EVENT_RESYNC,
+} EventType;
+
+typedef struct _Event Event;
+
+struct _Event
+{
+  Event *next;
+  EventType type;
+  gboolean removed;
+  struct nl_object *object;
+  struct nl_cache *cache;
+  gboolean links;
+};
+
+typedef struct
+{
+  Monitor *monitor;
+  struct nl_sock *sock;
+  struct nl_sock *dump_sock;
+  GSource *source;
+  gint msg_type;
+  gint rcvbuf_size;
+
+  /* events decoded in the current drain, newest first */
+  Event *head;
+  Event *tail;
+} Listener;
+
+struct _Monitor
+{
+  Listener links;
+  Listener addresses;
+
+  GMainContext *worker_context;
+  GThread *thread;
+  gint quit;
+
+  /* Multiple-producer single-consumer stack: producers push a chain of
+   * events with compare-and-swap, the consumer takes all events at once,
+   * which leaves no room for ABA problems. Newest events are on top. */
+  Event *queue;
+  gint event_fd;
+  GSource *event_source;
+
+  MonitorLinkFunc link_func;
+  MonitorAddressFunc address_func;
+  MonitorResyncFunc resync_func;
+  gpointer user_data;
+};
+
+static void
+event_free (Event *event)
+{
+  if (event->object != NULL)
+    nl_object_put (event->object);
+  if (event->cache != NULL)
+    nl_cache_free (event->cache);
+  g_slice_free (Event, event);
+}
+
+static void
+listener_append (Listener *listener,
+                 Event *event)
+{
+  event->next = listener->head;
+  listener->head = event;
+  if (listener->tail == NULL)
+    listener->tail = event;
+}
+
+static void
+on_object (struct nl_object *object,
+           void *arg)
+{
+  Listener *listener = arg;
+  Event *event;
+
+  event = g_slice_new0 (Event);
+  event->type = listener == &listener->monitor->links ? EVENT_LINK
+                                                      : EVENT_ADDRESS;
+  event->removed = listener->msg_type == RTM_DELLINK ||
+                   listener->msg_type == RTM_DELADDR;
+
+  /* nl_msg_parse() drops its own reference only after this returns, so
+   * the event is handed over once the drain is complete */
+  nl_object_get (object);
+  event->object = object;
+
+  listener_append (listener, event);
+}
+
+static int
+on_valid (struct nl_msg *msg,
+          void *arg)
+{
+  Listener *listener = arg;
+  struct nlmsghdr *hdr = nlmsg_hdr (msg);
+
+  switch (hdr->nlmsg_type)
+    {
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+      break;
+
+    default:
+      return NL_OK;
+    }
+
+  listener->msg_type = hdr->nlmsg_type;
+  nl_msg_parse (msg, on_object, listener);
+
+  return NL_OK;
+}
+
+static void
+push_events (Monitor *monitor,
+             Event *head,
+             Event *tail)
+{
+  Event *top;
+  guint64 one = 1;
+
+  do
+    {
+      top = g_atomic_pointer_get (&monitor->queue);
+      tail->next = top;
+    }
+  while (!g_atomic_pointer_compare_and_exchange (&monitor->queue, top, head));
+
+  /* the consumer takes all events per wakeup, a non-empty queue means a
+   * wakeup is pending already */
+  if (top == NULL && write (monitor->event_fd, &one, sizeof one) < 0)
+    g_warning (_("Failed to signal kernel events: %s"), g_strerror (errno));
+}
+
+static void
+set_receive_buffer (Listener *listener,
+                    gint size)
+{
+  gint fd = nl_socket_get_fd (listener->sock);
+  socklen_t len = sizeof size;
+
+  /* SO_RCVBUFFORCE may exceed net.core.rmem_max but requires
+   * CAP_NET_ADMIN, SO_RCVBUF is capped */
+  if (setsockopt (fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof size) < 0 &&
+      setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size) < 0)
+    g_warning (_("Failed to set receive buffer size: %s"), g_strerror (errno));
+
+  /* the kernel doubles the value set */
+  if (getsockopt (fd, SOL_SOCKET, SO_RCVBUF, &listener->rcvbuf_size, &len) < 0)
+    listener->rcvbuf_size = size;
+  else
+    listener->rcvbuf_size /= 2;
+}
+
+/* Runs in the worker thread. */
+static void
+handle_overrun (Listener *listener)
+{
+  struct nl_cache *cache = NULL;
+  Event *event;
+  gint err;
+
+  if (listener->rcvbuf_size < RCVBUF_MAX_SIZE)
+    set_receive_buffer (listener, MIN (listener->rcvbuf_size * 2,
+                                       RCVBUF_MAX_SIZE));
+
+  g_message (_("Kernel events lost, resynchronising %s "
+               "(receive buffer %d bytes)."),
+             listener == &listener->monitor->links ? "links" : "addresses",
+             listener->rcvbuf_size);
+
+  if (listener->dump_sock == NULL)
+    listener->dump_sock = nlio_socket_new ();
+
+  if (listener == &listener->monitor->links)
+    err = nlio_link_alloc_cache (listener->dump_sock, &cache);
+  else
+    err = nlio_addr_alloc_cache (listener->dump_sock, &cache);
+  if (err != 0)
+    {
+      g_warning (_("Failed to resynchronise with kernel: %s"),
+                 nl_geterror (err));
+      return;
+    }
+
+  event = g_slice_new0 (Event);
+  event->type = EVENT_RESYNC;
+  event->links = listener == &listener->monitor->links;
+  event->cache = cache;
+  listener_append (listener, event);
+}
+
+/* Runs in the worker thread. */
+static gboolean
+on_readable (gint fd,
+             GIOCondition condition,
+             gpointer user_data)
+{
+  Listener *listener = user_data;
+  gint err;
+
+  for (;;)
+    {
+      err = nl_recvmsgs_default (listener->sock);
+      if (err >= 0)
+        continue;
+
+      /* ENOBUFS */
+      if (err == -NLE_NOMEM)
+        {
+          handle_overrun (listener);
+          continue;
+        }
+
+      break;
+    }
+
+  if (err != -NLE_AGAIN)
+    g_warning (_("Error receiving kernel events: %s"), nl_geterror (err));
+
+  if (listener->head != NULL)
+    {
+      push_events (listener->monitor, listener->head, listener->tail);
+      listener->head = NULL;
+      listener->tail = NULL;
+    }
+
+  return TRUE;
+}
+
+static gpointer
+worker (gpointer user_data)
+{
+  Monitor *monitor = user_data;
+
+  g_main_context_push_thread_default (monitor->worker_context);
+  while (!g_atomic_int_get (&monitor->quit))
+    g_main_context_iteration (monitor->worker_context, TRUE);
+  g_main_context_pop_thread_default (monitor->worker_context);
+
+  return NULL;
+}
+
+static Event *
+take_events (Monitor *monitor)
+{
+  Event *top;
+  Event *events = NULL;
+
+  do
+    top = g_atomic_pointer_get (&monitor->queue);
+  while (!g_atomic_pointer_compare_and_exchange (&monitor->queue, top, NULL));
+
+  /* oldest first */
+  while (top != NULL)
+    {
+      Event *next = top->next;
+
+      top->next = events;
+      events = top;
+      top = next;
+    }
+
+  return events;
+}
+
+/* Runs in the main thread. */
+static gboolean
+on_events (gint fd,
+           GIOCondition condition,
+           gpointer user_data)
+{
+  Monitor *monitor = user_data;
+  Event *event;
+  guint64 count;
+
+  if (read (fd, &count, sizeof count) < 0 && errno != EAGAIN)
+    g_warning (_("Failed to read kernel event wakeup: %s"),
+               g_strerror (errno));
+
+  event = take_events (monitor);
+  while (event != NULL)
+    {
+      Event *next = event->next;
+
+      switch (event->type)
+        {
+        case EVENT_LINK:
+          monitor->link_func (event->removed,
+                              (struct rtnl_link *) event->object,
+                              monitor->user_data);
+          break;
+
+        case EVENT_ADDRESS:
+          monitor->address_func (event->removed,
+                                 (struct rtnl_addr *) event->object,
+                                 monitor->user_data);
+          break;
+
+        case EVENT_RESYNC:
+          monitor->resync_func (event->links, event->cache,
+                                monitor->user_data);
+          break;
+        }
+      event_free (event);
+
+      event = next;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+listener_init (Listener *listener,
+               Monitor *monitor,
+               gint group)
+{
+  gint err;
+
+  listener->monitor = monitor;
+  listener->sock = nl_socket_alloc ();
+  nl_socket_disable_seq_check (listener->sock);
+  nl_socket_modify_cb (listener->sock, NL_CB_VALID, NL_CB_CUSTOM,
+                       on_valid, listener);
+
+  err = nl_connect (listener->sock, NETLINK_ROUTE);
+  if (err == 0)
+    err = nl_socket_add_memberships (listener->sock, group, 0);
+  if (err == 0)
+    err = nl_socket_set_nonblocking (listener->sock);
+  if (err != 0)
+    {
+      g_warning (_("Failed to subscribe to kernel events: %s"),
+                 nl_geterror (err));
+      return FALSE;
+    }
+
+  set_receive_buffer (listener, RCVBUF_SIZE);
+
+  listener->source = g_unix_fd_source_new (nl_socket_get_fd (listener->sock),
+                                           G_IO_IN);
+  g_source_set_callback (listener->source, (GSourceFunc) on_readable,
+                         listener, NULL);
+  g_source_attach (listener->source, monitor->worker_context);
+
+  return TRUE;
+}
+
+static void
+listener_clear (Listener *listener)
+{
+  if (listener->source != NULL)
+    {
+      g_source_destroy (listener->source);
+      g_source_unref (listener->source);
+    }
+  if (listener->sock != NULL)
+    nl_socket_free (listener->sock);
+  if (listener->dump_sock != NULL)
+    nl_socket_free (listener->dump_sock);
+}
+
+/**
+ * monitor_new:
+ * @link_func: Function called for each link event.
+ * @address_func: Function called for each address event.
+ * @resync_func: Function called with a dump after events were lost.
+ * @user_data: Data to pass to the functions.
+ *
+ * Creates a new #Monitor watching link and address events. The events are
+ * received in a thread of the monitor, the functions are called in the
+ * thread-default main context of the caller.
+ *
+ * Returns: A new #Monitor or %NULL if subscribing failed. Free with
+ * monitor_free().
+ */
+Monitor *
+monitor_new (MonitorLinkFunc link_func,
+             MonitorAddressFunc address_func,
+             MonitorResyncFunc resync_func,
+             gpointer user_data)
+{
+  g_return_val_if_fail (link_func != NULL, NULL);
+  g_return_val_if_fail (address_func != NULL, NULL);
+  g_return_val_if_fail (resync_func != NULL, NULL);
+
+  Monitor *monitor;
+  GMainContext *context;
+
+  monitor = g_slice_new0 (Monitor);
+  monitor->link_func = link_func;
+  monitor->address_func = address_func;
+  monitor->resync_func = resync_func;
+  monitor->user_data = user_data;
+  monitor->worker_context = g_main_context_new ();
+
+  monitor->event_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (monitor->event_fd < 0)
+    {
+      g_warning (_("Failed to create eventfd: %s"), g_strerror (errno));
+      monitor_free (monitor);
+      return NULL;
+    }
+
+  if (!listener_init (&monitor->links, monitor, RTNLGRP_LINK) ||
+      !listener_init (&monitor->addresses, monitor, RTNLGRP_IPV4_IFADDR))
+    {
+      monitor_free (monitor);
+      return NULL;
+    }
+
+  context = g_main_context_ref_thread_default ();
+  monitor->event_source = g_unix_fd_source_new (monitor->event_fd, G_IO_IN);
+  g_source_set_name (monitor->event_source, "loom-monitor-events");
+  g_source_set_priority (monitor->event_source, G_PRIORITY_HIGH);
+  g_source_set_callback (monitor->event_source, (GSourceFunc) on_events,
+                         monitor, NULL);
+  g_source_attach (monitor->event_source, context);
+  g_main_context_unref (context);
+
+  monitor->thread = g_thread_new ("monitor", worker, monitor);
+
+  return monitor;
+}
+
+/**
+ * monitor_free:
+ * @monitor: A #Monitor.
+ *
+ * Stops watching and frees @monitor. Events not dispatched yet are
+ * dropped.
+ */
+void
+monitor_free (Monitor *monitor)
+{
+  if (monitor == NULL)
+    return;
+
+  if (monitor->thread != NULL)
+    {
+      g_atomic_int_set (&monitor->quit, TRUE);
+      g_main_context_wakeup (monitor->worker_context);
+      g_thread_join (monitor->thread);
+    }
+
+  listener_clear (&monitor->links);
+  listener_clear (&monitor->addresses);
+  g_main_context_unref (monitor->worker_context);
+
+  if (monitor->event_source != NULL)
+    {
+      g_source_destroy (monitor->event_source);
+      g_source_unref (monitor->event_source);
+    }
+  if (monitor->event_fd >= 0)
+    close (monitor->event_fd);
+
+  for (Event *event = take_events (monitor), *next; event != NULL;
+       event = next)
+    {
+      next = event->next;
+      event_free (event);
+    }
+
+  g_slice_free (Monitor, monitor);
+}
@@ -0,0 +1,78 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_MONITOR_H
+#define LOOM_MONITOR_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+struct rtnl_link;
+struct rtnl_addr;
+struct nl_cache;
+
+typedef struct _Monitor Monitor;
+
+/**
+ * MonitorLinkFunc:
+ * @removed: %TRUE if the link was removed.
+ * @link: The rtnl link object of the event.
+ * @user_data: Data passed to monitor_new().
+ *
+ * Called for each link event received from the kernel.
+ */
+typedef void (*MonitorLinkFunc) (gboolean removed,
+                                 struct rtnl_link *link,
+                                 gpointer user_data);
+
+/**
+ * MonitorAddressFunc:
+ * @removed: %TRUE if the address was removed.
+ * @addr: The rtnl address object of the event.
+ * @user_data: Data passed to monitor_new().
+ *
+ * Called for each IPv4 address event received from the kernel.
+ */
+typedef void (*MonitorAddressFunc) (gboolean removed,
+                                    struct rtnl_addr *addr,
+                                    gpointer user_data);
+
+/**
+ * MonitorResyncFunc:
+ * @links: %TRUE if link events were lost, %FALSE for address events.
+ * @cache: A fresh dump of all links or of all addresses.
+ * @user_data: Data passed to monitor_new().
+ *
+ * Called after events were lost because the receive buffer of a socket
+ * overran. @cache replaces all events lost.
+ */
+typedef void (*MonitorResyncFunc) (gboolean links,
+                                   struct nl_cache *cache,
+                                   gpointer user_data);
+
+Monitor * monitor_new  (MonitorLinkFunc link_func,
+                        MonitorAddressFunc address_func,
+                        MonitorResyncFunc resync_func,
+                        gpointer user_data);
+void      monitor_free (Monitor *monitor);
+
+G_END_DECLS
+
+#endif /* LOOM_MONITOR_H */
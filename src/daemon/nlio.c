@@ -0,0 +1,399 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <netlink/netlink.h>
+#include <netlink/socket.h>
+#include <netlink/msg.h>
+#include <netlink/route/link.h>
+#include <netlink/route/addr.h>
+#include <netlink/route/route.h>
+
+#include "histogram.h"
+#include "nlio.h"
+#include "probes.h"
+
+/**
+ * SECTION: Nlio
+ * @title: Nlio
+ * @short_description: Netlink I/O accounting.
+ *
+ * Wrappers of the rtnl requests of the daemon accounting calls, netlink
+ * messages and bytes sent and received, round trip times and libnl error
+ * codes per operation.
+ *
+ * Messages are counted by callbacks of sockets created with
+ * nlio_socket_new(); the operation they belong to is the one in progress in
+ * the calling thread.
+ */
+
+typedef struct
+{
+  guint64 calls;
+  guint64 messages_sent;
+  guint64 messages_received;
+  guint64 bytes_sent;
+  guint64 bytes_received;
+  Histogram latency;
+  guint64 errors[NLIO_N_ERRORS];
+} Account;
+
+typedef struct
+{
+  NlioOperation operation;
+  gint64 start;
+  guint messages_sent;
+  guint messages_received;
+  gsize bytes_sent;
+  gsize bytes_received;
+} Call;
+
+static const gchar * const operation_names[N_NLIO_OPERATIONS] =
+{
+  "connect",
+  "link-get",
+  "link-dump",
+  "link-change",
+  "address-dump",
+  "address-add",
+  "address-delete",
+  "route-add",
+  "route-delete",
+};
+
+static GMutex lock;
+static Account accounts[N_NLIO_OPERATIONS];
+
+static GPrivate current_call = G_PRIVATE_INIT (NULL);
+
+static void
+call_begin (Call *call,
+            NlioOperation operation)
+{
+  memset (call, 0, sizeof (Call));
+  call->operation = operation;
+  call->start = g_get_monotonic_time ();
+  g_private_set (&current_call, call);
+}
+
+static gint
+call_end (Call *call,
+          gint err)
+{
+  Account *account = &accounts[call->operation];
+  gint64 duration;
+
+  g_private_set (&current_call, NULL);
+
+  duration = g_get_monotonic_time () - call->start;
+  LOOM_PROBE5 (netlink, operation_names[call->operation], err, duration,
+               call->bytes_sent, call->bytes_received);
+
+  g_mutex_lock (&lock);
+  account->calls++;
+  account->messages_sent += call->messages_sent;
+  account->messages_received += call->messages_received;
+  account->bytes_sent += call->bytes_sent;
+  account->bytes_received += call->bytes_received;
+  histogram_record (&account->latency, duration);
+  if (err < 0)
+    account->errors[MIN (-err, NLE_MAX)]++;
+  g_mutex_unlock (&lock);
+
+  return err;
+}
+
+static gint
+on_message_out (struct nl_msg *msg,
+                gpointer user_data)
+{
+  Call *call = g_private_get (&current_call);
+
+  if (call != NULL)
+    {
+      call->messages_sent++;
+      call->bytes_sent += nlmsg_hdr (msg)->nlmsg_len;
+    }
+
+  return NL_OK;
+}
+
+static gint
+on_message_in (struct nl_msg *msg,
+               gpointer user_data)
+{
+  Call *call = g_private_get (&current_call);
+
+  if (call != NULL)
+    {
+      call->messages_received++;
+      call->bytes_received += nlmsg_hdr (msg)->nlmsg_len;
+    }
+
+  return NL_OK;
+}
+
+/**
+ * nlio_socket_new:
+ *
+ * Creates a netlink route socket with accounting of the messages passing
+ * it and connects it.
+ *
+ * Returns: A new socket. Free with nl_socket_free().
+ */
+struct nl_sock *
+nlio_socket_new (void)
+{
+  struct nl_sock *sock;
+  Call call;
+
+  sock = nl_socket_alloc ();
+  nl_socket_modify_cb (sock, NL_CB_MSG_OUT, NL_CB_CUSTOM,
+                       on_message_out, NULL);
+  nl_socket_modify_cb (sock, NL_CB_MSG_IN, NL_CB_CUSTOM,
+                       on_message_in, NULL);
+
+  call_begin (&call, NLIO_CONNECT);
+  call_end (&call, nl_connect (sock, NETLINK_ROUTE));
+
+  return sock;
+}
+
+/**
+ * nlio_link_get_kernel:
+ * @sock: A socket created with nlio_socket_new().
+ * @name: The name of the link.
+ * @result: Return location for the link.
+ *
+ * Accounted rtnl_link_get_kernel().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_link_get_kernel (struct nl_sock *sock,
+                      const gchar *name,
+                      struct rtnl_link **result)
+{
+  Call call;
+
+  call_begin (&call, NLIO_LINK_GET);
+  return call_end (&call, rtnl_link_get_kernel (sock, 0, name, result));
+}
+
+/**
+ * nlio_link_alloc_cache:
+ * @sock: A socket created with nlio_socket_new().
+ * @result: Return location for the cache.
+ *
+ * Accounted rtnl_link_alloc_cache() of all address families.
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_link_alloc_cache (struct nl_sock *sock,
+                       struct nl_cache **result)
+{
+  Call call;
+
+  call_begin (&call, NLIO_LINK_DUMP);
+  return call_end (&call, rtnl_link_alloc_cache (sock, AF_UNSPEC, result));
+}
+
+/**
+ * nlio_link_change:
+ * @sock: A socket created with nlio_socket_new().
+ * @orig: The link to change.
+ * @changes: The changes.
+ *
+ * Accounted rtnl_link_change().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_link_change (struct nl_sock *sock,
+                  struct rtnl_link *orig,
+                  struct rtnl_link *changes)
+{
+  Call call;
+
+  call_begin (&call, NLIO_LINK_CHANGE);
+  return call_end (&call, rtnl_link_change (sock, orig, changes, 0));
+}
+
+/**
+ * nlio_addr_alloc_cache:
+ * @sock: A socket created with nlio_socket_new().
+ * @result: Return location for the cache.
+ *
+ * Accounted rtnl_addr_alloc_cache().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_addr_alloc_cache (struct nl_sock *sock,
+                       struct nl_cache **result)
+{
+  Call call;
+
+  call_begin (&call, NLIO_ADDRESS_DUMP);
+  return call_end (&call, rtnl_addr_alloc_cache (sock, result));
+}
+
+/**
+ * nlio_addr_add:
+ * @sock: A socket created with nlio_socket_new().
+ * @addr: The address to add.
+ * @flags: Additional netlink message flags.
+ *
+ * Accounted rtnl_addr_add().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_addr_add (struct nl_sock *sock,
+               struct rtnl_addr *addr,
+               gint flags)
+{
+  Call call;
+
+  call_begin (&call, NLIO_ADDRESS_ADD);
+  return call_end (&call, rtnl_addr_add (sock, addr, flags));
+}
+
+/**
+ * nlio_addr_delete:
+ * @sock: A socket created with nlio_socket_new().
+ * @addr: The address to delete.
+ * @flags: Additional netlink message flags.
+ *
+ * Accounted rtnl_addr_delete().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_addr_delete (struct nl_sock *sock,
+                  struct rtnl_addr *addr,
+                  gint flags)
+{
+  Call call;
+
+  call_begin (&call, NLIO_ADDRESS_DELETE);
+  return call_end (&call, rtnl_addr_delete (sock, addr, flags));
+}
+
+/**
+ * nlio_route_add:
+ * @sock: A socket created with nlio_socket_new().
+ * @route: The route to add.
+ * @flags: Additional netlink message flags.
+ *
+ * Accounted rtnl_route_add().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_route_add (struct nl_sock *sock,
+                struct rtnl_route *route,
+                gint flags)
+{
+  Call call;
+
+  call_begin (&call, NLIO_ROUTE_ADD);
+  return call_end (&call, rtnl_route_add (sock, route, flags));
+}
+
+/**
+ * nlio_route_delete:
+ * @sock: A socket created with nlio_socket_new().
+ * @route: The route to delete.
+ * @flags: Additional netlink message flags.
+ *
+ * Accounted rtnl_route_delete().
+ *
+ * Returns: 0 on success or a negative libnl error code.
+ */
+gint
+nlio_route_delete (struct nl_sock *sock,
+                   struct rtnl_route *route,
+                   gint flags)
+{
+  Call call;
+
+  call_begin (&call, NLIO_ROUTE_DELETE);
+  return call_end (&call, rtnl_route_delete (sock, route, flags));
+}
+
+/**
+ * nlio_operation_to_string:
+ * @operation: A #NlioOperation.
+ *
+ * Returns: The name of @operation, e.g. "address-add".
+ */
+const gchar *
+nlio_operation_to_string (NlioOperation operation)
+{
+  g_return_val_if_fail (operation < N_NLIO_OPERATIONS, NULL);
+  return operation_names[operation];
+}
+
+/**
+ * nlio_get_stats:
+ * @operation: A #NlioOperation.
+ * @stats: Return location for the accounting of @operation.
+ *
+ * Gets the accounting of @operation since the start or the last
+ * nlio_reset().
+ */
+void
+nlio_get_stats (NlioOperation operation,
+                NlioStats *stats)
+{
+  g_return_if_fail (operation < N_NLIO_OPERATIONS);
+
+  Account *account = &accounts[operation];
+  guint count;
+
+  g_mutex_lock (&lock);
+  stats->calls = account->calls;
+  stats->messages_sent = account->messages_sent;
+  stats->messages_received = account->messages_received;
+  stats->bytes_sent = account->bytes_sent;
+  stats->bytes_received = account->bytes_received;
+  histogram_summarize (&account->latency, &count,
+                       &stats->p50, &stats->p90, &stats->p99, &stats->max);
+  stats->sum = histogram_get_sum (&account->latency);
+  memcpy (stats->errors, account->errors, sizeof (stats->errors));
+  g_mutex_unlock (&lock);
+}
+
+/**
+ * nlio_reset:
+ *
+ * Clears the accounting of all operations.
+ */
+void
+nlio_reset (void)
+{
+  g_mutex_lock (&lock);
+  memset (accounts, 0, sizeof (accounts));
+  g_mutex_unlock (&lock);
+}
@@ -0,0 +1,129 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_NLIO_H
+#define LOOM_NLIO_H
+
+#include "types.h"
+
+#include <netlink/errno.h>
+
+G_BEGIN_DECLS
+
+struct nl_sock;
+struct nl_cache;
+struct rtnl_link;
+struct rtnl_addr;
+struct rtnl_route;
+
+/**
+ * NlioOperation:
+ * @NLIO_CONNECT: Connecting a netlink socket.
+ * @NLIO_LINK_GET: Getting a single link.
+ * @NLIO_LINK_DUMP: Dumping all links.
+ * @NLIO_LINK_CHANGE: Changing link flags.
+ * @NLIO_ADDRESS_DUMP: Dumping all addresses.
+ * @NLIO_ADDRESS_ADD: Adding an address.
+ * @NLIO_ADDRESS_DELETE: Deleting an address.
+ * @NLIO_ROUTE_ADD: Adding a route.
+ * @NLIO_ROUTE_DELETE: Deleting a route.
+ * @N_NLIO_OPERATIONS: The number of operations.
+ *
+ * The netlink operations accounted for.
+ */
+typedef enum
+{
+  NLIO_CONNECT,
+  NLIO_LINK_GET,
+  NLIO_LINK_DUMP,
+  NLIO_LINK_CHANGE,
+  NLIO_ADDRESS_DUMP,
+  NLIO_ADDRESS_ADD,
+  NLIO_ADDRESS_DELETE,
+  NLIO_ROUTE_ADD,
+  NLIO_ROUTE_DELETE,
+  N_NLIO_OPERATIONS
+} NlioOperation;
+
+#define NLIO_N_ERRORS (NLE_MAX + 1)
+
+/**
+ * NlioStats:
+ * @calls: Number of calls.
+ * @messages_sent: Number of netlink messages sent.
+ * @messages_received: Number of netlink messages received.
+ * @bytes_sent: Number of bytes sent.
+ * @bytes_received: Number of bytes received.
+ * @p50: Median round trip time in micro-seconds.
+ * @p90: 90th percentile of the round trip time in micro-seconds.
+ * @p99: 99th percentile of the round trip time in micro-seconds.
+ * @max: Maximum round trip time in micro-seconds.
+ * @sum: Total round trip time in micro-seconds.
+ * @errors: Number of calls failed, indexed by libnl error code.
+ *
+ * Accounting of a netlink operation.
+ */
+typedef struct
+{
+  guint64 calls;
+  guint64 messages_sent;
+  guint64 messages_received;
+  guint64 bytes_sent;
+  guint64 bytes_received;
+  guint p50;
+  guint p90;
+  guint p99;
+  guint max;
+  guint64 sum;
+  guint64 errors[NLIO_N_ERRORS];
+} NlioStats;
+
+struct nl_sock * nlio_socket_new (void);
+
+gint nlio_link_get_kernel  (struct nl_sock *sock,
+                            const gchar *name,
+                            struct rtnl_link **result);
+gint nlio_link_alloc_cache (struct nl_sock *sock,
+                            struct nl_cache **result);
+gint nlio_link_change      (struct nl_sock *sock,
+                            struct rtnl_link *orig,
+                            struct rtnl_link *changes);
+gint nlio_addr_alloc_cache (struct nl_sock *sock,
+                            struct nl_cache **result);
+gint nlio_addr_add         (struct nl_sock *sock,
+                            struct rtnl_addr *addr,
+                            gint flags);
+gint nlio_addr_delete      (struct nl_sock *sock,
+                            struct rtnl_addr *addr,
+                            gint flags);
+gint nlio_route_add        (struct nl_sock *sock,
+                            struct rtnl_route *route,
+                            gint flags);
+gint nlio_route_delete     (struct nl_sock *sock,
+                            struct rtnl_route *route,
+                            gint flags);
+
+const gchar * nlio_operation_to_string (NlioOperation operation);
+void          nlio_get_stats           (NlioOperation operation,
+                                        NlioStats *stats);
+void          nlio_reset               (void);
+
+G_END_DECLS
+
+#endif /* LOOM_NLIO_H */
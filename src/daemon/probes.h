@@ -0,0 +1,132 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_PROBES_H
+#define LOOM_PROBES_H
+
+/**
+ * SECTION: Probes
+ * @title: Probes
+ * @short_description: USDT static probes.
+ *
+ * Static probes of the provider "loom" for SystemTap and bpftrace, built
+ * in with configure --enable-usdt. A probe not attached to is a single nop;
+ * its arguments are still evaluated, so probe sites only pass values at
+ * hand. Time stamps for durations are taken with LOOM_PROBE_NOW(), which
+ * is 0 in builds without probes. Durations are given in micro-seconds.
+ *
+ * The probes are listed by the names emitted into the binary, which
+ * bpftrace and readelf show. SystemTap also accepts dashes for the double
+ * underscores, e.g. process.mark("add-entry").
+ *
+ * <informaltable>
+ *   <tgroup cols="2">
+ *     <thead>
+ *       <row><entry>Probe</entry><entry>Arguments</entry></row>
+ *     </thead>
+ *     <tbody>
+ *       <row>
+ *         <entry>add__entry, delete__entry</entry>
+ *         <entry>connection object path</entry>
+ *       </row>
+ *       <row>
+ *         <entry>add__return, delete__return</entry>
+ *         <entry>connection object path, 0 if queued or -1 if rejected,
+ *         duration</entry>
+ *       </row>
+ *       <row>
+ *         <entry>intent__apply</entry>
+ *         <entry>interface name, target connection object path or "",
+ *         number of Add and Delete calls completed, time queued, duration
+ *         of the apply, 0 on success or -1</entry>
+ *       </row>
+ *       <row>
+ *         <entry>netlink</entry>
+ *         <entry>operation, libnl error code, duration, bytes sent, bytes
+ *         received</entry>
+ *       </row>
+ *       <row>
+ *         <entry>tick</entry>
+ *         <entry>number of jobs run, duration</entry>
+ *       </row>
+ *       <row>
+ *         <entry>job</entry>
+ *         <entry>job name, watched values changed, duration</entry>
+ *       </row>
+ *       <row>
+ *         <entry>link__event</entry>
+ *         <entry>interface index, link name, removed</entry>
+ *       </row>
+ *       <row>
+ *         <entry>address__event</entry>
+ *         <entry>interface index, removed</entry>
+ *       </row>
+ *       <row>
+ *         <entry>resolver__write</entry>
+ *         <entry>0 on success or -1, duration; also fired when the
+ *         configuration is erased</entry>
+ *       </row>
+ *     </tbody>
+ *   </tgroup>
+ * </informaltable>
+ *
+ * e.g. bpftrace -e 'usdt:/usr/libexec/loomd:loom:netlink
+ * { @[str(arg0)] = hist(arg2); }'
+ */
+
+#ifdef LOOM_USDT
+
+#include <sys/sdt.h>
+
+#define LOOM_PROBE_NOW() g_get_monotonic_time ()
+
+#define LOOM_PROBE1(name, a1) \
+  DTRACE_PROBE1 (loom, name, a1)
+#define LOOM_PROBE2(name, a1, a2) \
+  DTRACE_PROBE2 (loom, name, a1, a2)
+#define LOOM_PROBE3(name, a1, a2, a3) \
+  DTRACE_PROBE3 (loom, name, a1, a2, a3)
+#define LOOM_PROBE5(name, a1, a2, a3, a4, a5) \
+  DTRACE_PROBE5 (loom, name, a1, a2, a3, a4, a5)
+#define LOOM_PROBE6(name, a1, a2, a3, a4, a5, a6) \
+  DTRACE_PROBE6 (loom, name, a1, a2, a3, a4, a5, a6)
+
+#else
+
+/* arguments are referenced, not evaluated, to keep their variables used */
+#define LOOM_PROBE_NOW() ((gint64) 0)
+
+#define LOOM_PROBE1(name, a1) \
+  G_STMT_START { if (0) { (void) (a1); } } G_STMT_END
+#define LOOM_PROBE2(name, a1, a2) \
+  G_STMT_START { if (0) { (void) (a1); (void) (a2); } } G_STMT_END
+#define LOOM_PROBE3(name, a1, a2, a3) \
+  G_STMT_START { if (0) { (void) (a1); (void) (a2); (void) (a3); } } \
+  G_STMT_END
+#define LOOM_PROBE5(name, a1, a2, a3, a4, a5) \
+  G_STMT_START { if (0) { (void) (a1); (void) (a2); (void) (a3); \
+                          (void) (a4); (void) (a5); } } G_STMT_END
+#define LOOM_PROBE6(name, a1, a2, a3, a4, a5, a6) \
+  G_STMT_START { if (0) { (void) (a1); (void) (a2); (void) (a3); \
+                          (void) (a4); (void) (a5); (void) (a6); } } \
+  G_STMT_END
+
+#endif /* LOOM_USDT */
+
+#endif /* LOOM_PROBES_H */
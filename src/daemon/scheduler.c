@@ -0,0 +1,422 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "probes.h"
+#include "scheduler.h"
+
+/**
+ * SECTION: Scheduler
+ * @title: Scheduler
+ * @short_description: Periodic job scheduler.
+ *
+ * Subsystems register periodic jobs with their own interval and jitter
+ * instead of setting up their own timeouts. Jobs are kept in a hashed timer
+ * wheel and a single timeout is armed for the next occupied slot; without
+ * jobs no timeout is armed at all.
+ *
+ * A job reports whether the values it watches changed. If not, its period
+ * is doubled up to the maximum interval, otherwise it falls back to the base
+ * interval.
+ */
+
+#define WHEEL_SLOTS 256
+#define TICK_MSEC   250
+
+typedef struct
+{
+  guint id;
+  gchar *name;
+  guint interval;
+  guint base_interval;
+  guint max_interval;
+  guint jitter;
+  SchedulerFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+
+  guint64 deadline;
+  GQueue *queue;
+  GList link;
+  gboolean running;
+  gboolean removed;
+} Job;
+
+struct _Scheduler
+{
+  GQueue wheel[WHEEL_SLOTS];
+  GHashTable *jobs;
+  guint next_id;
+  gint priority;
+
+  gint64 origin;
+  guint64 current_tick;
+
+  guint timeout_id;
+  guint64 armed_tick;
+};
+
+static void arm (Scheduler *scheduler);
+
+static guint64
+now_tick (Scheduler *scheduler)
+{
+  return (g_get_monotonic_time () - scheduler->origin) / (TICK_MSEC * 1000);
+}
+
+static void
+job_free (Job *job)
+{
+  if (job->notify != NULL)
+    job->notify (job->user_data);
+  g_free (job->name);
+  g_slice_free (Job, job);
+}
+
+static void
+job_unlink (Job *job)
+{
+  if (job->queue != NULL)
+    {
+      g_queue_unlink (job->queue, &job->link);
+      job->queue = NULL;
+    }
+}
+
+static gboolean
+job_is_waiting (Scheduler *scheduler,
+                Job *job)
+{
+  return job->queue >= scheduler->wheel &&
+         job->queue < scheduler->wheel + WHEEL_SLOTS;
+}
+
+static void
+job_schedule (Scheduler *scheduler,
+              Job *job,
+              guint64 tick)
+{
+  guint delay;
+  guint64 ticks;
+
+  delay = job->interval;
+  if (job->jitter > 0)
+    delay += g_random_int_range (0, job->jitter + 1);
+
+  ticks = MAX (1, (delay + TICK_MSEC - 1) / TICK_MSEC);
+
+  job->deadline = tick + ticks;
+  job->queue = &scheduler->wheel[job->deadline % WHEEL_SLOTS];
+  g_queue_push_tail_link (job->queue, &job->link);
+}
+
+static void
+collect_due (Scheduler *scheduler,
+             guint64 tick,
+             guint64 now,
+             GQueue *due)
+{
+  GQueue *slot = &scheduler->wheel[tick % WHEEL_SLOTS];
+  GList *link = slot->head;
+
+  while (link != NULL)
+    {
+      Job *job = link->data;
+      GList *next = link->next;
+
+      if (job->deadline <= now)
+        {
+          g_queue_unlink (slot, link);
+          job->queue = due;
+          g_queue_push_tail_link (due, link);
+        }
+
+      link = next;
+    }
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+  Scheduler *scheduler = user_data;
+  GQueue due = G_QUEUE_INIT;
+  GList *link;
+  guint64 now;
+  guint64 tick;
+  guint n_jobs = 0;
+  gint64 start;
+
+  scheduler->timeout_id = 0;
+  start = LOOM_PROBE_NOW ();
+
+  now = now_tick (scheduler);
+
+  tick = scheduler->current_tick + 1;
+  if (now >= tick + WHEEL_SLOTS)
+    tick = now - WHEEL_SLOTS + 1;
+  for (; tick <= now; tick++)
+    collect_due (scheduler, tick, now, &due);
+  scheduler->current_tick = now;
+
+  while ((link = g_queue_pop_head_link (&due)) != NULL)
+    {
+      Job *job = link->data;
+      gboolean changed;
+      gint64 job_start;
+
+      job->queue = NULL;
+      job->running = TRUE;
+      job_start = LOOM_PROBE_NOW ();
+      changed = job->func (job->user_data);
+      LOOM_PROBE3 (job, job->name, changed, LOOM_PROBE_NOW () - job_start);
+      job->running = FALSE;
+      n_jobs++;
+
+      if (job->removed)
+        {
+          job_free (job);
+          continue;
+        }
+
+      if (changed)
+        job->interval = job->base_interval;
+      else
+        job->interval = MIN (job->interval * 2, job->max_interval);
+
+      job_schedule (scheduler, job, now);
+    }
+
+  LOOM_PROBE2 (tick, n_jobs, LOOM_PROBE_NOW () - start);
+
+  arm (scheduler);
+
+  return FALSE;
+}
+
+static void
+arm (Scheduler *scheduler)
+{
+  guint64 now;
+  guint64 tick;
+  gint64 wait;
+
+  if (g_hash_table_size (scheduler->jobs) == 0)
+    {
+      if (scheduler->timeout_id > 0)
+        g_source_remove (scheduler->timeout_id);
+      scheduler->timeout_id = 0;
+      return;
+    }
+
+  now = now_tick (scheduler);
+  for (tick = now + 1; tick <= now + WHEEL_SLOTS; tick++)
+    {
+      if (!g_queue_is_empty (&scheduler->wheel[tick % WHEEL_SLOTS]))
+        break;
+    }
+
+  if (scheduler->timeout_id > 0)
+    {
+      if (scheduler->armed_tick <= tick)
+        return;
+      g_source_remove (scheduler->timeout_id);
+    }
+
+  wait = (scheduler->origin + (gint64) tick * TICK_MSEC * 1000 -
+          g_get_monotonic_time () + 999) / 1000;
+
+  scheduler->armed_tick = tick;
+  scheduler->timeout_id = g_timeout_add_full (scheduler->priority,
+                                              MAX (wait, 0),
+                                              on_timeout,
+                                              scheduler,
+                                              NULL);
+  g_source_set_name_by_id (scheduler->timeout_id, "loom-scheduler");
+}
+
+/**
+ * scheduler_new:
+ * @priority: The priority of the scheduler timeout source.
+ *
+ * Creates a new #Scheduler dispatching jobs in the thread-default main
+ * context.
+ *
+ * Returns: A new #Scheduler. Free with scheduler_free().
+ */
+Scheduler *
+scheduler_new (gint priority)
+{
+  Scheduler *scheduler;
+
+  scheduler = g_slice_new0 (Scheduler);
+  for (guint i = 0; i < WHEEL_SLOTS; i++)
+    g_queue_init (&scheduler->wheel[i]);
+  scheduler->jobs = g_hash_table_new (g_direct_hash, g_direct_equal);
+  scheduler->next_id = 1;
+  scheduler->priority = priority;
+  scheduler->origin = g_get_monotonic_time ();
+
+  return scheduler;
+}
+
+/**
+ * scheduler_free:
+ * @scheduler: A #Scheduler.
+ *
+ * Removes all jobs and frees @scheduler.
+ */
+void
+scheduler_free (Scheduler *scheduler)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  if (scheduler == NULL)
+    return;
+
+  if (scheduler->timeout_id > 0)
+    g_source_remove (scheduler->timeout_id);
+
+  g_hash_table_iter_init (&iter, scheduler->jobs);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Job *job = value;
+
+      job_unlink (job);
+      job_free (job);
+    }
+  g_hash_table_unref (scheduler->jobs);
+
+  g_slice_free (Scheduler, scheduler);
+}
+
+/**
+ * scheduler_add:
+ * @scheduler: A #Scheduler.
+ * @name: A name describing the job.
+ * @interval_msec: The base period in milli-seconds.
+ * @max_interval_msec: The maximum period in milli-seconds the base period
+ * is stretched to while @func reports no changes.
+ * @jitter_msec: Up to this many milli-seconds are randomly added to each
+ * period.
+ * @func: The function to call.
+ * @user_data: Data to pass to @func.
+ * @notify: (allow-none): Function to free @user_data when the job is removed.
+ *
+ * Adds a periodic job to @scheduler.
+ *
+ * Returns: A job id greater than 0.
+ */
+guint
+scheduler_add (Scheduler *scheduler,
+               const gchar *name,
+               guint interval_msec,
+               guint max_interval_msec,
+               guint jitter_msec,
+               SchedulerFunc func,
+               gpointer user_data,
+               GDestroyNotify notify)
+{
+  g_return_val_if_fail (scheduler != NULL, 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  Job *job;
+
+  job = g_slice_new0 (Job);
+  job->id = scheduler->next_id++;
+  job->name = g_strdup (name);
+  job->base_interval = MAX (interval_msec, TICK_MSEC);
+  job->max_interval = MAX (max_interval_msec, job->base_interval);
+  job->interval = job->base_interval;
+  job->jitter = jitter_msec;
+  job->func = func;
+  job->user_data = user_data;
+  job->notify = notify;
+  job->link.data = job;
+
+  g_hash_table_insert (scheduler->jobs, GUINT_TO_POINTER (job->id), job);
+
+  if (scheduler->timeout_id == 0)
+    scheduler->current_tick = now_tick (scheduler);
+  job_schedule (scheduler, job, now_tick (scheduler));
+  arm (scheduler);
+
+  return job->id;
+}
+
+/**
+ * scheduler_remove:
+ * @scheduler: A #Scheduler.
+ * @id: A job id returned by scheduler_add().
+ *
+ * Removes a job. Can be called from within the job callback.
+ */
+void
+scheduler_remove (Scheduler *scheduler,
+                  guint id)
+{
+  g_return_if_fail (scheduler != NULL);
+
+  Job *job;
+
+  job = g_hash_table_lookup (scheduler->jobs, GUINT_TO_POINTER (id));
+  if (job == NULL)
+    return;
+
+  g_hash_table_remove (scheduler->jobs, GUINT_TO_POINTER (id));
+  job_unlink (job);
+
+  if (job->running)
+    job->removed = TRUE;
+  else
+    job_free (job);
+
+  arm (scheduler);
+}
+
+/**
+ * scheduler_reset:
+ * @scheduler: A #Scheduler.
+ * @id: A job id returned by scheduler_add().
+ *
+ * Resets the period of a job to its base interval, e.g. after an event that
+ * makes changes of the watched values likely.
+ */
+void
+scheduler_reset (Scheduler *scheduler,
+                 guint id)
+{
+  g_return_if_fail (scheduler != NULL);
+
+  Job *job;
+
+  job = g_hash_table_lookup (scheduler->jobs, GUINT_TO_POINTER (id));
+  if (job == NULL || job->running || job->interval == job->base_interval)
+    return;
+
+  job->interval = job->base_interval;
+  if (job_is_waiting (scheduler, job) &&
+      job->deadline > now_tick (scheduler) + job->base_interval / TICK_MSEC)
+    {
+      job_unlink (job);
+      job_schedule (scheduler, job, now_tick (scheduler));
+      arm (scheduler);
+    }
+}
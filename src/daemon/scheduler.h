@@ -0,0 +1,58 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_SCHEDULER_H
+#define LOOM_SCHEDULER_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _Scheduler Scheduler;
+
+/**
+ * SchedulerFunc:
+ * @user_data: Data passed to scheduler_add().
+ *
+ * Periodic job callback.
+ *
+ * Returns: %TRUE if the watched values changed, %FALSE to let the scheduler
+ * stretch the period of the job.
+ */
+typedef gboolean (*SchedulerFunc) (gpointer user_data);
+
+Scheduler * scheduler_new  (gint priority);
+void        scheduler_free (Scheduler *scheduler);
+
+guint scheduler_add    (Scheduler *scheduler,
+                        const gchar *name,
+                        guint interval_msec,
+                        guint max_interval_msec,
+                        guint jitter_msec,
+                        SchedulerFunc func,
+                        gpointer user_data,
+                        GDestroyNotify notify);
+void  scheduler_remove (Scheduler *scheduler,
+                        guint id);
+void  scheduler_reset  (Scheduler *scheduler,
+                        guint id);
+
+G_END_DECLS
+
+#endif /* LOOM_SCHEDULER_H */
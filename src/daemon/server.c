@@ -0,0 +1,331 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "daemon.h"
+#include "server.h"
+
+/**
+ * SECTION: Server
+ * @title: Server
+ * @short_description: Peer-to-peer D-Bus server.
+ *
+ * Listens on a private unix socket for direct D-Bus connections. Each peer
+ * gets its own object manager mirroring the objects exported on the
+ * message bus, so local clients can talk to the daemon without the round
+ * trip through the bus daemon.
+ *
+ * Peers are authenticated with the EXTERNAL mechanism, i.e. by the
+ * credentials of the socket (SO_PEERCRED). As on the message bus only user
+ * root and users of group netdev are allowed.
+ */
+
+#define SERVER_GROUP "netdev"
+
+typedef struct
+{
+  Server *server;
+  GDBusConnection *connection;
+  GDBusObjectManagerServer *object_manager;
+} Peer;
+
+struct _Server
+{
+  Daemon *daemon;
+  GDBusObjectManager *object_manager;
+  gchar *path;
+  gchar *guid;
+
+  GDBusServer *dbus_server;
+  GDBusAuthObserver *observer;
+  GHashTable *peers;
+};
+
+static gboolean
+is_authorized_user (uid_t uid)
+{
+  struct passwd pwd, *pw = NULL;
+  struct group grp, *gr = NULL;
+  gchar buf[4096];
+  gid_t groups[256];
+  gint ngroups = G_N_ELEMENTS (groups);
+
+  if (uid == 0 || uid == geteuid ())
+    return TRUE;
+
+  if (getgrnam_r (SERVER_GROUP, &grp, buf, sizeof (buf), &gr) != 0 ||
+      gr == NULL)
+    return FALSE;
+  gid_t gid = gr->gr_gid;
+
+  if (getpwuid_r (uid, &pwd, buf, sizeof (buf), &pw) != 0 || pw == NULL)
+    return FALSE;
+
+  if (getgrouplist (pw->pw_name, pw->pw_gid, groups, &ngroups) < 0)
+    return FALSE;
+
+  for (gint i = 0; i < ngroups; i++)
+    {
+      if (groups[i] == gid)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Called from the GDBusServer worker thread. */
+static gboolean
+on_authorize_authenticated_peer (GDBusAuthObserver *observer,
+                                 GIOStream *stream,
+                                 GCredentials *credentials,
+                                 gpointer user_data)
+{
+  uid_t uid;
+  GError *error = NULL;
+
+  if (credentials == NULL)
+    return FALSE;
+
+  uid = g_credentials_get_unix_user (credentials, &error);
+  if (error != NULL)
+    {
+      g_debug ("Rejecting peer without unix credentials: %s", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  if (!is_authorized_user (uid))
+    {
+      g_message (_("Rejecting peer connection of user %u"), (guint) uid);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+on_allow_mechanism (GDBusAuthObserver *observer,
+                    const gchar *mechanism,
+                    gpointer user_data)
+{
+  return g_strcmp0 (mechanism, "EXTERNAL") == 0;
+}
+
+static void
+peer_free (Peer *peer)
+{
+  g_signal_handlers_disconnect_by_data (peer->connection, peer);
+  g_dbus_connection_close (peer->connection, NULL, NULL, NULL);
+  g_object_unref (peer->object_manager);
+  g_object_unref (peer->connection);
+  g_slice_free (Peer, peer);
+}
+
+static void
+on_peer_closed (GDBusConnection *connection,
+                gboolean remote_peer_vanished,
+                GError *error,
+                gpointer user_data)
+{
+  Peer *peer = user_data;
+
+  g_debug ("Peer connection closed");
+  g_hash_table_remove (peer->server->peers, connection);
+}
+
+static gboolean
+on_new_connection (GDBusServer *dbus_server,
+                   GDBusConnection *connection,
+                   gpointer user_data)
+{
+  Server *server = user_data;
+  Peer *peer;
+  GList *objects;
+
+  peer = g_slice_new0 (Peer);
+  peer->server = server;
+  peer->connection = g_object_ref (connection);
+  peer->object_manager = g_dbus_object_manager_server_new ("/org/blackox/Loom");
+
+  objects = g_dbus_object_manager_get_objects (server->object_manager);
+  for (GList *l = objects; l != NULL; l = l->next)
+    g_dbus_object_manager_server_export (peer->object_manager,
+                                         G_DBUS_OBJECT_SKELETON (l->data));
+  g_list_free_full (objects, g_object_unref);
+
+  g_dbus_object_manager_server_set_connection (peer->object_manager,
+                                               connection);
+  g_signal_connect (connection, "closed", G_CALLBACK (on_peer_closed), peer);
+  g_hash_table_insert (server->peers, connection, peer);
+
+  return TRUE;
+}
+
+static void
+on_object_added (GDBusObjectManager *object_manager,
+                 GDBusObject *object,
+                 gpointer user_data)
+{
+  Server *server = user_data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, server->peers);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Peer *peer = value;
+
+      g_dbus_object_manager_server_export (peer->object_manager,
+                                           G_DBUS_OBJECT_SKELETON (object));
+    }
+}
+
+static void
+on_object_removed (GDBusObjectManager *object_manager,
+                   GDBusObject *object,
+                   gpointer user_data)
+{
+  Server *server = user_data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, server->peers);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Peer *peer = value;
+
+      g_dbus_object_manager_server_unexport (peer->object_manager,
+                                       g_dbus_object_get_object_path (object));
+    }
+}
+
+/**
+ * server_new:
+ * @daemon: A #Daemon.
+ * @path: Path of the unix socket to listen on.
+ *
+ * Creates a new #Server listening on @path. A stale socket left at @path
+ * is removed first.
+ *
+ * Returns: A new #Server or %NULL if listening failed. Free with
+ * server_free().
+ */
+Server *
+server_new (Daemon *daemon,
+            const gchar *path)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  Server *server;
+  gchar *dirname;
+  gchar *address;
+  GError *error = NULL;
+
+  dirname = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dirname, 0755) != 0)
+    g_warning (_("Failed to create directory %s: %s"),
+               dirname, g_strerror (errno));
+  g_free (dirname);
+
+  if (g_unlink (path) != 0 && errno != ENOENT)
+    g_warning (_("Failed to remove stale socket %s: %s"),
+               path, g_strerror (errno));
+
+  server = g_slice_new0 (Server);
+  server->daemon = daemon;
+  server->object_manager =
+    G_DBUS_OBJECT_MANAGER (daemon_get_object_manager (daemon));
+  server->path = g_strdup (path);
+  server->guid = g_dbus_generate_guid ();
+  server->peers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, (GDestroyNotify) peer_free);
+
+  server->observer = g_dbus_auth_observer_new ();
+  g_signal_connect (server->observer, "authorize-authenticated-peer",
+                    G_CALLBACK (on_authorize_authenticated_peer), server);
+  g_signal_connect (server->observer, "allow-mechanism",
+                    G_CALLBACK (on_allow_mechanism), server);
+
+  address = g_strdup_printf ("unix:path=%s", path);
+  server->dbus_server = g_dbus_server_new_sync (address,
+                                                G_DBUS_SERVER_FLAGS_NONE,
+                                                server->guid,
+                                                server->observer,
+                                                NULL,
+                                                &error);
+  g_free (address);
+  if (server->dbus_server == NULL)
+    {
+      g_warning (_("Failed to listen on %s: %s"), path, error->message);
+      g_error_free (error);
+      server_free (server);
+      return NULL;
+    }
+
+  g_signal_connect (server->dbus_server, "new-connection",
+                    G_CALLBACK (on_new_connection), server);
+  g_signal_connect (server->object_manager, "object-added",
+                    G_CALLBACK (on_object_added), server);
+  g_signal_connect (server->object_manager, "object-removed",
+                    G_CALLBACK (on_object_removed), server);
+
+  g_chmod (path, 0666);
+  g_dbus_server_start (server->dbus_server);
+
+  return server;
+}
+
+/**
+ * server_free:
+ * @server: A #Server.
+ *
+ * Stops listening, closes all peer connections and frees @server.
+ */
+void
+server_free (Server *server)
+{
+  if (server == NULL)
+    return;
+
+  g_signal_handlers_disconnect_by_data (server->object_manager, server);
+
+  if (server->dbus_server != NULL)
+    {
+      g_dbus_server_stop (server->dbus_server);
+      g_object_unref (server->dbus_server);
+      g_unlink (server->path);
+    }
+
+  g_hash_table_unref (server->peers);
+  g_object_unref (server->observer);
+  g_free (server->guid);
+  g_free (server->path);
+  g_slice_free (Server, server);
+}
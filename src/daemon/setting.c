@@ -26,6 +26,7 @@
 #include <glib/gi18n.h>
 
 #include "daemon.h"
+#include "settings.h"
 #include "setting.h"
 
 typedef struct _SettingClass SettingClass;
@@ -122,6 +123,10 @@ setting_get_property (GObject *object,
       g_value_set_string (value, setting_get_uuid (setting));
       break;
 
+    case PROP_CONFIGURATION:
+      g_value_set_variant (value, setting->configuration);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -171,6 +176,11 @@ parse_configuration (Setting *setting)
   GVariant *value = NULL;
   LoomSetting *loom_setting = LOOM_SETTING (setting);
 
+  loom_setting_set_router (loom_setting, NULL);
+  loom_setting_set_name_servers (loom_setting, NULL);
+  loom_setting_set_domain (loom_setting, NULL);
+  loom_setting_set_searches (loom_setting, NULL);
+
   dict = g_variant_dict_new (setting->configuration);
   value = g_variant_dict_lookup_value (dict, "address", G_VARIANT_TYPE_STRING);
   loom_setting_set_address (loom_setting, g_variant_get_string (value, NULL));
@@ -193,7 +203,7 @@ parse_configuration (Setting *setting)
 
   if (g_variant_dict_contains (dict, "domain"))
     {
-      value = g_variant_dict_lookup_value (dict, "domains",
+      value = g_variant_dict_lookup_value (dict, "domain",
                                            G_VARIANT_TYPE_STRING);
       loom_setting_set_domain (loom_setting, g_variant_get_string (value, NULL));
     }
@@ -249,7 +259,7 @@ setting_class_init (SettingClass *klass)
                                                          NULL,
                                                          G_VARIANT_TYPE_VARDICT,
                                                          NULL,
-                                                         G_PARAM_WRITABLE |
+                                                         G_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT_ONLY |
                                                          G_PARAM_STATIC_STRINGS));
 
@@ -309,7 +319,110 @@ setting_get_configuration (Setting *setting)
   return setting->configuration;
 }
 
+static const struct
+{
+  const gchar *key;
+  SettingField field;
+} fields[] =
+{
+  { "address",     SETTING_FIELD_ADDRESS },
+  { "router",      SETTING_FIELD_ROUTER },
+  { "nameservers", SETTING_FIELD_NAME_SERVERS },
+  { "domain",      SETTING_FIELD_DOMAIN },
+  { "searches",    SETTING_FIELD_SEARCHES },
+};
+
+/**
+ * setting_diff_configuration:
+ * @old_configuration: A setting configuration.
+ * @new_configuration: A setting configuration.
+ *
+ * Compares two setting configurations entry by entry.
+ *
+ * Returns: The entries added, removed or changed in @new_configuration.
+ */
+SettingField
+setting_diff_configuration (GVariant *old_configuration,
+                            GVariant *new_configuration)
+{
+  GVariantDict *old_dict;
+  GVariantDict *new_dict;
+  SettingField changed = 0;
+
+  old_dict = g_variant_dict_new (old_configuration);
+  new_dict = g_variant_dict_new (new_configuration);
+
+  for (guint i = 0; i < G_N_ELEMENTS (fields); i++)
+    {
+      gs_unref_variant GVariant *old_value = NULL;
+      gs_unref_variant GVariant *new_value = NULL;
+
+      old_value = g_variant_dict_lookup_value (old_dict, fields[i].key, NULL);
+      new_value = g_variant_dict_lookup_value (new_dict, fields[i].key, NULL);
+
+      if (old_value == NULL && new_value == NULL)
+        continue;
+      if (old_value == NULL || new_value == NULL ||
+          !g_variant_equal (old_value, new_value))
+        changed |= fields[i].field;
+    }
+
+  g_variant_dict_unref (old_dict);
+  g_variant_dict_unref (new_dict);
+
+  return changed;
+}
+
+/**
+ * setting_update:
+ * @setting: A #Setting.
+ * @configuration: A validated setting configuration.
+ *
+ * Replaces the configuration of @setting. #GObject::notify is emitted for
+ * the #Setting:configuration property if any entry changed, connections
+ * using @setting pick up the change from there.
+ */
+void
+setting_update (Setting *setting,
+                GVariant *configuration)
+{
+  g_return_if_fail (IS_SETTING (setting));
+  g_return_if_fail (g_variant_is_of_type (configuration,
+                                          G_VARIANT_TYPE_VARDICT));
+
+  if (setting_diff_configuration (setting->configuration, configuration) == 0)
+    return;
+
+  g_variant_unref (setting->configuration);
+  setting->configuration = g_variant_ref_sink (configuration);
+  parse_configuration (setting);
+
+  g_object_notify (G_OBJECT (setting), "configuration");
+}
+
+static gboolean
+handle_update (LoomSetting *object,
+               GDBusMethodInvocation *invocation,
+               GVariant *arg_configuration)
+{
+  GError *error = NULL;
+
+  if (!settings_validate_configuration (arg_configuration, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+
+      return TRUE;
+    }
+
+  setting_update (SETTING (object), arg_configuration);
+
+  loom_setting_complete_update (object, invocation);
+
+  return TRUE;
+}
+
 static void
 setting_iface_init (LoomSettingIface *iface)
 {
+  iface->handle_update = handle_update;
 }
@@ -24,6 +24,25 @@
 
 G_BEGIN_DECLS
 
+/**
+ * SettingField:
+ * @SETTING_FIELD_ADDRESS: The address entry.
+ * @SETTING_FIELD_ROUTER: The router entry.
+ * @SETTING_FIELD_NAME_SERVERS: The nameservers entry.
+ * @SETTING_FIELD_DOMAIN: The domain entry.
+ * @SETTING_FIELD_SEARCHES: The searches entry.
+ *
+ * Flags for the entries of a setting configuration.
+ */
+typedef enum
+{
+  SETTING_FIELD_ADDRESS      = 1 << 0,
+  SETTING_FIELD_ROUTER       = 1 << 1,
+  SETTING_FIELD_NAME_SERVERS = 1 << 2,
+  SETTING_FIELD_DOMAIN       = 1 << 3,
+  SETTING_FIELD_SEARCHES     = 1 << 4,
+} SettingField;
+
 #define TYPE_SETTING  (setting_get_type ())
 #define SETTING(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), TYPE_SETTING, Setting))
 #define IS_SETTING(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), TYPE_SETTING))
@@ -35,6 +54,11 @@ const gchar * setting_get_object_path   (Setting *setting);
 const gchar * setting_get_uuid          (Setting *setting);
 GVariant *    setting_get_configuration (Setting *setting);
 
+void         setting_update             (Setting *setting,
+                                         GVariant *configuration);
+SettingField setting_diff_configuration (GVariant *old_configuration,
+                                         GVariant *new_configuration);
+
 void setting_export (Setting *setting);
 void setting_unexport (Setting *setting);
 
@@ -245,9 +245,18 @@ validate_domainname (const gchar *key,
   return TRUE;
 }
 
-static gboolean
-validate_configuration (GVariant *configuration,
-                        GError **error)
+/**
+ * settings_validate_configuration:
+ * @configuration: A setting configuration.
+ * @error: Return location for error or %NULL.
+ *
+ * Checks @configuration for required entries and valid values.
+ *
+ * Returns: %TRUE if @configuration is valid, %FALSE if @error is set.
+ */
+gboolean
+settings_validate_configuration (GVariant *configuration,
+                                 GError **error)
 {
   GVariantDict *dict = NULL;
   GVariant *value = NULL;
@@ -402,7 +411,7 @@ handle_create (LoomSettings *object,
   gs_free gchar **object_paths = NULL;
   GError *error = NULL;
 
-  if (!validate_configuration (arg_configuration, &error))
+  if (!settings_validate_configuration (arg_configuration, &error))
     {
       g_dbus_method_invocation_take_error (invocation, error);
       return TRUE;
@@ -35,6 +35,9 @@ LoomSettings * settings_new      (Daemon *daemon);
 Setting * settings_get_by_object_path (Settings *settings,
                                        const gchar* object_path);
 
+gboolean settings_validate_configuration (GVariant *configuration,
+                                          GError **error);
+
 void settings_add_to_actives (Settings *settings, Setting *setting);
 void settings_remove_from_actives (Settings *settings, Setting *setting);
 
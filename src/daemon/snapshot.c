@@ -0,0 +1,318 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+/**
+ * SECTION: Snapshot
+ * @title: Snapshot
+ * @short_description: Immutable state snapshots.
+ *
+ * A #Snapshot holds the interface, setting and connection objects with
+ * their properties at one generation, serialized once when it is created.
+ * Snapshots are never modified; a change publishes a new snapshot in place
+ * of the old one, which lives on until its last reader drops it.
+ *
+ * Readers take a reference with snapshot_acquire() from any thread and get
+ * a consistent view without waiting for writers. Only the pointer swap and
+ * the reference increment are serialized, through a bit lock in the
+ * published pointer itself, never the building or serialization of a
+ * snapshot.
+ */
+
+struct _Snapshot
+{
+  gint ref_count;
+  guint64 generation;
+  GVariant *state;
+  GVariant *objects[N_SNAPSHOT_KINDS];
+  gchar **active[N_SNAPSHOT_KINDS];
+};
+
+#define LOCK_BIT 0
+
+static gint
+compare_strings (const void *a,
+                 const void *b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/**
+ * snapshot_new:
+ * @version: The version of the state layout.
+ * @generation: The generation of the state.
+ * @objects: (array fixed-size=3): For each #SnapshotKind a floating
+ * <literal>a{oa{sv}}</literal> of objects sorted by object-path.
+ * @active: (array fixed-size=3): For each #SnapshotKind the object-paths of
+ * active objects. The string arrays are taken.
+ *
+ * Creates a new #Snapshot and serializes it.
+ *
+ * Returns: A new #Snapshot. Free with snapshot_unref().
+ */
+Snapshot *
+snapshot_new (guint version,
+              guint64 generation,
+              GVariant **objects,
+              gchar ***active)
+{
+  Snapshot *snapshot;
+  GVariant *active_connections;
+
+  snapshot = g_slice_new0 (Snapshot);
+  snapshot->ref_count = 1;
+  snapshot->generation = generation;
+
+  for (guint i = 0; i < N_SNAPSHOT_KINDS; i++)
+    {
+      snapshot->active[i] = active[i] != NULL ? active[i] : g_new0 (gchar *, 1);
+      qsort (snapshot->active[i], g_strv_length (snapshot->active[i]),
+             sizeof (gchar *), compare_strings);
+    }
+
+  active_connections =
+    g_variant_new_objv ((const gchar * const *)
+                        snapshot->active[SNAPSHOT_CONNECTIONS], -1);
+
+  snapshot->state = g_variant_new ("(ut@a{oa{sv}}@a{oa{sv}}@a{oa{sv}}@ao)",
+                                   version, generation,
+                                   objects[SNAPSHOT_INTERFACES],
+                                   objects[SNAPSHOT_SETTINGS],
+                                   objects[SNAPSHOT_CONNECTIONS],
+                                   active_connections);
+  g_variant_ref_sink (snapshot->state);
+
+  /* Serialize once, readers only copy the flat data. */
+  g_variant_get_data (snapshot->state);
+
+  for (guint i = 0; i < N_SNAPSHOT_KINDS; i++)
+    snapshot->objects[i] = g_variant_get_child_value (snapshot->state, i + 2);
+
+  return snapshot;
+}
+
+/**
+ * snapshot_ref:
+ * @snapshot: A #Snapshot.
+ *
+ * Increases the reference count of @snapshot.
+ *
+ * Returns: @snapshot.
+ */
+Snapshot *
+snapshot_ref (Snapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  g_atomic_int_inc (&snapshot->ref_count);
+
+  return snapshot;
+}
+
+/**
+ * snapshot_unref:
+ * @snapshot: A #Snapshot.
+ *
+ * Decreases the reference count of @snapshot and frees it once the count
+ * drops to zero.
+ */
+void
+snapshot_unref (Snapshot *snapshot)
+{
+  g_return_if_fail (snapshot != NULL);
+
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  for (guint i = 0; i < N_SNAPSHOT_KINDS; i++)
+    {
+      g_variant_unref (snapshot->objects[i]);
+      g_strfreev (snapshot->active[i]);
+    }
+  g_variant_unref (snapshot->state);
+  g_slice_free (Snapshot, snapshot);
+}
+
+/**
+ * snapshot_get_generation:
+ * @snapshot: A #Snapshot.
+ *
+ * Returns: The generation of the state held by @snapshot.
+ */
+guint64
+snapshot_get_generation (Snapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, 0);
+  return snapshot->generation;
+}
+
+/**
+ * snapshot_get_state:
+ * @snapshot: A #Snapshot.
+ *
+ * Gets the serialized state, the reply of the GetState() method.
+ *
+ * Returns: (transfer none): The state, valid as long as @snapshot.
+ */
+GVariant *
+snapshot_get_state (Snapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+  return snapshot->state;
+}
+
+/**
+ * snapshot_get_objects:
+ * @snapshot: A #Snapshot.
+ * @kind: A #SnapshotKind.
+ *
+ * Gets the objects of @kind sorted by object-path.
+ *
+ * Returns: (transfer none): A <literal>a{oa{sv}}</literal>, valid as long
+ * as @snapshot.
+ */
+GVariant *
+snapshot_get_objects (Snapshot *snapshot,
+                      SnapshotKind kind)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+  g_return_val_if_fail (kind < N_SNAPSHOT_KINDS, NULL);
+  return snapshot->objects[kind];
+}
+
+/**
+ * snapshot_find:
+ * @snapshot: A #Snapshot.
+ * @kind: A #SnapshotKind.
+ * @cursor: An object-path or the empty string.
+ *
+ * Looks up the first object of @kind following @cursor in object-path
+ * order, @cursor itself needs not to exist.
+ *
+ * Returns: The index of the object in snapshot_get_objects(), the number
+ * of objects if none follows.
+ */
+gsize
+snapshot_find (Snapshot *snapshot,
+               SnapshotKind kind,
+               const gchar *cursor)
+{
+  g_return_val_if_fail (snapshot != NULL, 0);
+  g_return_val_if_fail (kind < N_SNAPSHOT_KINDS, 0);
+
+  GVariant *objects = snapshot->objects[kind];
+  gsize low = 0;
+  gsize high = g_variant_n_children (objects);
+
+  while (low < high)
+    {
+      gsize middle = low + (high - low) / 2;
+      const gchar *object_path;
+
+      g_variant_get_child (objects, middle, "{&o@a{sv}}", &object_path, NULL);
+      if (strcmp (object_path, cursor) <= 0)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  return low;
+}
+
+/**
+ * snapshot_is_active:
+ * @snapshot: A #Snapshot.
+ * @kind: A #SnapshotKind.
+ * @object_path: An object-path.
+ *
+ * Returns: %TRUE if the object at @object_path was active.
+ */
+gboolean
+snapshot_is_active (Snapshot *snapshot,
+                    SnapshotKind kind,
+                    const gchar *object_path)
+{
+  g_return_val_if_fail (snapshot != NULL, FALSE);
+  g_return_val_if_fail (kind < N_SNAPSHOT_KINDS, FALSE);
+
+  return bsearch (&object_path, snapshot->active[kind],
+                  g_strv_length (snapshot->active[kind]), sizeof (gchar *),
+                  compare_strings) != NULL;
+}
+
+/**
+ * snapshot_acquire:
+ * @location: Location a snapshot is published at.
+ *
+ * Takes a reference on the snapshot currently published at @location. Can
+ * be called from any thread.
+ *
+ * Returns: (allow-none): The snapshot or %NULL if none is published. Free
+ * with snapshot_unref().
+ */
+Snapshot *
+snapshot_acquire (Snapshot **location)
+{
+  g_return_val_if_fail (location != NULL, NULL);
+
+  Snapshot *snapshot;
+
+  g_pointer_bit_lock (location, LOCK_BIT);
+  snapshot = (Snapshot *) ((gsize) g_atomic_pointer_get (location) &
+                           ~((gsize) 1 << LOCK_BIT));
+  if (snapshot != NULL)
+    snapshot_ref (snapshot);
+  g_pointer_bit_unlock (location, LOCK_BIT);
+
+  return snapshot;
+}
+
+/**
+ * snapshot_publish:
+ * @location: Location to publish @snapshot at.
+ * @snapshot: (allow-none) (transfer full): A #Snapshot or %NULL.
+ *
+ * Replaces the snapshot published at @location with @snapshot. Readers
+ * holding the previous snapshot keep it until they drop it.
+ */
+void
+snapshot_publish (Snapshot **location,
+                  Snapshot *snapshot)
+{
+  g_return_if_fail (location != NULL);
+
+  Snapshot *previous;
+
+  g_pointer_bit_lock (location, LOCK_BIT);
+  previous = (Snapshot *) ((gsize) g_atomic_pointer_get (location) &
+                           ~((gsize) 1 << LOCK_BIT));
+  /* keep the lock bit set, unlocking clears it */
+  g_atomic_pointer_set (location,
+                        (gpointer) ((gsize) snapshot | (gsize) 1 << LOCK_BIT));
+  g_pointer_bit_unlock (location, LOCK_BIT);
+
+  if (previous != NULL)
+    snapshot_unref (previous);
+}
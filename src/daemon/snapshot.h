@@ -0,0 +1,69 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_SNAPSHOT_H
+#define LOOM_SNAPSHOT_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _Snapshot Snapshot;
+
+/**
+ * SnapshotKind:
+ * @SNAPSHOT_INTERFACES: Interface objects.
+ * @SNAPSHOT_SETTINGS: Setting objects.
+ * @SNAPSHOT_CONNECTIONS: Connection objects.
+ *
+ * Kind of objects held by a #Snapshot.
+ */
+typedef enum
+{
+  SNAPSHOT_INTERFACES,
+  SNAPSHOT_SETTINGS,
+  SNAPSHOT_CONNECTIONS,
+  N_SNAPSHOT_KINDS,
+} SnapshotKind;
+
+Snapshot * snapshot_new   (guint version,
+                           guint64 generation,
+                           GVariant **objects,
+                           gchar ***active);
+Snapshot * snapshot_ref   (Snapshot *snapshot);
+void       snapshot_unref (Snapshot *snapshot);
+
+guint64    snapshot_get_generation (Snapshot *snapshot);
+GVariant * snapshot_get_state      (Snapshot *snapshot);
+GVariant * snapshot_get_objects    (Snapshot *snapshot,
+                                    SnapshotKind kind);
+gsize      snapshot_find           (Snapshot *snapshot,
+                                    SnapshotKind kind,
+                                    const gchar *cursor);
+gboolean   snapshot_is_active      (Snapshot *snapshot,
+                                    SnapshotKind kind,
+                                    const gchar *object_path);
+
+Snapshot * snapshot_acquire (Snapshot **location);
+void       snapshot_publish (Snapshot **location,
+                             Snapshot *snapshot);
+
+G_END_DECLS
+
+#endif /* LOOM_SNAPSHOT_H */
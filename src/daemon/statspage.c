@@ -0,0 +1,384 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/link.h>
+
+#include "daemon.h"
+#include "interfaces.h"
+#include "loom-stats.h"
+#include "nlio.h"
+#include "statspage.h"
+
+/**
+ * SECTION: StatsPage
+ * @title: StatsPage
+ * @short_description: Shared memory stats page.
+ *
+ * Publishes the link state and counters of the managed interfaces in a
+ * file laid out as described in loom-stats.h, for readers mapping it with
+ * mmap(). A periodic job dumps the links and rewrites the slots under
+ * their sequence locks; the daemon is the only writer.
+ */
+
+/* Default update period in milli-seconds. */
+#define STATS_INTERVAL 1000
+
+/* Default number of interface slots. */
+#define MAX_INTERFACES 256
+
+struct _StatsPage
+{
+  Daemon *daemon;
+  gchar *path;
+
+  gsize size;
+  LoomStatsHeader *header;
+
+  /* ifindex to slot index + 1 */
+  GHashTable *slots;
+  gboolean full;
+
+  struct nl_sock *sock;
+  guint job_id;
+};
+
+static LoomStatsInterface *
+get_slot (StatsPage *page,
+          guint index)
+{
+  return (LoomStatsInterface *) loom_stats_get_interface (page->header, index);
+}
+
+/* The sequence is odd while the slot is written; the fence keeps the
+ * writes of the fields behind the odd sequence. */
+static void
+slot_begin (LoomStatsInterface *slot)
+{
+  __atomic_store_n (&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static void
+slot_end (LoomStatsInterface *slot)
+{
+  __atomic_store_n (&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+static LoomStatsInterface *
+lookup_slot (StatsPage *page,
+             gint ifindex)
+{
+  LoomStatsHeader *header = page->header;
+  guint index;
+
+  index = GPOINTER_TO_UINT (g_hash_table_lookup (page->slots,
+                                                 GINT_TO_POINTER (ifindex)));
+  if (index > 0)
+    return get_slot (page, index - 1);
+
+  for (index = 0; index < header->n_interfaces; index++)
+    {
+      if (get_slot (page, index)->ifindex == 0)
+        break;
+    }
+
+  if (index == header->max_interfaces)
+    {
+      if (!page->full)
+        g_warning (_("Stats page %s is full, increase MaxInterfaces."),
+                   page->path);
+      page->full = TRUE;
+      return NULL;
+    }
+
+  if (index == header->n_interfaces)
+    __atomic_store_n (&header->n_interfaces, index + 1, __ATOMIC_RELEASE);
+
+  g_hash_table_insert (page->slots, GINT_TO_POINTER (ifindex),
+                       GUINT_TO_POINTER (index + 1));
+
+  return get_slot (page, index);
+}
+
+static void
+write_slot (LoomStatsInterface *slot,
+            struct rtnl_link *link,
+            guint64 now)
+{
+  guint flags = 0;
+
+  if (rtnl_link_get_flags (link) & IFF_UP)
+    flags |= LOOM_STATS_UP;
+  if (rtnl_link_get_carrier (link))
+    flags |= LOOM_STATS_CARRIER;
+
+  slot_begin (slot);
+  slot->ifindex = rtnl_link_get_ifindex (link);
+  g_strlcpy (slot->name, rtnl_link_get_name (link), sizeof (slot->name));
+  slot->flags = flags;
+  slot->mtu = rtnl_link_get_mtu (link);
+  slot->rx_bytes = rtnl_link_get_stat (link, RTNL_LINK_RX_BYTES);
+  slot->tx_bytes = rtnl_link_get_stat (link, RTNL_LINK_TX_BYTES);
+  slot->rx_packets = rtnl_link_get_stat (link, RTNL_LINK_RX_PACKETS);
+  slot->tx_packets = rtnl_link_get_stat (link, RTNL_LINK_TX_PACKETS);
+  slot->rx_errors = rtnl_link_get_stat (link, RTNL_LINK_RX_ERRORS);
+  slot->tx_errors = rtnl_link_get_stat (link, RTNL_LINK_TX_ERRORS);
+  slot->rx_dropped = rtnl_link_get_stat (link, RTNL_LINK_RX_DROPPED);
+  slot->tx_dropped = rtnl_link_get_stat (link, RTNL_LINK_TX_DROPPED);
+  slot->updated = now;
+  slot_end (slot);
+}
+
+static void
+clear_slot (LoomStatsInterface *slot)
+{
+  guint32 seq = slot->seq;
+
+  slot_begin (slot);
+  memset ((guint8 *) slot + sizeof (seq), 0,
+          sizeof (LoomStatsInterface) - sizeof (seq));
+  slot_end (slot);
+}
+
+static gboolean
+on_update_job (gpointer user_data)
+{
+  StatsPage *page = user_data;
+  Interfaces *interfaces = daemon_get_interfaces (page->daemon);
+  struct nl_cache *cache = NULL;
+  struct nl_object *object;
+  guint64 now;
+  gint err;
+
+  err = nlio_link_alloc_cache (page->sock, &cache);
+  if (err != 0)
+    {
+      g_warning (_("Error getting link cache from kernel: %s"),
+                 nl_geterror (err));
+      return TRUE;
+    }
+
+  now = g_get_monotonic_time ();
+
+  for (object = nl_cache_get_first (cache); object != NULL;
+       object = nl_cache_get_next (object))
+    {
+      struct rtnl_link *link = (struct rtnl_link *) object;
+      LoomStatsInterface *slot;
+
+      if (!interfaces_is_managed (interfaces, rtnl_link_get_ifindex (link)))
+        continue;
+
+      slot = lookup_slot (page, rtnl_link_get_ifindex (link));
+      if (slot != NULL)
+        write_slot (slot, link, now);
+    }
+
+  /* slots not written are of links gone or no longer managed */
+  for (guint i = 0; i < page->header->n_interfaces; i++)
+    {
+      LoomStatsInterface *slot = get_slot (page, i);
+
+      if (slot->ifindex != 0 && slot->updated != now)
+        {
+          g_hash_table_remove (page->slots, GINT_TO_POINTER (slot->ifindex));
+          clear_slot (slot);
+          page->full = FALSE;
+        }
+    }
+
+  __atomic_store_n (&page->header->updated, now, __ATOMIC_RELEASE);
+
+  nl_cache_free (cache);
+
+  /* counters always move, keep the period */
+  return TRUE;
+}
+
+/* Creates the file under a temporary name and moves it in place once the
+ * header is initialized, readers never see a partial header. */
+static gboolean
+create_page (StatsPage *page,
+             guint max_interfaces,
+             guint interval)
+{
+  gs_free gchar *tmp_path = NULL;
+  gs_free gchar *dirname = NULL;
+  LoomStatsHeader *header;
+  gpointer data;
+  gint fd;
+
+  dirname = g_path_get_dirname (page->path);
+  if (g_mkdir_with_parents (dirname, 0755) != 0)
+    g_warning (_("Failed to create directory %s: %s"),
+               dirname, g_strerror (errno));
+
+  page->size = sizeof (LoomStatsHeader) +
+               max_interfaces * sizeof (LoomStatsInterface);
+
+  tmp_path = g_strconcat (page->path, ".tmp", NULL);
+  fd = g_open (tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    {
+      g_warning (_("Failed to create stats page %s: %s"),
+                 tmp_path, g_strerror (errno));
+      return FALSE;
+    }
+
+  if (fchmod (fd, 0644) != 0 || ftruncate (fd, page->size) != 0)
+    {
+      g_warning (_("Failed to create stats page %s: %s"),
+                 tmp_path, g_strerror (errno));
+      close (fd);
+      g_unlink (tmp_path);
+      return FALSE;
+    }
+
+  data = mmap (NULL, page->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      g_warning (_("Failed to map stats page %s: %s"),
+                 tmp_path, g_strerror (errno));
+      g_unlink (tmp_path);
+      return FALSE;
+    }
+
+  header = data;
+  header->magic = LOOM_STATS_MAGIC;
+  header->version = LOOM_STATS_VERSION;
+  header->header_size = sizeof (LoomStatsHeader);
+  header->interface_size = sizeof (LoomStatsInterface);
+  header->max_interfaces = max_interfaces;
+  header->n_interfaces = 0;
+  header->pid = getpid ();
+  header->interval = interval;
+  header->updated = 0;
+
+  if (g_rename (tmp_path, page->path) != 0)
+    {
+      g_warning (_("Failed to create stats page %s: %s"),
+                 page->path, g_strerror (errno));
+      munmap (data, page->size);
+      g_unlink (tmp_path);
+      return FALSE;
+    }
+
+  page->header = header;
+
+  return TRUE;
+}
+
+/**
+ * stats_page_new:
+ * @daemon: A #Daemon.
+ * @path: Path of the stats page file.
+ *
+ * Creates a new #StatsPage publishing the counters of the managed
+ * interfaces at @path, replacing a file left there. The number of slots
+ * and the update period are taken from the [Stats] section of the
+ * configuration.
+ *
+ * Returns: A new #StatsPage or %NULL if the file could not be created.
+ * Free with stats_page_free().
+ */
+StatsPage *
+stats_page_new (Daemon *daemon,
+                const gchar *path)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  StatsPage *page;
+  guint max_interfaces;
+  guint interval;
+
+  max_interfaces = CLAMP (daemon_config_get_integer (daemon, "Stats",
+                                                     "MaxInterfaces",
+                                                     MAX_INTERFACES),
+                          1, 65536);
+  interval = MAX (daemon_config_get_integer (daemon, "Stats", "Interval",
+                                             STATS_INTERVAL), 1);
+
+  page = g_slice_new0 (StatsPage);
+  page->daemon = daemon;
+  page->path = g_strdup (path);
+
+  if (!create_page (page, max_interfaces, interval))
+    {
+      stats_page_free (page);
+      return NULL;
+    }
+
+  page->slots = g_hash_table_new (g_direct_hash, g_direct_equal);
+  page->sock = nlio_socket_new ();
+
+  on_update_job (page);
+  page->job_id = scheduler_add (daemon_get_scheduler (daemon), "stats-page",
+                                interval, interval, 0,
+                                on_update_job, page, NULL);
+
+  return page;
+}
+
+/**
+ * stats_page_free:
+ * @page: A #StatsPage.
+ *
+ * Stops updating, removes the stats page file and frees @page.
+ */
+void
+stats_page_free (StatsPage *page)
+{
+  if (page == NULL)
+    return;
+
+  if (page->job_id > 0)
+    scheduler_remove (daemon_get_scheduler (page->daemon), page->job_id);
+
+  if (page->header != NULL)
+    {
+      g_unlink (page->path);
+      munmap (page->header, page->size);
+    }
+
+  if (page->sock != NULL)
+    nl_socket_free (page->sock);
+  if (page->slots != NULL)
+    g_hash_table_unref (page->slots);
+  g_free (page->path);
+  g_slice_free (StatsPage, page);
+}
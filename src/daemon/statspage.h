@@ -0,0 +1,35 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_STATSPAGE_H
+#define LOOM_STATSPAGE_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _StatsPage StatsPage;
+
+StatsPage * stats_page_new  (Daemon *daemon,
+                             const gchar *path);
+void        stats_page_free (StatsPage *page);
+
+G_END_DECLS
+
+#endif /* LOOM_STATSPAGE_H */
@@ -0,0 +1,412 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+
+#include "interface.h"
+#include "subscriptions.h"
+
+/**
+ * SECTION: Subscriptions
+ * @title: Subscriptions
+ * @short_description: Client-scoped change subscriptions.
+ *
+ * Clients register interest in specific objects and kinds of changes.
+ * Matching changes are sent as unicast Event signals to the subscribed
+ * clients only. The subscriptions of a client are dropped as soon as it
+ * vanishes from the bus.
+ */
+
+/* Maximum number of subscriptions per client. */
+#define MAX_SUBSCRIPTIONS 32
+
+#define ALL_KINDS (CHANGE_KIND_LINK | CHANGE_KIND_ADDRESS | \
+                   CHANGE_KIND_SETTING | CHANGE_KIND_CONNECTION)
+
+typedef struct _Subscriber Subscriber;
+
+typedef struct
+{
+  guint id;
+  Subscriber *subscriber;
+  guint kinds;
+  GHashTable *object_paths;
+} Subscription;
+
+struct _Subscriber
+{
+  Subscriptions *subscriptions;
+  gchar *name;
+  guint watch_id;
+  GList *subscriptions_list;
+};
+
+struct _Subscriptions
+{
+  GDBusConnection *connection;
+  gchar *object_path;
+  gchar *interface_name;
+
+  GHashTable *subscribers;
+  GHashTable *by_id;
+  guint next_id;
+};
+
+static void
+subscription_free (Subscription *subscription)
+{
+  if (subscription->object_paths != NULL)
+    g_hash_table_unref (subscription->object_paths);
+  g_slice_free (Subscription, subscription);
+}
+
+static void
+subscriber_free (Subscriber *subscriber)
+{
+  Subscriptions *subscriptions = subscriber->subscriptions;
+
+  for (GList *l = subscriber->subscriptions_list; l != NULL; l = l->next)
+    {
+      Subscription *subscription = l->data;
+
+      g_hash_table_remove (subscriptions->by_id,
+                           GUINT_TO_POINTER (subscription->id));
+      subscription_free (subscription);
+    }
+  g_list_free (subscriber->subscriptions_list);
+
+  if (subscriber->watch_id > 0)
+    g_bus_unwatch_name (subscriber->watch_id);
+  g_free (subscriber->name);
+  g_slice_free (Subscriber, subscriber);
+}
+
+static void
+on_name_vanished (GDBusConnection *connection,
+                  const gchar *name,
+                  gpointer user_data)
+{
+  Subscriber *subscriber = user_data;
+
+  g_debug ("Dropping subscriptions of vanished client %s", name);
+  g_hash_table_remove (subscriber->subscriptions->subscribers, name);
+}
+
+/**
+ * subscriptions_new:
+ * @connection: The #GDBusConnection to send events on.
+ * @object_path: The object-path events are emitted from.
+ * @interface_name: The D-Bus interface of the Event signal.
+ *
+ * Creates a new, empty subscription registry.
+ *
+ * Returns: A new #Subscriptions. Free with subscriptions_free().
+ */
+Subscriptions *
+subscriptions_new (GDBusConnection *connection,
+                   const gchar *object_path,
+                   const gchar *interface_name)
+{
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
+
+  Subscriptions *subscriptions;
+
+  subscriptions = g_slice_new0 (Subscriptions);
+  subscriptions->connection = g_object_ref (connection);
+  subscriptions->object_path = g_strdup (object_path);
+  subscriptions->interface_name = g_strdup (interface_name);
+  subscriptions->subscribers =
+    g_hash_table_new_full (g_str_hash, g_str_equal,
+                           NULL, (GDestroyNotify) subscriber_free);
+  subscriptions->by_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+  subscriptions->next_id = 1;
+
+  return subscriptions;
+}
+
+/**
+ * subscriptions_free:
+ * @subscriptions: A #Subscriptions.
+ *
+ * Drops all subscriptions and frees @subscriptions.
+ */
+void
+subscriptions_free (Subscriptions *subscriptions)
+{
+  if (subscriptions == NULL)
+    return;
+
+  g_hash_table_unref (subscriptions->subscribers);
+  g_hash_table_unref (subscriptions->by_id);
+  g_object_unref (subscriptions->connection);
+  g_free (subscriptions->object_path);
+  g_free (subscriptions->interface_name);
+  g_slice_free (Subscriptions, subscriptions);
+}
+
+static gboolean
+parse_filter (GVariant *filter,
+              guint *kinds,
+              GHashTable **object_paths,
+              GError **error)
+{
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  *kinds = ALL_KINDS;
+  *object_paths = NULL;
+
+  g_variant_iter_init (&iter, filter);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      gs_free const gchar **strv = NULL;
+
+      if (g_str_equal (key, "kinds") &&
+          g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+        {
+          *kinds = g_variant_get_uint32 (value) & ALL_KINDS;
+        }
+      else if (g_str_equal (key, "objects") &&
+               g_variant_is_of_type (value, G_VARIANT_TYPE_OBJECT_PATH_ARRAY))
+        {
+          strv = g_variant_get_objv (value, NULL);
+          if (*object_paths == NULL)
+            *object_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+          for (guint i = 0; strv[i] != NULL; i++)
+            g_hash_table_add (*object_paths, g_strdup (strv[i]));
+        }
+      else if (g_str_equal (key, "interfaces") &&
+               g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
+        {
+          strv = g_variant_get_strv (value, NULL);
+          if (*object_paths == NULL)
+            *object_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+          for (guint i = 0; strv[i] != NULL; i++)
+            g_hash_table_add (*object_paths,
+                              interface_build_object_path (strv[i]));
+        }
+      else
+        {
+          g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                       _("invalid filter entry '%s'"), key);
+          g_variant_unref (value);
+          if (*object_paths != NULL)
+            g_clear_pointer (object_paths, g_hash_table_unref);
+          return FALSE;
+        }
+
+      g_variant_unref (value);
+    }
+
+  if (*kinds == 0)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   _("'kinds' entry must select at least one kind"));
+      if (*object_paths != NULL)
+        g_clear_pointer (object_paths, g_hash_table_unref);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * subscriptions_add:
+ * @subscriptions: A #Subscriptions.
+ * @sender: Unique bus name of the subscribing client.
+ * @filter: A #GVariant of type a{sv} selecting the changes.
+ * @error: Return location for error or %NULL.
+ *
+ * Adds a subscription for @sender. The filter may contain "kinds", a
+ * mask of #ChangeKind values, "objects", an array of object-paths, and
+ * "interfaces", an array of network interface names. Without objects or
+ * interfaces changes of all objects match.
+ *
+ * Returns: The subscription id or 0 on error.
+ */
+guint
+subscriptions_add (Subscriptions *subscriptions,
+                   const gchar *sender,
+                   GVariant *filter,
+                   GError **error)
+{
+  g_return_val_if_fail (subscriptions != NULL, 0);
+  g_return_val_if_fail (filter != NULL, 0);
+
+  Subscriber *subscriber;
+  Subscription *subscription;
+  GHashTable *object_paths;
+  guint kinds;
+
+  if (sender == NULL)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+                   _("subscriptions require a message bus"));
+      return 0;
+    }
+
+  if (!parse_filter (filter, &kinds, &object_paths, error))
+    return 0;
+
+  subscriber = g_hash_table_lookup (subscriptions->subscribers, sender);
+  if (subscriber == NULL)
+    {
+      subscriber = g_slice_new0 (Subscriber);
+      subscriber->subscriptions = subscriptions;
+      subscriber->name = g_strdup (sender);
+      g_hash_table_insert (subscriptions->subscribers, subscriber->name,
+                           subscriber);
+      subscriber->watch_id =
+        g_bus_watch_name_on_connection (subscriptions->connection, sender,
+                                        G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                        NULL, on_name_vanished,
+                                        subscriber, NULL);
+    }
+  else if (g_list_length (subscriber->subscriptions_list) >= MAX_SUBSCRIPTIONS)
+    {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+                   _("too many subscriptions"));
+      if (object_paths != NULL)
+        g_hash_table_unref (object_paths);
+      return 0;
+    }
+
+  subscription = g_slice_new0 (Subscription);
+  subscription->id = subscriptions->next_id++;
+  subscription->subscriber = subscriber;
+  subscription->kinds = kinds;
+  subscription->object_paths = object_paths;
+
+  subscriber->subscriptions_list =
+    g_list_prepend (subscriber->subscriptions_list, subscription);
+  g_hash_table_insert (subscriptions->by_id,
+                       GUINT_TO_POINTER (subscription->id), subscription);
+
+  return subscription->id;
+}
+
+/**
+ * subscriptions_remove:
+ * @subscriptions: A #Subscriptions.
+ * @sender: Unique bus name of the client.
+ * @id: A subscription id returned by subscriptions_add().
+ *
+ * Removes a subscription of @sender.
+ *
+ * Returns: %TRUE if the subscription was found and removed.
+ */
+gboolean
+subscriptions_remove (Subscriptions *subscriptions,
+                      const gchar *sender,
+                      guint id)
+{
+  g_return_val_if_fail (subscriptions != NULL, FALSE);
+
+  Subscription *subscription;
+  Subscriber *subscriber;
+
+  subscription = g_hash_table_lookup (subscriptions->by_id,
+                                      GUINT_TO_POINTER (id));
+  if (subscription == NULL ||
+      g_strcmp0 (subscription->subscriber->name, sender) != 0)
+    return FALSE;
+
+  subscriber = subscription->subscriber;
+  g_hash_table_remove (subscriptions->by_id, GUINT_TO_POINTER (id));
+  subscriber->subscriptions_list =
+    g_list_remove (subscriber->subscriptions_list, subscription);
+  subscription_free (subscription);
+
+  if (subscriber->subscriptions_list == NULL)
+    g_hash_table_remove (subscriptions->subscribers, subscriber->name);
+
+  return TRUE;
+}
+
+static gboolean
+subscription_matches (Subscription *subscription,
+                      ChangeKind kind,
+                      const gchar *object_path)
+{
+  if ((subscription->kinds & kind) == 0)
+    return FALSE;
+
+  return subscription->object_paths == NULL ||
+         g_hash_table_contains (subscription->object_paths, object_path);
+}
+
+/**
+ * subscriptions_dispatch:
+ * @subscriptions: A #Subscriptions.
+ * @sequence: The journal sequence number of the change.
+ * @kind: The kind of change.
+ * @op: The operation.
+ * @object_path: The object-path of the changed object.
+ *
+ * Sends an Event signal to every client with a matching subscription. A
+ * client receives a change only once, with the id of its first matching
+ * subscription.
+ */
+void
+subscriptions_dispatch (Subscriptions *subscriptions,
+                        guint64 sequence,
+                        ChangeKind kind,
+                        ChangeOp op,
+                        const gchar *object_path)
+{
+  g_return_if_fail (subscriptions != NULL);
+
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, subscriptions->subscribers);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Subscriber *subscriber = value;
+
+      for (GList *l = subscriber->subscriptions_list; l != NULL; l = l->next)
+        {
+          Subscription *subscription = l->data;
+
+          if (!subscription_matches (subscription, kind, object_path))
+            continue;
+
+          g_dbus_connection_emit_signal (subscriptions->connection,
+                                         subscriber->name,
+                                         subscriptions->object_path,
+                                         subscriptions->interface_name,
+                                         "Event",
+                                         g_variant_new ("(utuuo)",
+                                                        subscription->id,
+                                                        sequence,
+                                                        (guint32) kind,
+                                                        (guint32) op,
+                                                        object_path),
+                                         NULL);
+          break;
+        }
+    }
+}
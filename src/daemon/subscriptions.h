@@ -0,0 +1,50 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_SUBSCRIPTIONS_H
+#define LOOM_SUBSCRIPTIONS_H
+
+#include "types.h"
+#include "journal.h"
+
+G_BEGIN_DECLS
+
+typedef struct _Subscriptions Subscriptions;
+
+Subscriptions * subscriptions_new  (GDBusConnection *connection,
+                                    const gchar *object_path,
+                                    const gchar *interface_name);
+void            subscriptions_free (Subscriptions *subscriptions);
+
+guint    subscriptions_add      (Subscriptions *subscriptions,
+                                 const gchar *sender,
+                                 GVariant *filter,
+                                 GError **error);
+gboolean subscriptions_remove   (Subscriptions *subscriptions,
+                                 const gchar *sender,
+                                 guint id);
+void     subscriptions_dispatch (Subscriptions *subscriptions,
+                                 guint64 sequence,
+                                 ChangeKind kind,
+                                 ChangeOp op,
+                                 const gchar *object_path);
+
+G_END_DECLS
+
+#endif /* LOOM_SUBSCRIPTIONS_H */
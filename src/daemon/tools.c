@@ -27,6 +27,8 @@
 #include <netlink/socket.h>
 #include <netlink/route/route.h>
 
+#include "nlio.h"
+#include "probes.h"
 #include "tools.h"
 
 void
@@ -37,9 +39,9 @@ tools_add_router_address (const gchar *address)
   struct nl_addr *gw = NULL;
   struct rtnl_nexthop *nhop = NULL;
   struct rtnl_route *route = NULL;
+  gint err;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
   nhop = rtnl_route_nh_alloc ();
   nl_addr_parse (address, AF_INET, &gw);
@@ -51,8 +53,9 @@ tools_add_router_address (const gchar *address)
   nl_addr_parse ("default", AF_INET, &dst);
   rtnl_route_add_nexthop (route, nhop);
 
-  if (rtnl_route_add (sock, route, NLM_F_CREATE | NLM_F_REPLACE) != 0)
-    g_warning (_("Failed to add default route."));
+  err = nlio_route_add (sock, route, NLM_F_CREATE | NLM_F_REPLACE);
+  if (err != 0)
+    g_warning (_("Failed to add default route: %s"), nl_geterror (err));
 
   nl_socket_free (sock);
   rtnl_route_put (route);
@@ -68,9 +71,9 @@ tools_delete_router_address (const gchar *address)
   struct nl_addr *gw = NULL;
   struct rtnl_nexthop *nhop = NULL;
   struct rtnl_route *route = NULL;
+  gint err;
 
-  sock = nl_socket_alloc ();
-  nl_connect (sock, NETLINK_ROUTE);
+  sock = nlio_socket_new ();
 
   nhop = rtnl_route_nh_alloc ();
   nl_addr_parse (address, AF_INET, &gw);
@@ -82,8 +85,9 @@ tools_delete_router_address (const gchar *address)
   nl_addr_parse ("default", AF_INET, &dst);
   rtnl_route_add_nexthop (route, nhop);
 
-  if (rtnl_route_delete (sock, route, NLM_F_CREATE | NLM_F_REPLACE) != 0)
-    g_warning (_("Failed to delete default route."));
+  err = nlio_route_delete (sock, route, NLM_F_CREATE | NLM_F_REPLACE);
+  if (err != 0)
+    g_warning (_("Failed to delete default route: %s"), nl_geterror (err));
 
   nl_socket_free (sock);
   rtnl_route_put (route);
@@ -100,7 +104,10 @@ void tools_write_resolver_configuration (const gchar * const *nameservers,
   GString * resolv_conf;
   GDateTime *now;
   gchar *_now = NULL;
-  GError *error;
+  GError *error = NULL;
+  gint64 start;
+
+  start = LOOM_PROBE_NOW ();
 
   now = g_date_time_new_now_local ();
   _now = g_date_time_format (now, "%F %T");
@@ -129,6 +136,14 @@ void tools_write_resolver_configuration (const gchar * const *nameservers,
     }
 
   g_file_set_contents ("/etc/resolv.conf", resolv_conf->str, -1, &error);
+  LOOM_PROBE2 (resolver__write, error != NULL ? -1 : 0,
+               LOOM_PROBE_NOW () - start);
+  if (error != NULL)
+    {
+      g_warning (_("Failed to write resolver configuration: %s"),
+                 error->message);
+      g_error_free (error);
+    }
 
   g_string_free (resolv_conf, TRUE);
 }
@@ -137,5 +152,18 @@ void tools_erase_resolver_configuration (const gchar * const *nameservers,
                                          const gchar *domain,
                                          const gchar * const *searches)
 {
-  g_file_set_contents ("/etc/resolv.conf", "", 1, NULL);
+  GError *error = NULL;
+  gint64 start;
+
+  start = LOOM_PROBE_NOW ();
+
+  g_file_set_contents ("/etc/resolv.conf", "", 1, &error);
+  LOOM_PROBE2 (resolver__write, error != NULL ? -1 : 0,
+               LOOM_PROBE_NOW () - start);
+  if (error != NULL)
+    {
+      g_warning (_("Failed to erase resolver configuration: %s"),
+                 error->message);
+      g_error_free (error);
+    }
 }
@@ -29,6 +29,12 @@
 struct _Daemon;
 typedef struct _Daemon Daemon;
 
+struct _Manager;
+typedef struct _Manager Manager;
+
+struct _Metrics;
+typedef struct _Metrics Metrics;
+
 struct _Interfaces;
 typedef struct _Interfaces Interfaces;
 
@@ -0,0 +1,417 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+
+#include "waiters.h"
+
+/**
+ * SECTION: Waiters
+ * @title: Waiters
+ * @short_description: Deferred completion of wait requests.
+ *
+ * Holds method invocations waiting for a condition on a property of an
+ * exported object. The conditions of an object are evaluated whenever it
+ * changes, the invocation is completed as soon as its condition is met, the
+ * object is removed or the timeout expires.
+ *
+ * A condition is the name of a property, optionally prefixed by '!', for
+ * boolean properties or NAME=VALUE. VALUE is compared to string properties,
+ * looked up in string array properties and compared to the printed value of
+ * other properties.
+ */
+
+/* Default and maximum wait timeout in milli-seconds. */
+#define DEFAULT_TIMEOUT 30000
+#define MAX_TIMEOUT     600000
+
+typedef struct
+{
+  Waiters *waiters;
+  GDBusMethodInvocation *invocation;
+  gchar *object_path;
+  gchar *property;
+  gchar *value;
+  gboolean negate;
+  gint64 start;
+  guint timeout_id;
+} Waiter;
+
+struct _Waiters
+{
+  GDBusObjectManager *object_manager;
+  GHashTable *by_path;
+};
+
+static void
+waiter_free (Waiter *waiter)
+{
+  if (waiter->timeout_id > 0)
+    g_source_remove (waiter->timeout_id);
+  g_free (waiter->object_path);
+  g_free (waiter->property);
+  g_free (waiter->value);
+  g_slice_free (Waiter, waiter);
+}
+
+static void
+waiter_remove (Waiter *waiter)
+{
+  Waiters *waiters = waiter->waiters;
+  GQueue *queue;
+
+  queue = g_hash_table_lookup (waiters->by_path, waiter->object_path);
+  g_queue_remove (queue, waiter);
+  if (g_queue_is_empty (queue))
+    {
+      g_hash_table_remove (waiters->by_path, waiter->object_path);
+      g_queue_free (queue);
+    }
+
+  waiter_free (waiter);
+}
+
+/* Looks up @property on any interface of the object at @object_path. */
+static GVariant *
+lookup_property (Waiters *waiters,
+                 const gchar *object_path,
+                 const gchar *property,
+                 gboolean *exists)
+{
+  gs_unref_object GDBusObject *object = NULL;
+  GList *interfaces;
+  GVariant *value = NULL;
+
+  object = g_dbus_object_manager_get_object (waiters->object_manager,
+                                             object_path);
+  *exists = object != NULL;
+  if (object == NULL)
+    return NULL;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (GList *l = interfaces; l != NULL && value == NULL; l = l->next)
+    {
+      GVariant *properties;
+
+      properties =
+        g_dbus_interface_skeleton_get_properties (G_DBUS_INTERFACE_SKELETON (l->data));
+      value = g_variant_lookup_value (properties, property, NULL);
+      g_variant_unref (properties);
+    }
+  g_list_free_full (interfaces, g_object_unref);
+
+  return value;
+}
+
+static gboolean
+evaluate (Waiter *waiter,
+          GVariant *value)
+{
+  gboolean met;
+
+  if (waiter->value == NULL)
+    {
+      met = g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN) &&
+            g_variant_get_boolean (value);
+    }
+  else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING) ||
+           g_variant_is_of_type (value, G_VARIANT_TYPE_OBJECT_PATH))
+    {
+      met = g_str_equal (g_variant_get_string (value, NULL), waiter->value);
+    }
+  else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY) ||
+           g_variant_is_of_type (value, G_VARIANT_TYPE_OBJECT_PATH_ARRAY))
+    {
+      GVariantIter iter;
+      const gchar *item;
+
+      met = FALSE;
+      g_variant_iter_init (&iter, value);
+      while (!met && g_variant_iter_next (&iter, "&s", &item))
+        met = g_str_equal (item, waiter->value);
+    }
+  else
+    {
+      gs_free gchar *printed = g_variant_print (value, FALSE);
+      met = g_str_equal (printed, waiter->value);
+    }
+
+  return met != waiter->negate;
+}
+
+static void
+complete (Waiter *waiter)
+{
+  g_dbus_method_invocation_return_value (waiter->invocation,
+                          g_variant_new ("(t)",
+                                         (guint64) (g_get_monotonic_time () -
+                                                    waiter->start) / 1000));
+  waiter_remove (waiter);
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+  Waiter *waiter = user_data;
+
+  waiter->timeout_id = 0;
+  g_dbus_method_invocation_return_error (waiter->invocation,
+                                         G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT,
+                                         _("condition not met in time"));
+  waiter_remove (waiter);
+
+  return FALSE;
+}
+
+/**
+ * waiters_new:
+ * @object_manager: The #GDBusObjectManager exporting the objects waited on.
+ *
+ * Creates a new, empty #Waiters.
+ *
+ * Returns: A new #Waiters. Free with waiters_free().
+ */
+Waiters *
+waiters_new (GDBusObjectManager *object_manager)
+{
+  Waiters *waiters;
+
+  waiters = g_slice_new0 (Waiters);
+  waiters->object_manager = object_manager;
+  waiters->by_path = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, NULL);
+
+  return waiters;
+}
+
+/**
+ * waiters_free:
+ * @waiters: A #Waiters.
+ *
+ * Fails all pending invocations and frees @waiters.
+ */
+void
+waiters_free (Waiters *waiters)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  if (waiters == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, waiters->by_path);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GQueue *queue = value;
+      Waiter *waiter;
+
+      while ((waiter = g_queue_pop_head (queue)) != NULL)
+        {
+          g_dbus_method_invocation_return_error (waiter->invocation,
+                                                 G_DBUS_ERROR,
+                                                 G_DBUS_ERROR_FAILED,
+                                                 _("daemon shutting down"));
+          waiter_free (waiter);
+        }
+      g_queue_free (queue);
+    }
+  g_hash_table_unref (waiters->by_path);
+
+  g_slice_free (Waiters, waiters);
+}
+
+/**
+ * waiters_add:
+ * @waiters: A #Waiters.
+ * @invocation: (transfer full): The invocation to complete.
+ * @object_path: Object-path of the object to wait on.
+ * @condition: The condition to wait for.
+ * @timeout_msec: Timeout in milli-seconds, 0 for the default.
+ *
+ * Completes @invocation with the milli-seconds waited once @condition is
+ * met, immediately if it already is. Fails @invocation if the object does
+ * not exist or is removed, the condition is invalid or the timeout
+ * expires.
+ */
+void
+waiters_add (Waiters *waiters,
+             GDBusMethodInvocation *invocation,
+             const gchar *object_path,
+             const gchar *condition,
+             guint timeout_msec)
+{
+  g_return_if_fail (waiters != NULL);
+
+  Waiter *waiter;
+  GVariant *value;
+  GQueue *queue;
+  const gchar *separator;
+  gboolean exists;
+
+  waiter = g_slice_new0 (Waiter);
+  waiter->waiters = waiters;
+  waiter->invocation = invocation;
+  waiter->object_path = g_strdup (object_path);
+  waiter->start = g_get_monotonic_time ();
+
+  separator = strchr (condition, '=');
+  if (separator != NULL)
+    {
+      waiter->property = g_strndup (condition, separator - condition);
+      waiter->value = g_strdup (separator + 1);
+    }
+  else
+    {
+      waiter->negate = condition[0] == '!';
+      waiter->property = g_strdup (condition + (waiter->negate ? 1 : 0));
+    }
+
+  value = lookup_property (waiters, object_path, waiter->property, &exists);
+  if (!exists)
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                             _("no such object found"));
+      waiter_free (waiter);
+      return;
+    }
+  if (value == NULL ||
+      (waiter->value == NULL &&
+       !g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN)))
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_INVALID_ARGS,
+                               _("'condition' must name a boolean property "
+                                 "or compare a property to a value"));
+      if (value != NULL)
+        g_variant_unref (value);
+      waiter_free (waiter);
+      return;
+    }
+
+  queue = g_hash_table_lookup (waiters->by_path, waiter->object_path);
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (waiters->by_path, g_strdup (object_path), queue);
+    }
+  g_queue_push_tail (queue, waiter);
+
+  if (evaluate (waiter, value))
+    {
+      g_variant_unref (value);
+      complete (waiter);
+      return;
+    }
+  g_variant_unref (value);
+
+  if (timeout_msec == 0)
+    timeout_msec = DEFAULT_TIMEOUT;
+  waiter->timeout_id = g_timeout_add (MIN (timeout_msec, MAX_TIMEOUT),
+                                      on_timeout, waiter);
+}
+
+/**
+ * waiters_check:
+ * @waiters: A #Waiters.
+ * @object_path: Object-path of a changed object.
+ *
+ * Evaluates the conditions waited for on the object at @object_path and
+ * completes the invocations whose condition is met.
+ */
+void
+waiters_check (Waiters *waiters,
+               const gchar *object_path)
+{
+  g_return_if_fail (waiters != NULL);
+
+  GQueue *queue;
+  GList *link;
+
+  queue = g_hash_table_lookup (waiters->by_path, object_path);
+  if (queue == NULL)
+    return;
+
+  link = queue->head;
+  while (link != NULL)
+    {
+      Waiter *waiter = link->data;
+      GList *next = link->next;
+      GVariant *value;
+      gboolean exists;
+
+      value = lookup_property (waiters, object_path, waiter->property,
+                               &exists);
+      if (value != NULL)
+        {
+          gboolean met = evaluate (waiter, value);
+
+          g_variant_unref (value);
+          if (met)
+            {
+              /* the queue is freed along with its last waiter */
+              gboolean last = queue->length == 1;
+
+              complete (waiter);
+              if (last)
+                return;
+            }
+        }
+
+      link = next;
+    }
+}
+
+/**
+ * waiters_object_removed:
+ * @waiters: A #Waiters.
+ * @object_path: Object-path of a removed object.
+ *
+ * Fails all invocations waiting on the object at @object_path.
+ */
+void
+waiters_object_removed (Waiters *waiters,
+                        const gchar *object_path)
+{
+  g_return_if_fail (waiters != NULL);
+
+  GQueue *queue;
+  Waiter *waiter;
+
+  queue = g_hash_table_lookup (waiters->by_path, object_path);
+  if (queue == NULL)
+    return;
+
+  g_hash_table_remove (waiters->by_path, object_path);
+  while ((waiter = g_queue_pop_head (queue)) != NULL)
+    {
+      g_dbus_method_invocation_return_error (waiter->invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                             _("object was removed"));
+      waiter_free (waiter);
+    }
+  g_queue_free (queue);
+}
@@ -0,0 +1,44 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOM_WAITERS_H
+#define LOOM_WAITERS_H
+
+#include "types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _Waiters Waiters;
+
+Waiters * waiters_new  (GDBusObjectManager *object_manager);
+void      waiters_free (Waiters *waiters);
+
+void waiters_add            (Waiters *waiters,
+                             GDBusMethodInvocation *invocation,
+                             const gchar *object_path,
+                             const gchar *condition,
+                             guint timeout_msec);
+void waiters_check          (Waiters *waiters,
+                             const gchar *object_path);
+void waiters_object_removed (Waiters *waiters,
+                             const gchar *object_path);
+
+G_END_DECLS
+
+#endif /* LOOM_WAITERS_H */
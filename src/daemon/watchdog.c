@@ -0,0 +1,635 @@
+/**
+ * This file is part of Loom.
+ *
+ * Copyright (C) 2014 Tobias Schäfer <tschaefer@blackox.org>.
+ *
+ * Loom is free software: you can redistribute it and*or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Loom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Loom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gsystem-local-alloc.h"
+
+#include <glib/gi18n.h>
+
+#include "daemon.h"
+#include "histogram.h"
+#include "watchdog.h"
+
+/**
+ * SECTION: Watchdog
+ * @title: Watchdog
+ * @short_description: Main loop stall watchdog.
+ *
+ * A heartbeat timeout in the main loop measures how late it is dispatched.
+ * A watchdog thread checks the last heartbeat; once it is overdue by more
+ * than the threshold the main thread is interrupted with a signal, whose
+ * handler records the #GSource being dispatched, the D-Bus method it runs
+ * if any, and optionally a backtrace. The stall ends with the next
+ * heartbeat.
+ *
+ * The handler reads the current source and takes the backtrace with calls
+ * not guaranteed to be async-signal-safe. This is why the watchdog and its
+ * backtraces are disabled by default.
+ *
+ * Each capture is armed with a generation number, which the handler claims
+ * before it writes. A handler running late, after the watchdog thread gave
+ * up waiting, thus never writes into a buffer being reused: the buffer is
+ * only rearmed once the claiming handler is done.
+ *
+ * Stalls are counted and the most recent ones are kept in a ring.
+ */
+
+#define STALL_RING_SIZE 32
+#define BACKTRACE_DEPTH 32
+#define NAME_SIZE       128
+
+#define STALL_SIGNAL    (SIGRTMIN + 1)
+
+typedef struct
+{
+  guint64 seq;
+  gint64 time;
+  gint64 start;
+  gint64 duration;
+  gchar *source;
+  gchar *method;
+  gchar **backtrace;
+} Stall;
+
+struct _Watchdog
+{
+  Daemon *daemon;
+  GThread *main_thread;
+  pthread_t main_pthread;
+
+  gint64 interval;
+  gint64 threshold;
+  gboolean backtraces;
+
+  GSource *heartbeat;
+  GArray *hooks;
+
+  GThread *thread;
+  gboolean quit;
+
+  /* protects everything below */
+  GMutex lock;
+  GCond cond;
+  gint64 last_beat;
+  guint64 beats;
+  guint64 stall_time;
+  Histogram latency;
+  Stall ring[STALL_RING_SIZE];
+  guint64 n_stalls;
+  guint64 stall_seq;
+  Stall *current;
+
+  struct sigaction old_action;
+};
+
+typedef struct
+{
+  guint signal_id;
+  gulong hook_id;
+} Hook;
+
+/* The D-Bus method dispatched last in the main thread and the source
+ * dispatching it. Written by the main thread only. */
+static struct
+{
+  volatile gint writing;
+  GSource *source;
+  gchar method[NAME_SIZE];
+} dispatch;
+
+/* Filled by the signal handler in the main thread, read by the watchdog
+ * thread once done is set to the generation armed. The handler claims the
+ * generation by negating armed. */
+static struct
+{
+  volatile gint armed;
+  volatile gint done;
+  gint generation;
+  gboolean want_backtrace;
+  gboolean has_source;
+  gchar source[NAME_SIZE];
+  gchar method[NAME_SIZE];
+  gpointer frames[BACKTRACE_DEPTH];
+  gint depth;
+} capture;
+
+static GType (*interface_types[]) (void) =
+{
+  loom_manager_get_type,
+  loom_interfaces_get_type,
+  loom_interface_get_type,
+  loom_settings_get_type,
+  loom_setting_get_type,
+  loom_connections_get_type,
+  loom_connection_get_type,
+  loom_metrics_get_type,
+};
+
+static void
+stall_clear (Stall *stall)
+{
+  g_free (stall->source);
+  g_free (stall->method);
+  g_strfreev (stall->backtrace);
+  memset (stall, 0, sizeof (Stall));
+}
+
+/* Runs in the interrupted main thread. The method name was recorded by the
+ * main thread itself, it is only copied here. g_main_current_source() and
+ * g_source_get_name() are not async-signal-safe by contract, though they
+ * only read thread-private and source memory without taking locks.
+ * backtrace() is not either: its first call loads the unwinder and may
+ * allocate, watchdog_new() makes that call up front. */
+static void
+on_stall_signal (gint signum)
+{
+  GSource *source;
+  const gchar *name;
+  gint generation;
+
+  generation = g_atomic_int_get (&capture.armed);
+  if (generation <= 0 ||
+      !g_atomic_int_compare_and_exchange (&capture.armed, generation,
+                                          -generation))
+    return;
+
+  source = g_main_current_source ();
+  capture.has_source = source != NULL;
+  if (source != NULL)
+    {
+      name = g_source_get_name (source);
+      if (name != NULL)
+        g_strlcpy (capture.source, name, NAME_SIZE);
+      if (!dispatch.writing && dispatch.source == source)
+        g_strlcpy (capture.method, dispatch.method, NAME_SIZE);
+    }
+
+  if (capture.want_backtrace)
+    capture.depth = backtrace (capture.frames, BACKTRACE_DEPTH);
+
+  g_atomic_int_set (&capture.done, generation);
+}
+
+static gboolean
+on_method_emission (GSignalInvocationHint *hint,
+                    guint n_param_values,
+                    const GValue *param_values,
+                    gpointer user_data)
+{
+  Watchdog *watchdog = user_data;
+  GDBusMethodInvocation *invocation;
+
+  if (g_thread_self () != watchdog->main_thread ||
+      n_param_values < 2 ||
+      !G_VALUE_HOLDS (&param_values[1], G_TYPE_DBUS_METHOD_INVOCATION))
+    return TRUE;
+
+  invocation = g_value_get_object (&param_values[1]);
+
+  dispatch.writing = TRUE;
+  dispatch.source = g_main_current_source ();
+  g_snprintf (dispatch.method, NAME_SIZE, "%s.%s",
+              g_dbus_method_invocation_get_interface_name (invocation),
+              g_dbus_method_invocation_get_method_name (invocation));
+  dispatch.writing = FALSE;
+
+  return TRUE;
+}
+
+static void
+capture_offender (Watchdog *watchdog,
+                  Stall *stall)
+{
+  gint armed;
+  gint generation;
+
+  /* a handler claimed a previous capture and is still writing */
+  armed = g_atomic_int_get (&capture.armed);
+  if (armed < 0 && g_atomic_int_get (&capture.done) != -armed)
+    return;
+
+  generation = capture.generation = MAX (1, capture.generation + 1);
+  capture.want_backtrace = watchdog->backtraces;
+  capture.has_source = FALSE;
+  capture.source[0] = '\0';
+  capture.method[0] = '\0';
+  capture.depth = 0;
+  g_atomic_int_set (&capture.done, 0);
+  g_atomic_int_set (&capture.armed, generation);
+
+  if (pthread_kill (watchdog->main_pthread, STALL_SIGNAL) != 0)
+    {
+      g_atomic_int_set (&capture.armed, 0);
+      return;
+    }
+
+  for (guint i = 0;
+       i < 100 && g_atomic_int_get (&capture.done) != generation; i++)
+    g_usleep (1000);
+  if (g_atomic_int_get (&capture.done) != generation)
+    {
+      /* disarm, unless the handler claimed it already */
+      g_atomic_int_compare_and_exchange (&capture.armed, generation, 0);
+      return;
+    }
+
+  if (capture.source[0] != '\0')
+    stall->source = g_strdup (capture.source);
+  else if (capture.has_source)
+    stall->source = g_strdup ("(unnamed)");
+
+  if (capture.method[0] != '\0')
+    stall->method = g_strdup (capture.method);
+
+  if (capture.depth > 0)
+    {
+      gchar **symbols;
+
+      symbols = backtrace_symbols (capture.frames, capture.depth);
+      if (symbols != NULL)
+        {
+          stall->backtrace = g_new0 (gchar *, capture.depth + 1);
+          for (gint i = 0; i < capture.depth; i++)
+            stall->backtrace[i] = g_strdup (symbols[i]);
+          free (symbols);
+        }
+    }
+}
+
+static gpointer
+watchdog_thread (gpointer user_data)
+{
+  Watchdog *watchdog = user_data;
+  Stall *stall;
+
+  g_mutex_lock (&watchdog->lock);
+  while (!watchdog->quit)
+    {
+      g_cond_wait_until (&watchdog->cond, &watchdog->lock,
+                         g_get_monotonic_time () + watchdog->interval);
+      if (watchdog->quit || watchdog->current != NULL ||
+          g_get_monotonic_time () - watchdog->last_beat <=
+          watchdog->interval + watchdog->threshold)
+        continue;
+
+      stall = &watchdog->ring[watchdog->n_stalls % STALL_RING_SIZE];
+      stall_clear (stall);
+      stall->seq = ++watchdog->stall_seq;
+      stall->time = g_get_real_time ();
+      stall->start = watchdog->last_beat + watchdog->interval;
+      watchdog->n_stalls++;
+      watchdog->current = stall;
+
+      /* only this thread starts stalls, but watchdog_reset() may move the
+       * stall and the heartbeat may end it while the offender is captured */
+      g_mutex_unlock (&watchdog->lock);
+      {
+        Stall offender = { 0, };
+        guint64 seq = stall->seq;
+
+        capture_offender (watchdog, &offender);
+
+        g_mutex_lock (&watchdog->lock);
+        stall = NULL;
+        for (guint i = 0; i < STALL_RING_SIZE && stall == NULL; i++)
+          if (watchdog->ring[i].seq == seq)
+            stall = &watchdog->ring[i];
+        if (stall != NULL)
+          {
+            stall->source = offender.source;
+            stall->method = offender.method;
+            stall->backtrace = offender.backtrace;
+          }
+        else
+          {
+            stall_clear (&offender);
+          }
+      }
+    }
+  g_mutex_unlock (&watchdog->lock);
+
+  return NULL;
+}
+
+static gboolean
+on_heartbeat (gpointer user_data)
+{
+  Watchdog *watchdog = user_data;
+  gs_free gchar *offender = NULL;
+  gint64 duration = 0;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&watchdog->lock);
+  if (watchdog->last_beat != 0)
+    histogram_record (&watchdog->latency,
+                      MAX (0, now - watchdog->last_beat - watchdog->interval));
+  watchdog->last_beat = now;
+  watchdog->beats++;
+
+  if (watchdog->current != NULL)
+    {
+      Stall *stall = watchdog->current;
+
+      stall->duration = now - stall->start;
+      watchdog->stall_time += stall->duration;
+      watchdog->current = NULL;
+
+      duration = stall->duration;
+      offender = g_strdup (stall->method != NULL ? stall->method :
+                           stall->source != NULL ? stall->source :
+                           _("unknown"));
+    }
+  g_mutex_unlock (&watchdog->lock);
+
+  if (offender != NULL)
+    g_message (_("Main loop stalled for %" G_GINT64_FORMAT " ms in %s."),
+               duration / 1000, offender);
+
+  return TRUE;
+}
+
+static void
+add_hooks (Watchdog *watchdog)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (interface_types); i++)
+    {
+      GType type = interface_types[i] ();
+      gpointer iface;
+      guint *ids;
+      guint n_ids;
+
+      iface = g_type_default_interface_ref (type);
+      ids = g_signal_list_ids (type, &n_ids);
+      for (guint j = 0; j < n_ids; j++)
+        {
+          GSignalQuery query;
+          Hook hook;
+
+          g_signal_query (ids[j], &query);
+          if (!g_str_has_prefix (query.signal_name, "handle-"))
+            continue;
+
+          hook.signal_id = ids[j];
+          hook.hook_id = g_signal_add_emission_hook (ids[j], 0,
+                                                     on_method_emission,
+                                                     watchdog, NULL);
+          g_array_append_val (watchdog->hooks, hook);
+        }
+      g_free (ids);
+      g_type_default_interface_unref (iface);
+    }
+}
+
+/**
+ * watchdog_new:
+ * @daemon: A #Daemon.
+ *
+ * Creates a new #Watchdog for the main loop of the calling thread, which
+ * must be the thread @daemon runs in. The watchdog is configured by the
+ * [Watchdog] section of the configuration; with an interval of 0 it is
+ * inactive and only reports empty metrics.
+ *
+ * Returns: A new #Watchdog. Free with watchdog_free().
+ */
+Watchdog *
+watchdog_new (Daemon *daemon)
+{
+  g_return_val_if_fail (IS_DAEMON (daemon), NULL);
+
+  Watchdog *watchdog;
+  GMainContext *context;
+  struct sigaction action;
+
+  watchdog = g_slice_new0 (Watchdog);
+  watchdog->daemon = daemon;
+  watchdog->main_thread = g_thread_self ();
+  watchdog->main_pthread = pthread_self ();
+  watchdog->hooks = g_array_new (FALSE, FALSE, sizeof (Hook));
+  g_mutex_init (&watchdog->lock);
+  g_cond_init (&watchdog->cond);
+
+  watchdog->interval = 1000 * (gint64) MAX (0,
+    daemon_config_get_integer (daemon, "Watchdog", "Interval", 0));
+  watchdog->threshold = 1000 * (gint64) MAX (0,
+    daemon_config_get_integer (daemon, "Watchdog", "Threshold", 250));
+  watchdog->backtraces = daemon_config_get_boolean (daemon, "Watchdog",
+                                                    "Backtrace", FALSE);
+
+  if (watchdog->interval == 0)
+    return watchdog;
+
+  /* load the unwinder now, not in the signal handler */
+  if (watchdog->backtraces)
+    {
+      gpointer frames[1];
+
+      backtrace (frames, 1);
+    }
+
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = on_stall_signal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset (&action.sa_mask);
+  sigaction (STALL_SIGNAL, &action, &watchdog->old_action);
+
+  add_hooks (watchdog);
+
+  watchdog->last_beat = g_get_monotonic_time ();
+
+  context = g_main_context_ref_thread_default ();
+  watchdog->heartbeat = g_timeout_source_new (watchdog->interval / 1000);
+  g_source_set_name (watchdog->heartbeat, "loom-watchdog-heartbeat");
+  g_source_set_callback (watchdog->heartbeat, on_heartbeat, watchdog, NULL);
+  g_source_attach (watchdog->heartbeat, context);
+  g_main_context_unref (context);
+
+  watchdog->thread = g_thread_new ("watchdog", watchdog_thread, watchdog);
+
+  return watchdog;
+}
+
+/**
+ * watchdog_free:
+ * @watchdog: A #Watchdog.
+ *
+ * Stops the watchdog thread and frees @watchdog.
+ */
+void
+watchdog_free (Watchdog *watchdog)
+{
+  if (watchdog == NULL)
+    return;
+
+  if (watchdog->thread != NULL)
+    {
+      g_mutex_lock (&watchdog->lock);
+      watchdog->quit = TRUE;
+      g_cond_signal (&watchdog->cond);
+      g_mutex_unlock (&watchdog->lock);
+      g_thread_join (watchdog->thread);
+
+      g_source_destroy (watchdog->heartbeat);
+      g_source_unref (watchdog->heartbeat);
+
+      sigaction (STALL_SIGNAL, &watchdog->old_action, NULL);
+    }
+
+  for (guint i = 0; i < watchdog->hooks->len; i++)
+    {
+      Hook *hook = &g_array_index (watchdog->hooks, Hook, i);
+
+      g_signal_remove_emission_hook (hook->signal_id, hook->hook_id);
+    }
+  g_array_unref (watchdog->hooks);
+
+  for (guint i = 0; i < STALL_RING_SIZE; i++)
+    stall_clear (&watchdog->ring[i]);
+
+  g_cond_clear (&watchdog->cond);
+  g_mutex_clear (&watchdog->lock);
+  g_slice_free (Watchdog, watchdog);
+}
+
+/**
+ * watchdog_get_counters:
+ * @watchdog: A #Watchdog.
+ *
+ * Gets the counters of @watchdog: the number of heartbeats, of stalls and
+ * the total time in micro-seconds spent in stalls, as well as the
+ * percentiles and the maximum of the heartbeat dispatch latency in
+ * micro-seconds.
+ *
+ * Returns: (transfer floating): A #GVariant of type a{sv}.
+ */
+GVariant *
+watchdog_get_counters (Watchdog *watchdog)
+{
+  g_return_val_if_fail (watchdog != NULL, NULL);
+
+  GVariantBuilder builder;
+  guint count, p50, p90, p99, max;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  g_mutex_lock (&watchdog->lock);
+  histogram_summarize (&watchdog->latency, &count, &p50, &p90, &p99, &max);
+  g_variant_builder_add (&builder, "{sv}", "beats",
+                         g_variant_new_uint64 (watchdog->beats));
+  g_variant_builder_add (&builder, "{sv}", "stalls",
+                         g_variant_new_uint64 (watchdog->n_stalls));
+  g_variant_builder_add (&builder, "{sv}", "stall-time",
+                         g_variant_new_uint64 (watchdog->stall_time));
+  g_mutex_unlock (&watchdog->lock);
+
+  g_variant_builder_add (&builder, "{sv}", "p50", g_variant_new_uint32 (p50));
+  g_variant_builder_add (&builder, "{sv}", "p90", g_variant_new_uint32 (p90));
+  g_variant_builder_add (&builder, "{sv}", "p99", g_variant_new_uint32 (p99));
+  g_variant_builder_add (&builder, "{sv}", "max", g_variant_new_uint32 (max));
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * watchdog_get_stalls:
+ * @watchdog: A #Watchdog.
+ *
+ * Gets the most recent stalls, newest first. Each stall is given by its
+ * wall clock time and its duration so far in micro-seconds, the name of the
+ * #GSource and the D-Bus method dispatched, empty if unknown, and the
+ * backtrace, empty unless enabled.
+ *
+ * Returns: (transfer floating): A #GVariant of type a(xtssas).
+ */
+GVariant *
+watchdog_get_stalls (Watchdog *watchdog)
+{
+  g_return_val_if_fail (watchdog != NULL, NULL);
+
+  GVariantBuilder builder;
+  gint64 now;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xtssas)"));
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&watchdog->lock);
+  for (guint64 i = watchdog->n_stalls;
+       i > 0 && i + STALL_RING_SIZE > watchdog->n_stalls; i--)
+    {
+      Stall *stall = &watchdog->ring[(i - 1) % STALL_RING_SIZE];
+      const gchar * const empty[] = { NULL };
+
+      g_variant_builder_add (&builder, "(xtss^as)",
+                             stall->time,
+                             stall == watchdog->current ?
+                             now - stall->start : stall->duration,
+                             stall->source != NULL ? stall->source : "",
+                             stall->method != NULL ? stall->method : "",
+                             stall->backtrace != NULL ?
+                             (const gchar * const *) stall->backtrace : empty);
+    }
+  g_mutex_unlock (&watchdog->lock);
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * watchdog_reset:
+ * @watchdog: A #Watchdog.
+ *
+ * Clears the counters and the recent stalls of @watchdog. An ongoing stall
+ * is kept as the only recent one, it is finished by the next heartbeat.
+ */
+void
+watchdog_reset (Watchdog *watchdog)
+{
+  g_return_if_fail (watchdog != NULL);
+
+  g_mutex_lock (&watchdog->lock);
+  watchdog->beats = 0;
+  watchdog->stall_time = 0;
+  histogram_reset (&watchdog->latency);
+  for (guint i = 0; i < STALL_RING_SIZE; i++)
+    {
+      if (&watchdog->ring[i] != watchdog->current)
+        stall_clear (&watchdog->ring[i]);
+    }
+  watchdog->n_stalls = 0;
+  if (watchdog->current != NULL)
+    {
+      /* the ring is filled from the first slot again */
+      if (watchdog->current != &watchdog->ring[0])
+        {
+          watchdog->ring[0] = *watchdog->current;
+          memset (watchdog->current, 0, sizeof (Stall));
+          watchdog->current = &watchdog->ring[0];
+        }
+      watchdog->n_stalls = 1;
+    }
+  g_mutex_unlock (&watchdog->lock);
+}